@@ -0,0 +1,1208 @@
+/* ================================ Benchmark suite =============================
+Runs without any hardware: every bus is an SDI12 object on an SDI12Emulator.
+    sdi12bench [decode|cpu|commands|load|serial|log|capture|epoll|coroutine|worker|ring|parse|buses|all]
+    sdi12bench replay FILE [bitNs] [noprofile]
+1 - decode - decode error rate versus edge jitter. Random printable characters are turned
+into edges with a uniform error of up to the jitter on every edge and fed straight to an
+SDI12Decoder, so this runs as fast as the CPU allows and does not depend on the machine.
+Then versus the sensor's clock error, with clock recovery inside each frame only and with
+a timing profile learnt from the frames before, as the SDI12 object keeps per address.
+2 - cpu - CPU time per byte. TX: compiling a waveform and playing it (mostly the spin
+before each edge). The cost of one pin write and of a state change (writeMask() of 3 pins)
+on the in-memory backend and on SDI12MmioGpio over anonymous memory. RX: decoding the
+edges of a byte and storing it in the ring.
+3 - commands - commands per second over the emulated bus, a! and aD0!, with and without
+the wake up break. The bus runs at 1200 baud, so this is bounded by the time on the wire.
+Then aD0! from a sensor that damages every other response, recovered by the retries of
+SDI12::transact().
+4 - load - decode error rate with a busy thread per CPU (times 2) competing with the bus,
+first on the normal scheduler, then through an SDI12Worker pinned to CPU 0 at SCHED_FIFO
+with memory locked. Without CAP_SYS_NICE the second run only pins and says so.
+5 - serial - aD0! on the bit-banged bus (emulator) and on an SDI12Uart bus whose tty is the
+slave of a pseudo-terminal pair, with a sensor thread on the master side. Commands per
+second and CPU time per transaction: of the calling thread, and of the whole process less
+the pty sensor (the emulator's share cannot be taken out and is included).
+6 - log - readings of 3 values, 10 s apart, appended to an SDI12Log in a temporary
+directory: time per reading, bytes per value against the same values as CSV lines, then
+a query of one day through the index against a query of everything.
+7 - capture - the cost of recording an edge (SDI12Capture::rx() in batches of 32) and the
+bytes it takes. Then aD0! from a sensor 4 % slow with 100 us of jitter, captured on the
+emulated bus and replayed through SDI12Replay: frames decoded live and offline, and the
+replay speed in edges per second.
+8 - epoll - aD0! on several emulated buses driven from one epoll loop on this thread: every
+bus's eventFd() is in the epoll set, a command is submit()ted and the next one submitted as
+soon as completed() returns the response. Commands per second of all buses together, loop
+wake ups and CPU time of the loop thread per transaction.
+9 - coroutine - the cost of the coroutine interface: an SDI12Task awaited from another one
+and returning at once (frame allocation, symmetric transfer there and back), then a!
+from BENCH_COROUTINE_TASKS tasks spread over the buses of 8, each its own workflow on the
+one SDI12Executor thread: commands per second, resumes and loop CPU per transaction, to
+set against the hand-written submit() loop of 8.
+10 - worker - BENCH_WORKER_PRODUCERS threads submit() a! to one SDI12Worker at the same time,
+each to its own sensor and a few at once, so slots are claimed and published out of order.
+Commands per second, then the transactions that got another thread's response, came back
+SDI12_OVERFLOW or were still not done BENCH_WORKER_STUCK_MS after being submitted.
+11 - ring - an SDI12Ring of BENCH_RING_CAPACITY with push() on one thread and the other
+thread consuming in turn with readInto(), peekRange() and skip(), view() and skip(), and
+read(). Every character is checked against the sequence pushed, so a character lost,
+repeated or out of order is counted; then characters per second through the ring.
+12 - parse - aD0! lines of 1 to 9 values parsed by SDI12Data::parse() and by the usual
+application code it replaces, a std::string copy read with a std::stringstream into a
+std::vector<double>, the same lines for both. Nanoseconds per line and per value, and the
+lines on which the two disagree.
+13 - buses - BENCH_BUSES emulated buses, each with its own sensor at its own address and
+values, driven at the same time from a thread per bus with aD0!. Commands per second of
+each bus and of all together, then the responses that held another bus's address or values
+(state shared between SDI12 objects would show here) and the other failures.
+replay FILE - decodes a capture and prints its commands (>) and responses (<), with '?' for
+a character that had an error, then the bit periods learnt. bitNs changes the nominal bit
+period and noprofile decodes every frame from it, to try a recorded waveform with other
+timing.
+*/
+#include <SDI12.h>
+#include <SDI12Emulator.h>
+#include <SDI12Worker.h>
+#include <SDI12Uart.h>
+#include <SDI12Log.h>
+#include <SDI12Coroutine.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define BENCH_DECODE_CHARS       20000                  //characters per jitter level
+#define BENCH_SKEW_JITTER_US     150                    //edge jitter of the clock error figures
+#define BENCH_CPU_BYTES          200000                 //bytes compiled or decoded per CPU figure
+#define BENCH_COMMANDS           20                     //commands per commands figure
+#define BENCH_LOAD_COMMANDS      40                     //transactions per load run
+#define BENCH_LOG_READINGS       100000                 //readings appended to the log
+#define BENCH_CAPTURE_EDGES      200000                 //edges recorded for the capture cost
+#define BENCH_REPLAYS            50                     //replays of the capture for the replay speed
+#define BENCH_EPOLL_BUSES        4                      //buses driven by the one event loop
+#define BENCH_AWAITS             1000000                //empty tasks awaited for the await cost
+#define BENCH_COROUTINE_TASKS    200                    //workflows on the one executor
+#define BENCH_WORKER_PRODUCERS   4                      //threads submitting to the one worker
+#define BENCH_WORKER_COMMANDS    16                     //transactions per producer
+#define BENCH_WORKER_BATCH       3                      //transactions a producer has in the queue at once
+#define BENCH_WORKER_STUCK_MS    3000                   //a transaction not done by then is stuck in the queue
+#define BENCH_RING_CHARS         20000000               //characters through the ring
+#define BENCH_RING_CAPACITY      64                     //small, so it wraps and fills all the time
+#define BENCH_PARSE_LINES        256                    //distinct aD0! lines
+#define BENCH_PARSE_ROUNDS       2000                   //times each parser goes through the lines
+#define BENCH_BUSES              4                      //buses each driven by a thread of its own
+
+static uint64_t cpuNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static uint64_t wallNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// edges of the frame of c starting at ns, every edge moved by up to jitterNs
+static int frameEdges(char c, uint64_t ns, uint32_t jitterNs, std::mt19937 &random, SDI12Edge *edges, double bitNs = SDI12_BIT_NS)
+{
+    std::uniform_int_distribution<int32_t> error(-(int32_t)jitterNs, (int32_t)jitterNs);
+    uint16_t frame = sdi12Encode(c);
+    uint8_t level = SDI12_HIGH;
+    int count = 0;
+    for(uint8_t bit = 0; bit < SDI12_FRAME_BITS; bit++)
+    {
+        uint8_t next = (frame >> bit) & 1;
+        if(next != level)
+        {
+            edges[count].ns = ns + (uint64_t)(bit * bitNs) + (jitterNs ? error(random) : 0);
+            edges[count].level = next;
+            count++;
+            level = next;
+        }
+    }
+    return count;
+}
+
+// 1 - errors decoding BENCH_DECODE_CHARS characters sent with a clock error of skewPpm, with a timing profile if learn
+static uint32_t decodeErrors(uint32_t jitterNs, int32_t skewPpm, bool learn)
+{
+    std::mt19937 random(jitterNs + skewPpm + 1);
+    std::uniform_int_distribution<int> printable(32, 126);
+    SDI12Decoder decoder;
+    SDI12Edge edges[SDI12_FRAME_BITS];
+    SDI12Frame frame;
+    double bitNs = SDI12_BIT_NS * (1.0 + skewPpm / 1e6);
+    uint64_t ns = 1000000000ULL;
+    uint32_t errors = 0;
+    uint32_t profile = 0;
+    for(int i = 0; i < BENCH_DECODE_CHARS; i++)
+    {
+        char c = (char)printable(random);
+        int count = frameEdges(c, ns, jitterNs, random, edges, bitNs);
+        bool done = false;
+        for(int e = 0; e < count; e++)
+        {
+            done = decoder.feed(edges[e], frame) || done;                       //an edge late past the stop bit centre completes it
+        }
+        ns += (uint64_t)((SDI12_FRAME_BITS + 2) * bitNs);                       //two bits of marking between frames
+        done = done || decoder.advance(ns - SDI12_BIT_NS, frame);
+        if(!done || frame.status != SDI12_FRAME_OK || frame.data != (uint8_t)c)
+        {
+            errors++;
+            decoder.reset(SDI12_HIGH);
+        }
+        else if(learn && frame.bitNs)                                           //as the SDI12 object does (6.3.5)
+        {
+            profile = profile ? profile + ((int32_t)frame.bitNs - (int32_t)profile) / (1 << SDI12_PROFILE_SHIFT) : frame.bitNs;
+            decoder.bitPeriod(profile);
+        }
+    }
+    return errors;
+}
+
+// 1 - decode error rate versus jitter and sensor clock error
+static void benchDecode()
+{
+    printf("decode error rate versus jitter (%d characters each)\n", BENCH_DECODE_CHARS);
+    printf("  jitter us   errors   error rate\n");
+    for(uint32_t jitterUs = 0; jitterUs <= 500; jitterUs += 50)
+    {
+        uint32_t errors = decodeErrors(jitterUs * 1000, 0, false);
+        printf("  %9u %8u %11.3f%%\n", jitterUs, errors, 100.0 * errors / BENCH_DECODE_CHARS);
+    }
+    printf("decode error rate versus sensor clock error, %d us jitter\n", BENCH_SKEW_JITTER_US);
+    printf("  clock error   in frame   with profile\n");
+    for(int32_t skewPpm = -80000; skewPpm <= 80000; skewPpm += 20000)
+    {
+        printf("  %+10.1f%% %9.3f%% %13.3f%%\n", skewPpm / 1e4,
+               100.0 * decodeErrors(BENCH_SKEW_JITTER_US * 1000, skewPpm, false) / BENCH_DECODE_CHARS,
+               100.0 * decodeErrors(BENCH_SKEW_JITTER_US * 1000, skewPpm, true) / BENCH_DECODE_CHARS);
+    }
+}
+
+// 2 - CPU time per byte
+static void benchCpu()
+{
+    printf("CPU time per byte\n");
+    const char *text = "0+3.1415926-0.0001234+1013.25+42.0+9999999";
+    size_t length = strlen(text);
+    SDI12Waveform wave;
+    uint64_t start = cpuNs();
+    size_t bytes = 0;
+    while(bytes < BENCH_CPU_BYTES)
+    {
+        wave.clear();
+        wave.wake();
+        wave.addString(std::string_view(text, length));
+        bytes += length;
+    }
+    printf("  TX compile            %8.1f ns/byte\n", (double)(cpuNs() - start) / bytes);
+
+    SDI12MockGpio gpio;
+    SDI12Jitter jitter;
+    wave.clear();
+    wave.addString("0D0!");
+    start = cpuNs();
+    uint64_t wall = wallNs();
+    wave.play(&gpio, 17, &jitter);
+    printf("  TX play               %8.1f us/byte CPU (%.1f%% of the wire time, max late %.1f us)\n",
+           (cpuNs() - start) / 4000.0, 100.0 * (cpuNs() - start) / (wallNs() - wall), jitter.maxLateNs / 1000.0);
+
+    std::vector<uint32_t> registers(SDI12_MMIO_LENGTH / 4);                     //anonymous memory in place of the register block
+    SDI12MmioGpio mmio(registers.data());
+    SDI12Gpio *pins[2] = { &gpio, &mmio };
+    const char *names[2] = { "mock", "registers" };
+    for(int p = 0; p < 2; p++)
+    {
+        start = cpuNs();
+        for(int i = 0; i < BENCH_CPU_BYTES; i++)
+        {
+            pins[p]->write(17, i & 1);
+        }
+        uint64_t single = cpuNs() - start;
+        start = cpuNs();
+        for(int i = 0; i < BENCH_CPU_BYTES; i++)
+        {
+            pins[p]->writeMask((i & 1) ? 0x8000010ULL : 0, (i & 1) ? 0x20000ULL : 0x8020010ULL);    //a state change, 3 pins
+        }
+        printf("  pin write %-10s %8.1f ns, state change %.1f ns\n", names[p], (double)single / BENCH_CPU_BYTES,
+               (double)(cpuNs() - start) / BENCH_CPU_BYTES);
+    }
+
+    std::mt19937 random(1);
+    std::vector<SDI12Edge> edges;
+    edges.reserve(BENCH_CPU_BYTES / 10 * SDI12_FRAME_BITS);
+    uint64_t ns = 1000000000ULL;
+    SDI12Edge frame[SDI12_FRAME_BITS];
+    for(int i = 0; i < BENCH_CPU_BYTES / 10; i++)
+    {
+        int count = frameEdges(text[i % length], ns, 0, random, frame);
+        edges.insert(edges.end(), frame, frame + count);
+        ns += (SDI12_FRAME_BITS + 1) * (uint64_t)SDI12_BIT_NS;
+    }
+    SDI12Decoder decoder;
+    SDI12Ring ring(256);
+    SDI12Frame out;
+    char sink[256];
+    uint32_t decoded = 0;
+    start = cpuNs();
+    for(size_t i = 0; i < edges.size(); i++)
+    {
+        if(decoder.feed(edges[i], out))
+        {
+            ring.push((char)out.data);
+            decoded++;
+            if(ring.available() == ring.capacity())
+            {
+                ring.readInto(sink, sizeof(sink));
+            }
+        }
+    }
+    printf("  RX decode and store   %8.1f ns/byte\n", (double)(cpuNs() - start) / (decoded ? decoded : 1));
+}
+
+// one transaction, true if the response is the expected one
+static bool exchange(SDI12 &bus, char address, std::string_view command, std::string_view expected)
+{
+    SDI12Response response;
+    if(bus.transact(SDI12Command(address, command), std::chrono::milliseconds(SDI12_DATA_TIMEOUT_MS), response) != SDI12_OK)
+    {
+        return false;
+    }
+    bool same = response.line == expected;
+    bus.releaseResponse();
+    return same;
+}
+
+// 3 - commands per second
+static void benchCommands()
+{
+    printf("commands per second over the emulated bus (%d each)\n", BENCH_COMMANDS);
+    SDI12Emulator emulator(17, 22);
+    SDI12SensorModel model;
+    model.address = '0';
+    model.data = "+3.14-2.5+1013.2";
+    emulator.addSensor(model);
+    model.address = '1';
+    model.damageEvery = 2;                                                      //every other response has a parity error
+    emulator.addSensor(model);
+    SDI12 bus(4, 17, 27, 22, &emulator);
+    bus.begin();
+    const char *commands[][2] = { { "", "0" }, { "D0", "0+3.14-2.5+1013.2" } };
+    for(int c = 0; c < 2; c++)
+    {
+        for(int gap = 0; gap < 2; gap++)                                        //back to back, then idle long enough to need the break
+        {
+            uint32_t ok = 0;
+            uint64_t busy = 0;
+            uint64_t breaks = bus.trace().counter(SDI12_COUNT_BREAKS);
+            for(int i = 0; i < BENCH_COMMANDS; i++)
+            {
+                if(gap)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
+                uint64_t start = wallNs();
+                ok += exchange(bus, '0', commands[c][0], commands[c][1]);
+                busy += wallNs() - start;
+            }
+            printf("  0%s! %-13s %6.2f commands/s, %u/%d ok, %lu breaks\n", commands[c][0], gap ? "after idle" : "back to back",
+                   BENCH_COMMANDS * 1e9 / busy, ok, BENCH_COMMANDS, (unsigned long)(bus.trace().counter(SDI12_COUNT_BREAKS) - breaks));
+        }
+    }
+    uint32_t ok = 0;
+    uint64_t busy = 0;
+    uint64_t retries = bus.trace().counter(SDI12_COUNT_RETRIES);
+    for(int i = 0; i < BENCH_COMMANDS; i++)
+    {
+        uint64_t start = wallNs();
+        ok += exchange(bus, '1', "D0", "1+3.14-2.5+1013.2");
+        busy += wallNs() - start;
+    }
+    printf("  1D0! half damaged  %6.2f commands/s, %u/%d ok, %lu retries\n", BENCH_COMMANDS * 1e9 / busy, ok, BENCH_COMMANDS,
+           (unsigned long)(bus.trace().counter(SDI12_COUNT_RETRIES) - retries));
+}
+
+// 4 - one load run, worker is 0 for transactions on this thread
+static void loadRun(const char *name, SDI12 &bus, SDI12Emulator &emulator, SDI12Worker *worker)
+{
+    uint32_t failed = 0;
+    uint64_t parity = bus.trace().counter(SDI12_COUNT_PARITY) + bus.trace().counter(SDI12_COUNT_STOP);
+    uint32_t txErrors = emulator.errors();
+    for(int i = 0; i < BENCH_LOAD_COMMANDS; i++)
+    {
+        if(worker)
+        {
+            SDI12Transaction transaction = worker->submit(SDI12Command('0', "D0")).get();
+            failed += transaction.status != SDI12_OK || transaction.view() != "0+3.14-2.5+1013.2";
+        }
+        else
+        {
+            failed += !exchange(bus, '0', "D0", "0+3.14-2.5+1013.2");
+        }
+    }
+    printf("  %-34s %3u/%d failed, %lu RX frame errors, %u TX frame errors\n", name, failed, BENCH_LOAD_COMMANDS,
+           (unsigned long)(bus.trace().counter(SDI12_COUNT_PARITY) + bus.trace().counter(SDI12_COUNT_STOP) - parity), emulator.errors() - txErrors);
+}
+
+// 4 - decode error rate under CPU load
+static void benchLoad()
+{
+    unsigned threads = 2 * (std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1);
+    printf("decode errors under load (%u busy threads, %d aD0! each)\n", threads, BENCH_LOAD_COMMANDS);
+    SDI12Emulator emulator(17, 22);
+    SDI12SensorModel model;
+    model.address = '0';
+    model.data = "+3.14-2.5+1013.2";
+    emulator.addSensor(model);
+    SDI12 bus(4, 17, 27, 22, &emulator);
+    bus.begin();
+    loadRun("idle, normal scheduler", bus, emulator, 0);
+
+    std::atomic<bool> busy(true);
+    std::vector<std::thread> burners;
+    for(unsigned i = 0; i < threads; i++)
+    {
+        burners.emplace_back([&busy]
+        {
+            volatile uint64_t spin = 0;
+            while(busy.load(std::memory_order_relaxed))
+            {
+                spin = spin + 1;
+            }
+        });
+    }
+    loadRun("loaded, normal scheduler", bus, emulator, 0);
+    {
+        SDI12Worker worker(bus, 0, 50, true);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        loadRun(worker.realtime() ? "loaded, worker SCHED_FIFO" : "loaded, worker (realtime refused)", bus, emulator, &worker);
+    }
+    busy = false;
+    for(size_t i = 0; i < burners.size(); i++)
+    {
+        burners[i].join();
+    }
+}
+
+// 5 - process CPU time in nanoseconds
+static uint64_t processNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// 5 - sensor '0' on the master side of a pty, answers a! and aD0! a character time per character late
+static void ptySensor(int master, std::atomic<bool> &running, std::atomic<uint64_t> &cpu)
+{
+    struct termios tty;
+    tcgetattr(master, &tty);
+    cfmakeraw(&tty);
+    tcsetattr(master, TCSANOW, &tty);
+    char command[SDI12_COMMAND_MAX + 1];
+    size_t length = 0;
+    while(running)
+    {
+        struct pollfd pfd;
+        pfd.fd = master;
+        pfd.events = POLLIN;
+        char bytes[32];
+        ssize_t got = poll(&pfd, 1, 50) > 0 ? ::read(master, bytes, sizeof(bytes)) : 0;
+        for(ssize_t i = 0; i < got; i++)
+        {
+            command[length < SDI12_COMMAND_MAX ? length++ : length] = bytes[i] & 0x7F;
+            if((bytes[i] & 0x7F) != '!')
+            {
+                continue;
+            }
+            std::string_view text(command, length);
+            const char *response = text == "0!" ? "0\r\n" : text == "0D0!" ? "0+3.14-2.5+1013.2\r\n" : 0;
+            length = 0;
+            if(response)
+            {
+                size_t size = strlen(response);
+                std::this_thread::sleep_for(std::chrono::nanoseconds(9000000 + size * SDI12_UART_FRAME_NS));   //response time and the wire
+                if(::write(master, response, size) < 0)
+                {
+                    break;
+                }
+                cpu = cpuNs();                                                  //CPU of this thread so far
+            }
+        }
+    }
+}
+
+// 5 - one bus, CPU per transaction of the caller's thread and of the whole process
+static void serialRun(const char *name, SDI12 &bus, std::atomic<uint64_t> &sensorCpu)
+{
+    uint32_t ok = 0;
+    uint64_t thread = cpuNs();
+    uint64_t process = processNs();
+    uint64_t sensor = sensorCpu;
+    uint64_t wall = wallNs();
+    for(int i = 0; i < BENCH_COMMANDS; i++)
+    {
+        ok += exchange(bus, '0', "D0", "0+3.14-2.5+1013.2");
+    }
+    printf("  %-22s %5.2f commands/s, %u/%d ok, CPU per transaction %7.1f us caller, %7.1f us process\n", name,
+           BENCH_COMMANDS * 1e9 / (wallNs() - wall), ok, BENCH_COMMANDS, (cpuNs() - thread) / 1000.0 / BENCH_COMMANDS,
+           (processNs() - process - (sensorCpu - sensor)) / 1000.0 / BENCH_COMMANDS);
+}
+
+// 5 - serial transport against bit-banging
+static void benchSerial()
+{
+    printf("serial transport over a pty pair against the bit-banged bus (%d aD0! each)\n", BENCH_COMMANDS);
+    {
+        SDI12Emulator emulator(17, 22);
+        SDI12SensorModel model;
+        model.data = "+3.14-2.5+1013.2";
+        emulator.addSensor(model);
+        SDI12 bus(4, 17, 27, 22, &emulator);
+        bus.begin();
+        std::atomic<uint64_t> none(0);
+        serialRun("bit-banged, emulator", bus, none);
+    }
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+    {
+        printf("  no pseudo-terminal: %s\n", strerror(errno));
+        return;
+    }
+    SDI12Uart uart(ptsname(master));
+    std::atomic<bool> running(true);
+    std::atomic<uint64_t> sensorCpu(0);
+    std::thread sensor(ptySensor, master, std::ref(running), std::ref(sensorCpu));
+    {
+        SDI12MockGpio enables;
+        SDI12 bus(&uart, 4, 27, &enables);
+        bus.begin();
+        serialRun("serial, pty", bus, sensorCpu);
+    }
+    running = false;
+    sensor.join();
+    close(master);
+}
+
+// 6 - counts the records a query visits
+static bool countRecord(const SDI12LogRecord &, void *)
+{
+    return true;
+}
+
+// 6 - binary log against text
+static void benchLog()
+{
+    printf("measurement log (%d readings of 3 values, 10 s apart)\n", BENCH_LOG_READINGS);
+    char directory[] = "/tmp/sdi12bench-XXXXXX";
+    if(!mkdtemp(directory))
+    {
+        printf("  no temporary directory: %s\n", strerror(errno));
+        return;
+    }
+    SDI12Reading reading;
+    reading.address = '0';
+    reading.status = SDI12_OK;
+    reading.data.clear('0');
+    reading.data.parse("0+3.14-2.5+1013.2");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t text = 0;
+    uint32_t segments;
+    uint64_t wall = wallNs();
+    {
+        SDI12Log log(directory);
+        for(int i = 0; i < BENCH_LOG_READINGS; i++)
+        {
+            reading.time = start + std::chrono::seconds(10 * i);
+            log.append(0, reading);
+        }
+        segments = log.segment();
+    }
+    double appendUs = (wallNs() - wall) / 1000.0 / BENCH_LOG_READINGS;
+    char line[96];
+    for(int i = 0; i < BENCH_LOG_READINGS; i++)
+    {
+        for(uint8_t v = 0; v < reading.data.count(); v++)                       //what a text log would hold
+        {
+            text += snprintf(line, sizeof(line), "2026-01-01T00:00:00.000,0,0,%u,%g,0\n", v, reading.data.value(v));
+        }
+    }
+    uint64_t values = (uint64_t)BENCH_LOG_READINGS * reading.data.count();
+    printf("  append %.2f us per reading, %u segments, %.1f bytes per value (text %.1f)\n", appendUs, segments,
+           (double)sizeof(SDI12LogRecord), (double)text / values);
+    SDI12LogReader reader(directory);
+    int64_t first = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    int64_t day = 86400LL * 1000000000LL;
+    wall = wallNs();
+    uint64_t found = reader.query(first + 5 * day, first + 6 * day, countRecord);
+    double dayUs = (wallNs() - wall) / 1000.0;
+    wall = wallNs();
+    uint64_t everything = reader.query(INT64_MIN, INT64_MAX, countRecord);
+    printf("  one day %llu records in %.0f us, everything %llu records in %.0f us\n", (unsigned long long)found, dayUs,
+           (unsigned long long)everything, (wallNs() - wall) / 1000.0);
+    for(uint32_t s = 1; s <= segments; s++)
+    {
+        snprintf(line, sizeof(line), "%s/%08u.sdl", directory, s);
+        unlink(line);
+    }
+    snprintf(line, sizeof(line), "%s/index.sdx", directory);
+    unlink(line);
+    rmdir(directory);
+}
+
+// 7 - counts the frames a replay decodes
+static void countFrame(uint8_t pin, const SDI12Frame &frame, void *user)
+{
+    uint64_t *counts = (uint64_t *)user;
+    counts[pin * 2 + (frame.status == SDI12_FRAME_OK ? 0 : 1)]++;
+}
+
+// 7 - capture cost, then a live capture replayed offline
+static void benchCapture()
+{
+    printf("edge capture and replay\n");
+    char path[] = "/tmp/sdi12bench-capture-XXXXXX";
+    int fd = mkstemp(path);
+    if(fd < 0)
+    {
+        printf("  no temporary file: %s\n", strerror(errno));
+        return;
+    }
+    close(fd);
+    {
+        SDI12Capture capture;
+        capture.open(path);
+        std::mt19937 random(1);
+        SDI12Edge edges[32];
+        int count = 0;
+        uint64_t ns = wallNs();
+        uint64_t cpu = 0;
+        for(int i = 0; i < BENCH_CAPTURE_EDGES / 4; i++)                        //'0' and most characters have about 4 edges
+        {
+            count += frameEdges((char)(32 + i % 95), ns, 0, random, edges + count, SDI12_BIT_NS);
+            ns += (SDI12_FRAME_BITS + 1) * (uint64_t)SDI12_BIT_NS;
+            if(count > 32 - SDI12_FRAME_BITS)
+            {
+                uint64_t start = cpuNs();
+                capture.rx(edges, count);
+                cpu += cpuNs() - start;
+                count = 0;
+            }
+        }
+        printf("  record  %.1f ns/edge, %.2f bytes/edge\n", (double)cpu / capture.edges(), (double)(capture.bytes() - sizeof(SDI12CaptureHeader)) / capture.edges());
+    }
+    SDI12Emulator emulator(17, 22);
+    SDI12SensorModel model;
+    model.data = "+3.14-2.5+1013.2";
+    model.skewPpm = 40000;
+    model.jitterNs = 100000;
+    emulator.addSensor(model);
+    SDI12 bus(4, 17, 27, 22, &emulator);
+    bus.begin();
+    bus.capture().open(path);
+    uint32_t ok = 0;
+    for(int i = 0; i < BENCH_COMMANDS; i++)
+    {
+        ok += exchange(bus, '0', "D0", "0+3.14-2.5+1013.2");
+    }
+    bus.capture().close();
+    uint64_t live = bus.trace().counter(SDI12_COUNT_FRAMES);
+    uint64_t liveErrors = bus.trace().counter(SDI12_COUNT_PARITY) + bus.trace().counter(SDI12_COUNT_STOP);
+    SDI12CaptureReader reader(path);
+    uint64_t counts[4] = { 0, 0, 0, 0 };
+    uint64_t edges = SDI12Replay().run(reader, countFrame, counts);
+    uint64_t wall = wallNs();
+    for(int i = 0; i < BENCH_REPLAYS; i++)
+    {
+        reader.rewind();
+        SDI12Replay().run(reader);
+    }
+    double seconds = (wallNs() - wall) / 1e9;
+    printf("  %u/%d aD0! ok, %llu edges: RX live %llu frames %llu errors, replayed %llu frames %llu errors, TX %llu frames\n",
+           ok, BENCH_COMMANDS, (unsigned long long)edges, (unsigned long long)live, (unsigned long long)liveErrors,
+           (unsigned long long)counts[0], (unsigned long long)counts[1], (unsigned long long)counts[2]);
+    printf("  replay  %.1f M edges/s\n", edges * BENCH_REPLAYS / seconds / 1e6);
+    unlink(path);
+}
+
+// 7 - prints the traffic of a capture file
+static void printFrame(uint8_t pin, const SDI12Frame &frame, void *user)
+{
+    uint8_t *last = (uint8_t *)user;
+    if(*last != pin + 1)
+    {
+        printf("%s%c ", *last ? "\n" : "", pin == SDI12_CAPTURE_TX ? '>' : '<');
+        *last = pin + 1;
+    }
+    if(frame.status != SDI12_FRAME_OK)
+    {
+        putchar('?');
+    }
+    else if(frame.data == '\r' || frame.data == '\n')
+    {
+        printf(frame.data == '\r' ? "<CR>" : "<LF>");
+    }
+    else
+    {
+        putchar(frame.data);
+    }
+}
+
+// 7 - replay FILE
+static int replayFile(int argc, char **argv)
+{
+    if(argc < 3)
+    {
+        printf("usage: sdi12bench replay FILE [bitNs] [noprofile]\n");
+        return 1;
+    }
+    SDI12CaptureReader reader(argv[2]);
+    if(!reader.ready())
+    {
+        return 1;
+    }
+    uint32_t bitNs = argc > 3 ? strtoul(argv[3], 0, 10) : reader.header().bitNs;
+    bool profiles = !(argc > 4 && strcmp(argv[4], "noprofile") == 0);
+    SDI12Replay replay(bitNs, profiles);
+    uint8_t last = 0;
+    uint64_t wall = wallNs();
+    uint64_t edges = replay.run(reader, printFrame, &last);
+    wall = wallNs() - wall;
+    printf("\n%llu edges in %.1f ms, RX %u frames %u errors, TX %u frames\n", (unsigned long long)edges, wall / 1e6,
+           replay.decoder(SDI12_CAPTURE_RX).frames(), replay.decoder(SDI12_CAPTURE_RX).errors(), replay.decoder(SDI12_CAPTURE_TX).frames());
+    for(int address = 0; address < 128; address++)
+    {
+        if(replay.profile(address))
+        {
+            printf("sensor %c: %u ns per bit\n", address, replay.profile(address));
+        }
+    }
+    return 0;
+}
+
+// 8 - several buses, one epoll loop, no thread of the application per bus
+static void benchEpoll()
+{
+    printf("%d emulated buses on one epoll loop with submit() (%d aD0! per bus)\n", BENCH_EPOLL_BUSES, BENCH_COMMANDS);
+    std::unique_ptr<SDI12Emulator> emulators[BENCH_EPOLL_BUSES];
+    std::unique_ptr<SDI12> buses[BENCH_EPOLL_BUSES];
+    int sent[BENCH_EPOLL_BUSES];
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+    if(epoll < 0)
+    {
+        printf("  no epoll: %s\n", strerror(errno));
+        return;
+    }
+    SDI12SensorModel model;
+    model.data = "+3.14-2.5+1013.2";
+    for(int i = 0; i < BENCH_EPOLL_BUSES; i++)
+    {
+        emulators[i].reset(new SDI12Emulator(17, 22));
+        emulators[i]->addSensor(model);
+        buses[i].reset(new SDI12(4, 17, 27, 22, emulators[i].get()));
+        buses[i]->begin();
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = i;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, buses[i]->eventFd(), &event);
+    }
+    uint64_t thread = cpuNs();
+    uint64_t wall = wallNs();
+    for(int i = 0; i < BENCH_EPOLL_BUSES; i++)
+    {
+        sent[i] = buses[i]->submit(SDI12Command('0', "D0")) ? 1 : BENCH_COMMANDS;
+    }
+    uint32_t done = 0;
+    uint32_t ok = 0;
+    uint32_t wakeups = 0;
+    uint32_t total = 0;
+    for(int i = 0; i < BENCH_EPOLL_BUSES; i++)
+    {
+        total += sent[i] == 1 ? BENCH_COMMANDS : 0;
+    }
+    while(done < total)
+    {
+        struct epoll_event events[BENCH_EPOLL_BUSES];
+        int ready = epoll_wait(epoll, events, BENCH_EPOLL_BUSES, 5000);
+        if(ready <= 0)
+        {
+            printf("  stalled after %u transactions\n", done);
+            break;
+        }
+        wakeups++;
+        for(int e = 0; e < ready; e++)
+        {
+            SDI12 &bus = *buses[events[e].data.u32];
+            SDI12Response response;
+            if(!bus.completed(response))
+            {
+                continue;
+            }
+            done++;
+            if(response.status == SDI12_OK)
+            {
+                ok += response.line == "0+3.14-2.5+1013.2";
+                bus.releaseResponse();
+            }
+            int &count = sent[events[e].data.u32];
+            if(count < BENCH_COMMANDS && bus.submit(SDI12Command('0', "D0")))
+            {
+                count++;
+            }
+        }
+    }
+    uint64_t busy = wallNs() - wall;
+    printf("  %6.2f commands/s in all, %5.2f per bus, %u/%u ok, %.2f loop wake ups and %.1f us loop CPU per transaction\n",
+           done * 1e9 / busy, done * 1e9 / busy / BENCH_EPOLL_BUSES, ok, total, done ? (double)wakeups / done : 0.0,
+           done ? (cpuNs() - thread) / 1000.0 / done : 0.0);
+    close(epoll);
+}
+
+// 9 - a task that returns at once
+static SDI12Task<int> emptyTask(int value)
+{
+    co_return value;
+}
+
+// 9 - awaits BENCH_AWAITS empty tasks
+static SDI12Task<> awaitLoop(uint64_t &sum)
+{
+    for(int i = 0; i < BENCH_AWAITS; i++)
+    {
+        sum += co_await emptyTask(i);
+    }
+}
+
+// 9 - one workflow, a! on its bus
+static SDI12Task<> acknowledge(SDI12 &bus, uint32_t &ok)
+{
+    SDI12Transaction transaction = co_await bus.command(SDI12Command('0', ""), std::chrono::milliseconds(SDI12_ACK_TIMEOUT_MS));
+    ok += transaction.status == SDI12_OK && transaction.view() == "0";
+}
+
+// 9 - coroutine overhead per await and per transaction
+static void benchCoroutine()
+{
+    printf("coroutine interface on one SDI12Executor\n");
+    {
+        SDI12Executor executor;
+        uint64_t sum = 0;
+        executor.spawn(awaitLoop(sum));
+        uint64_t thread = cpuNs();
+        executor.run();
+        printf("  awaited empty task     %6.1f ns CPU each (%d, sum %lu)\n", (cpuNs() - thread) / (double)BENCH_AWAITS, BENCH_AWAITS,
+               (unsigned long)sum);
+    }
+    std::unique_ptr<SDI12Emulator> emulators[BENCH_EPOLL_BUSES];
+    std::unique_ptr<SDI12> buses[BENCH_EPOLL_BUSES];
+    SDI12SensorModel model;
+    for(int i = 0; i < BENCH_EPOLL_BUSES; i++)
+    {
+        emulators[i].reset(new SDI12Emulator(17, 22));
+        emulators[i]->addSensor(model);
+        buses[i].reset(new SDI12(4, 17, 27, 22, emulators[i].get()));
+        buses[i]->begin();
+    }
+    SDI12Executor executor;
+    uint32_t ok = 0;
+    for(int i = 0; i < BENCH_COROUTINE_TASKS; i++)
+    {
+        executor.spawn(acknowledge(*buses[i % BENCH_EPOLL_BUSES], ok));
+    }
+    uint64_t thread = cpuNs();
+    uint64_t wall = wallNs();
+    executor.run();
+    uint64_t busy = wallNs() - wall;
+    printf("  %d a! workflows, %d buses %6.2f commands/s, %u/%d ok, %.2f resumes and %.1f us loop CPU per transaction\n",
+           BENCH_COROUTINE_TASKS, BENCH_EPOLL_BUSES, BENCH_COROUTINE_TASKS * 1e9 / busy, ok, BENCH_COROUTINE_TASKS,
+           (double)executor.resumes() / BENCH_COROUTINE_TASKS, (cpuNs() - thread) / 1000.0 / BENCH_COROUTINE_TASKS);
+}
+
+// 10 - several threads submitting to one worker
+static void benchWorker()
+{
+    printf("worker, %d threads submitting a! at once (%d each, %d in the queue per thread)\n", BENCH_WORKER_PRODUCERS,
+           BENCH_WORKER_COMMANDS, BENCH_WORKER_BATCH);
+    SDI12Emulator emulator(17, 22);
+    SDI12SensorModel model;
+    for(int p = 0; p < BENCH_WORKER_PRODUCERS; p++)
+    {
+        model.address = '0' + p;
+        emulator.addSensor(model);
+    }
+    SDI12 bus(4, 17, 27, 22, &emulator);
+    bus.begin();
+    std::atomic<uint32_t> ok(0);
+    std::atomic<uint32_t> wrong(0);
+    std::atomic<uint32_t> full(0);
+    std::atomic<uint32_t> stuck(0);
+    uint64_t wall;
+    {
+        SDI12Worker worker(bus);
+        std::vector<std::thread> producers;
+        wall = wallNs();
+        for(int p = 0; p < BENCH_WORKER_PRODUCERS; p++)
+        {
+            producers.emplace_back([&worker, &ok, &wrong, &full, &stuck, p]
+            {
+                char address = '0' + p;
+                for(int i = 0; i < BENCH_WORKER_COMMANDS; i += BENCH_WORKER_BATCH)
+                {
+                    std::future<SDI12Transaction> batch[BENCH_WORKER_BATCH];
+                    int count = BENCH_WORKER_COMMANDS - i < BENCH_WORKER_BATCH ? BENCH_WORKER_COMMANDS - i : BENCH_WORKER_BATCH;
+                    for(int b = 0; b < count; b++)
+                    {
+                        batch[b] = worker.submit(SDI12Command(address, ""));
+                    }
+                    for(int b = 0; b < count; b++)
+                    {
+                        if(batch[b].wait_for(std::chrono::milliseconds(BENCH_WORKER_STUCK_MS)) != std::future_status::ready)
+                        {
+                            stuck++;
+                            continue;
+                        }
+                        SDI12Transaction transaction = batch[b].get();
+                        if(transaction.status == SDI12_OVERFLOW)
+                        {
+                            full++;
+                        }
+                        else if(transaction.status == SDI12_OK && transaction.length == 1 && transaction.line[0] == address)
+                        {
+                            ok++;
+                        }
+                        else if(transaction.status == SDI12_OK)
+                        {
+                            wrong++;
+                        }
+                    }
+                }
+            });
+        }
+        for(size_t i = 0; i < producers.size(); i++)
+        {
+            producers[i].join();
+        }
+        wall = wallNs() - wall;
+    }
+    uint32_t total = BENCH_WORKER_PRODUCERS * BENCH_WORKER_COMMANDS;
+    printf("  a! from %d threads    %6.2f commands/s, %u/%u ok, %u wrong response, %u overflow, %u stuck\n", BENCH_WORKER_PRODUCERS,
+           total * 1e9 / wall, ok.load(), total, wrong.load(), full.load(), stuck.load());
+}
+
+// 11 - the character pushed at position i, 251 so it does not line up with the capacity
+static char ringChar(uint64_t i)
+{
+    return (char)(i % 251);
+}
+
+// 11 - one producer and one consumer on the ring
+static void benchRing()
+{
+    printf("ring, push() against readInto/peekRange/view/read on another thread (%d characters, capacity %d)\n", BENCH_RING_CHARS,
+           BENCH_RING_CAPACITY);
+    SDI12Ring ring(BENCH_RING_CAPACITY);
+    uint64_t full = 0;
+    uint64_t wall = wallNs();
+    std::thread producer([&ring, &full]
+    {
+        for(uint64_t i = 0; i < BENCH_RING_CHARS; i++)
+        {
+            while(!ring.push(ringChar(i)))
+            {
+                full++;
+                std::this_thread::yield();                                      //lets the consumer run on a single core
+            }
+        }
+    });
+    uint64_t position = 0;
+    uint64_t errors = 0;
+    uint64_t empty = 0;
+    uint32_t turn = 0;
+    char chunk[BENCH_RING_CAPACITY];
+    while(position < BENCH_RING_CHARS)
+    {
+        size_t count = 0;
+        size_t max = 1 + turn % BENCH_RING_CAPACITY;
+        switch(turn++ % 4)
+        {
+            case 0:
+                count = ring.readInto(chunk, max);
+                break;
+            case 1:
+                count = ring.skip(ring.peekRange(chunk, 0, max));
+                break;
+            case 2:
+            {
+                std::string_view run = ring.view(0, max);
+                memcpy(chunk, run.data(), run.size());
+                count = ring.skip(run.size());
+                break;
+            }
+            default:
+            {
+                int c = ring.read();
+                if(c >= 0)
+                {
+                    chunk[0] = (char)c;
+                    count = 1;
+                }
+            }
+        }
+        if(count == 0)
+        {
+            empty++;
+            std::this_thread::yield();
+        }
+        for(size_t k = 0; k < count; k++)
+        {
+            errors += chunk[k] != ringChar(position + k);
+        }
+        position += count;
+    }
+    producer.join();
+    wall = wallNs() - wall;
+    printf("  %.1f M characters/s, %lu wrong, %lu left over, %lu pushes on a full ring, %lu reads of an empty one\n",
+           BENCH_RING_CHARS * 1e3 / wall, (unsigned long)errors, (unsigned long)ring.available(), (unsigned long)full, (unsigned long)empty);
+}
+
+// 12 - the stringstream parser, as applications wrote it before SDI12Data
+static bool streamParse(std::string_view view, char &address, std::vector<double> &values)
+{
+    std::string line(view);
+    std::stringstream stream(line);
+    values.clear();
+    if(!(stream >> address))
+    {
+        return false;
+    }
+    double value;
+    while(stream >> value)
+    {
+        values.push_back(value);
+    }
+    return stream.eof() && !values.empty();
+}
+
+// 12 - in place parser against stringstream
+static void benchParse()
+{
+    printf("parsing aD0! lines, SDI12Data::parse() against std::stringstream (%d lines, %d rounds)\n", BENCH_PARSE_LINES,
+           BENCH_PARSE_ROUNDS);
+    std::mt19937 random(12);
+    std::vector<std::string> lines;
+    uint64_t values = 0;
+    for(int i = 0; i < BENCH_PARSE_LINES; i++)
+    {
+        char line[SDI12_RESPONSE_MAX];
+        int length = snprintf(line, sizeof(line), "%c", '0' + (int)(random() % 10));
+        int count = 1 + random() % 9;
+        for(int v = 0; v < count; v++)
+        {
+            int decimals = random() % 4;
+            double value = (double)(random() % 100000) / (decimals == 0 ? 1 : decimals == 1 ? 10 : decimals == 2 ? 100 : 1000);
+            length += snprintf(line + length, sizeof(line) - length, "%c%.*f", random() % 2 ? '+' : '-', decimals, value);
+        }
+        lines.push_back(line);
+        values += count;
+    }
+
+    SDI12Data data;
+    char address;
+    std::vector<double> parsed;
+    uint32_t disagree = 0;
+    for(size_t i = 0; i < lines.size(); i++)
+    {
+        bool same = data.parse(lines[i]) && streamParse(lines[i], address, parsed) && address == data.address() && parsed.size() == data.count();
+        for(size_t v = 0; same && v < parsed.size(); v++)
+        {
+            same = parsed[v] == data.value(v);
+        }
+        disagree += !same;
+    }
+
+    double sum = 0;                                                             //used, so neither loop is optimised away
+    uint64_t start = cpuNs();
+    for(int r = 0; r < BENCH_PARSE_ROUNDS; r++)
+    {
+        for(size_t i = 0; i < lines.size(); i++)
+        {
+            data.parse(lines[i]);
+            sum += data.value(0);
+        }
+    }
+    uint64_t inPlace = cpuNs() - start;
+    start = cpuNs();
+    for(int r = 0; r < BENCH_PARSE_ROUNDS; r++)
+    {
+        for(size_t i = 0; i < lines.size(); i++)
+        {
+            streamParse(lines[i], address, parsed);
+            sum += parsed[0];
+        }
+    }
+    uint64_t stream = cpuNs() - start;
+    uint64_t total = (uint64_t)BENCH_PARSE_LINES * BENCH_PARSE_ROUNDS;
+    printf("  SDI12Data::parse()  %7.1f ns per line, %5.1f ns per value\n", (double)inPlace / total, (double)inPlace / (values * BENCH_PARSE_ROUNDS));
+    printf("  std::stringstream   %7.1f ns per line, %5.1f ns per value, %.1f times slower\n", (double)stream / total,
+           (double)stream / (values * BENCH_PARSE_ROUNDS), (double)stream / inPlace);
+    printf("  %.1f values per line, %u lines parsed differently (checksum %g)\n", (double)values / BENCH_PARSE_LINES, disagree, sum);
+}
+
+// 13 - the aD0! response of the sensor on bus
+static std::string busResponse(int bus)
+{
+    char line[32];
+    snprintf(line, sizeof(line), "%c+%d.%d-%d%d", '0' + bus, bus + 1, bus + 1, bus + 1, bus + 1);
+    return line;
+}
+
+// 13 - a thread per bus
+static void benchBuses()
+{
+    printf("%d emulated buses, a thread each (%d aD0! per bus)\n", BENCH_BUSES, BENCH_COMMANDS);
+    std::unique_ptr<SDI12Emulator> emulators[BENCH_BUSES];
+    std::unique_ptr<SDI12> buses[BENCH_BUSES];
+    std::string expected[BENCH_BUSES];
+    uint64_t busy[BENCH_BUSES];
+    uint32_t ok[BENCH_BUSES];
+    uint32_t foreign[BENCH_BUSES];
+    for(int i = 0; i < BENCH_BUSES; i++)
+    {
+        expected[i] = busResponse(i);
+        SDI12SensorModel model;
+        model.address = '0' + i;
+        model.data = expected[i].substr(1);
+        emulators[i].reset(new SDI12Emulator(17, 22));
+        emulators[i]->addSensor(model);
+        buses[i].reset(new SDI12(4, 17, 27, 22, emulators[i].get()));
+        buses[i]->begin();
+    }
+    std::vector<std::thread> threads;
+    uint64_t wall = wallNs();
+    for(int i = 0; i < BENCH_BUSES; i++)
+    {
+        threads.emplace_back([&, i]
+        {
+            SDI12 &bus = *buses[i];
+            ok[i] = 0;
+            foreign[i] = 0;
+            uint64_t start = wallNs();
+            for(int c = 0; c < BENCH_COMMANDS; c++)
+            {
+                SDI12Response response;
+                if(bus.transact(SDI12Command('0' + i, "D0"), std::chrono::milliseconds(SDI12_DATA_TIMEOUT_MS), response) != SDI12_OK)
+                {
+                    continue;
+                }
+                if(response.line == expected[i])
+                {
+                    ok[i]++;
+                }
+                for(int other = 0; other < BENCH_BUSES; other++)                //any trace of another bus, address or values
+                {
+                    if(other != i && (response.line.find(expected[other].substr(1)) != std::string_view::npos || (!response.line.empty() && response.line[0] == expected[other][0])))
+                    {
+                        foreign[i]++;
+                        break;
+                    }
+                }
+                bus.releaseResponse();
+            }
+            busy[i] = wallNs() - start;
+        });
+    }
+    for(size_t i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+    wall = wallNs() - wall;
+    uint32_t allOk = 0;
+    uint32_t allForeign = 0;
+    for(int i = 0; i < BENCH_BUSES; i++)
+    {
+        printf("  bus %d               %6.2f commands/s, %u/%d ok, %u with another bus's data\n", i, BENCH_COMMANDS * 1e9 / busy[i], ok[i],
+               BENCH_COMMANDS, foreign[i]);
+        allOk += ok[i];
+        allForeign += foreign[i];
+    }
+    printf("  all buses           %6.2f commands/s, %u/%d ok, %u with another bus's data%s\n", BENCH_BUSES * BENCH_COMMANDS * 1e9 / wall, allOk,
+           BENCH_BUSES * BENCH_COMMANDS, allForeign, allForeign ? ", BUSES SHARE STATE" : "");
+}
+
+int main(int argc, char **argv)
+{
+    const char *which = argc > 1 ? argv[1] : "all";
+    if(strcmp(which, "replay") == 0)
+    {
+        return replayFile(argc, argv);
+    }
+    bool all = strcmp(which, "all") == 0;
+    if(all || strcmp(which, "decode") == 0)
+    {
+        benchDecode();
+    }
+    if(all || strcmp(which, "cpu") == 0)
+    {
+        benchCpu();
+    }
+    if(all || strcmp(which, "commands") == 0)
+    {
+        benchCommands();
+    }
+    if(all || strcmp(which, "load") == 0)
+    {
+        benchLoad();
+    }
+    if(all || strcmp(which, "serial") == 0)
+    {
+        benchSerial();
+    }
+    if(all || strcmp(which, "log") == 0)
+    {
+        benchLog();
+    }
+    if(all || strcmp(which, "capture") == 0)
+    {
+        benchCapture();
+    }
+    if(all || strcmp(which, "epoll") == 0)
+    {
+        benchEpoll();
+    }
+    if(all || strcmp(which, "coroutine") == 0)
+    {
+        benchCoroutine();
+    }
+    if(all || strcmp(which, "worker") == 0)
+    {
+        benchWorker();
+    }
+    if(all || strcmp(which, "ring") == 0)
+    {
+        benchRing();
+    }
+    if(all || strcmp(which, "parse") == 0)
+    {
+        benchParse();
+    }
+    if(all || strcmp(which, "buses") == 0)
+    {
+        benchBuses();
+    }
+    return 0;
+}
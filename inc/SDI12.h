@@ -2,28 +2,118 @@
 #define __SDI12_H__
 
 #include <string>
+#include <string_view>
 #include <errno.h>
 #include <stdlib.h>
 #include <inttypes.h>
 #include <iostream>
-#include <wiringPi.h>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <pthread.h>
+#include <SDI12Gpio.h>
+#include <SDI12Decoder.h>
+#include <SDI12Waveform.h>
+#include <SDI12Command.h>
+#include <SDI12Ring.h>
+#include <SDI12Data.h>
+#include <SDI12Trace.h>
+#include <SDI12Uart.h>
+#include <SDI12Capture.h>
+
+#define SDI12_BUFFER_SIZE      128                       //default buffer size, a power of two
+#define SDI12_NO_PIN           255                       //data pin of a serial bus, not a GPIO pin
+#define SDI12_MAX_SENSORS      62                        //addresses 0-9, A-Z and a-z
+#define SDI12_ACK_TIMEOUT_MS   100                       //15 ms to start plus a short response on the wire
+#define SDI12_DATA_TIMEOUT_MS  800                       //15 ms to start plus a 75 character response on the wire
+#define SDI12_RETRIES          3                         //times transact() sends a failed command again, the standard asks for at least 3
+#define SDI12_RETRY_GAP_MS     17                        //marking after the last frame before a retry, 16.67 ms in the standard
+#define SDI12_PROFILE_SHIFT    3                         //a timing profile moves 1/8 of the way to each frame's period
+
+template<typename T> class SDI12Task;                                                  //coroutine interface, see SDI12Coroutine.h
+struct SDI12Transaction;
+struct SDI12Reading;
+
+enum SDI12Status                                                                            //outcome of awaitResponse()
+{
+    SDI12_OK = 0,                                                                           //a complete line ending in <CR><LF> was received
+    SDI12_TIMEOUT,                                                                          //the deadline passed first
+    SDI12_PARITY_ERROR,                                                                     //a character had a parity or stop bit error
+    SDI12_OVERFLOW,                                                                         //the buffer overflowed
+    SDI12_INVALID                                                                           //a line was received but is not a valid data response
+};
+
+struct SDI12Response
+{
+    SDI12Status status;                                                                     //SDI12_OK if line holds a response
+    std::string_view line;                                                                  //the response without <CR><LF>, points into the buffer
+};
 
 class SDI12
 {
     private:
-        static void setState(uint8_t state);                                                //set the state of the SDI12 objects
-        void wakeSensors();                                                                 //Used to wake up all sensors on the SDI12 bus
-        void writeChar(uint8_t out);                                                        //sends a char out on the data line
-        static inline void receiveChar();                                                   //used by the ISR(interrupt service routine) to grab a char from data line
+        uint8_t _txEnable;                                                                  //(JMC: refernce to the pin that connects to one of the SN74HCT240 output enable pins)
+        uint8_t _txDataPin;                                                                 //(JMC: reference to the tx data pin)
+        uint8_t _rxEnable;                                                                  //(JMC: reference to the pin that connects to one of the SN74HCT240 output enable pins)
+        uint8_t _rxDataPin;                                                                 //(JMC: reference to the rx data pin)
+        SDI12Gpio *_gpio;                                                                   //pin backend every level, pull and edge change goes through
+        bool _ownsGpio;                                                                     //true if the backend was created by the constructor
+        SDI12Uart *_uart;                                                                   //serial transport, 0 if the bus is on the data pins
+        SDI12Decoder _decoder;                                                              //rebuilds frames from the RX data pin edges
+        std::thread _rxThread;                                                              //listening thread of this bus, its interrupt service routine
+        std::atomic<bool> _rxRunning;                                                       //true while the listening thread should run
+        SDI12Jitter _txJitter;                                                              //timing report of the last transmission
+        SDI12Trace _trace;                                                                  //counters, event trace and latency histogram
+        SDI12Capture _capture;                                                              //RX and TX edges recorded to a file, see SDI12Capture.h
+        std::atomic<bool> _bufferOverflow;                                                  //(buffer overflow status)
+        std::atomic<bool> _parityError;                                                     //(parity error status)
+        std::atomic<bool> _discarding;                                                      //the rest of a line with an error is being dropped
+        SDI12Ring _rx;                                                                      //buffer for incoming ascii characters
+        std::mutex _rxLock;                                                                 //awaitResponse() sleeps on _rxReady with this lock
+        std::condition_variable _rxReady;                                                   //notified when a <LF> after a <CR> or an error is received
+        char _lastChar;                                                                     //previous character stored by the listening thread
+        std::atomic<uint64_t> _lastMarkingNs;                                               //CLOCK_MONOTONIC time the line last went back to marking, 0 if unknown
+        std::atomic<char> _rxAddress;                                                       //address of the last command sent, whose sensor answers
+        std::atomic<uint32_t> _bitProfile[128];                                             //timing profile, bit period learnt for each address, 0 if none
+        size_t _responseLength;                                                             //characters of the last response, <CR><LF> included, not yet released
+        int _eventFd;                                                                       //eventfd, readable when a submitted command is done, see eventFd()
+        std::atomic<uint8_t> _submitState;                                                  //stage of the submitted command, SDI12_SUBMIT_* in SDI12.cpp
+        SDI12Command _submitted;                                                            //command given to submit()
+        std::chrono::milliseconds _submitTimeout;                                           //its response timeout
+        uint8_t _submitRetries;                                                             //times it may be sent again
+        bool (*_submitCheck)(std::string_view line);                                        //rejects a response line, 0 if none
+        uint8_t _submitAttempt;                                                             //times it has been sent again
+        uint64_t _submitDeadlineNs;                                                         //CLOCK_MONOTONIC time its response or its retry is due
+        SDI12Status _submitStatus;                                                          //its outcome once done
+        bool findLine(size_t &length);                                                      //looks for <CR><LF> in the buffer
+        void wakeWaiter();                                                                  //wakes awaitResponse()
+        void wakeListener();                                                                //ends the wait of the listening thread early
+        void signalEvent();                                                                 //makes eventFd() readable
+        int64_t idleUs();                                                                   //longest wait of the listening thread
+        void serveSubmitted();                                                              //listening thread: sends, retries and completes the submitted command
+        void setState(uint8_t state);                                                       //set the state of the SDI12 objects
+        void receiveChar();                                                                 //used by the ISR(interrupt service routine) to decode the edges of the data line
+        void storeChar(const SDI12Frame &frame);                                            //stores a decoded character in the buffer
+        void listen();                                                                      //listening thread, calls handleInterrupt() until the destructor
+        void sendSerial(std::string_view cmd, bool awake);                                  //sendCommand() on a serial bus
+        void receiveSerial();                                                               //receiveChar() on a serial bus
     public:
-        SDI12(uint8_t txEnable, uint8_t txDataPin, uint8_t rxEnable, uint8_t rxDataPin);    //constructor
+        SDI12(uint8_t txEnable, uint8_t txDataPin, uint8_t rxEnable, uint8_t rxDataPin, SDI12Gpio *gpio = 0, size_t bufferSize = SDI12_BUFFER_SIZE);    //constructor (gpio = 0 uses the Raspberry Pi backend, see SDI12Gpio.h)
+        SDI12(SDI12Uart *uart, uint8_t txEnable, uint8_t rxEnable, SDI12Gpio *gpio = 0, size_t bufferSize = SDI12_BUFFER_SIZE);   //serial bus on uart, the caller owns it
         ~SDI12();                                                                           //destructor
         void begin();                                                                       //enable SDI-12 object
-        static void end();                                                                  //disable SDI-12 object
+        void end();                                                                         //disable SDI-12 object
         void forceHold();                                                                   //sets line state to HOLDING
-        void sendCommand(std::string cmd);                                                  //sends the String cmd out on the data line
+        void sendCommand(std::string_view cmd);                                             //sends the String cmd out on the data line
+        void sendCommand(const SDI12Command &cmd);                                          //sends a built command out on the data line
+        SDI12Jitter txJitter();                                                             //timing report of the last sendCommand()
+        uint32_t bitProfile(char address);                                                  //bit period learnt for the sensor at address, 0 if none yet
+        void bitProfile(char address, uint32_t bitNs);                                      //sets the bit period of the sensor at address, 0 forgets it
         bool overflowStatus();                                                              //(JMC: returns the overflow status)
         bool parityErrorStatus();                                                           //(JMC: returns parity error status)
+        bool realtimeListener(int cpu, int priority);                                       //pins the listening thread and runs it SCHED_FIFO, false if refused
         int availabe();                                                                     //returns the number of bytes available in buffer
         bool LFCheck();                                                                     //(JNC: Checks the last character in the buffer is a <LF>)
         bool CRCheck();                                                                     //(JMC: checks the last character in the buffer is a <CR>)
@@ -31,8 +121,27 @@ class SDI12
         void flush();                                                                       //resets the circular buffer head and tail, resets the voerflow and parity error status
         int read();                                                                         //returns next byte in the buffer(consumes)
         void advanceBufHead(int advance);                                                   //(JMC: advance the buffer head)
-        static inline void handleInterrupt();                                               //intermediary ISR(interrupt service routine) function
+        size_t readInto(char *dst, size_t max);                                             //consumes up to max characters into dst, returns how many
+        size_t peekRange(char *dst, size_t offset, size_t max);                             //copies characters after the head without consuming, returns how many
+        SDI12Response awaitResponse(std::chrono::steady_clock::time_point deadline);        //sleeps until a complete response, an error or the deadline
+        void releaseResponse();                                                             //consumes the response returned by awaitResponse()
+        SDI12Status awaitData(std::chrono::steady_clock::time_point deadline, SDI12Data &data);    //awaitResponse(), parses the values and releases the line
+        SDI12Status transact(const SDI12Command &command, std::chrono::milliseconds timeout, SDI12Response &response,
+                             uint8_t retries = SDI12_RETRIES, bool (*check)(std::string_view line) = 0);   //sends command until its response line arrives, check can reject the line
+        int eventFd() const;                                                                //readable when a submitted command is done or a response arrives, -1 if none
+        bool submit(const SDI12Command &command, std::chrono::milliseconds timeout = std::chrono::milliseconds(SDI12_DATA_TIMEOUT_MS),
+                    uint8_t retries = SDI12_RETRIES, bool (*check)(std::string_view line) = 0);    //transact() without waiting, false if a command is in flight
+        bool completed(SDI12Response &response);                                            //true once the submitted command is done, response as transact() gives it
+        SDI12Task<SDI12Transaction> command(SDI12Command cmd, std::chrono::milliseconds timeout = std::chrono::milliseconds(SDI12_DATA_TIMEOUT_MS),
+                                            uint8_t retries = SDI12_RETRIES);               //co_await: transact() on an SDI12Executor
+        SDI12Task<SDI12Transaction> identify(char address);                                 //co_await: the aI! response of the sensor at address
+        SDI12Task<SDI12Reading> measure(char address, std::string_view command = "M");     //co_await: aM! (MC, C, CC), the wait and aD0!..aD9!
+        SDI12Trace &trace();                                                                //counters, event trace and latency histogram of this bus
+        SDI12Capture &capture();                                                            //edge capture of this bus, open() it to record
+        void handleInterrupt();                                                             //intermediary ISR(interrupt service routine) function
 
 };
 
+bool sdi12Realtime(pthread_t thread, int cpu, int priority);                                //pins thread to cpu (-1 any) and runs it SCHED_FIFO at priority (0 unchanged)
+
 #endif
\ No newline at end of file
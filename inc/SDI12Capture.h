@@ -0,0 +1,124 @@
+#ifndef __SDI12CAPTURE_H__
+#define __SDI12CAPTURE_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <SDI12Gpio.h>
+#include <SDI12Decoder.h>
+
+/* ================================ Edge capture ================================
+Records what happened on the wire of one bus, so a sensor that answers garbage in the field
+can be looked at, and decoded again, at a desk:
+- SDI12Capture writes every edge of the RX data pin, as the listening thread got it from the
+kernel, and every edge of the TX data pin, as the waveform scheduled it from the time
+play() started it, to a binary file. SDI12::capture() gives the capture of a bus; while it
+is not open it costs the bus one relaxed load per batch of edges and per command.
+- Each edge is one unsigned LEB128 varint: the time since the previous edge, zigzag encoded
+(TX edges are written after the command has been played and may be older than the last
+RX edge), shifted left by 2, with the pin in bit 1 and the level in bit 0. The delta in ns
+is so stored times 8: an edge up to 262 us (2^18 ns) after the last one takes 3 bytes, up to
+33.5 ms (2^25 ns) 4 bytes, so every edge of a waveform at 833 us per bit takes 4 bytes, and
+up to 4.29 s (2^32 ns) 5 bytes. Edges are encoded into a 64 KiB buffer that is written out
+when full and by close().
+- The file starts with a 32 byte SDI12CaptureHeader: "SDIC", version, the nominal bit period,
+the CLOCK_MONOTONIC time the first delta counts from and the wall clock time of that moment.
+SDI12CaptureReader maps a capture and returns its edges one by one. SDI12Replay feeds them
+through an SDI12Decoder per pin at full CPU speed: the RX decoder is given the bit period
+learnt for the addressed sensor between frames and the TX decoder rebuilds the commands,
+whose first character is the address, exactly as the SDI12 object does live. The nominal
+bit period and the use of profiles can be changed to see what they do to a recorded
+waveform. A serial bus (SDI12Uart) has no edges and records nothing.
+*/
+#define SDI12_CAPTURE_VERSION    1                      //format of the capture file
+#define SDI12_CAPTURE_BUFFER     65536                  //bytes encoded before a write()
+#define SDI12_CAPTURE_RX         0                      //edge of the RX data pin
+#define SDI12_CAPTURE_TX         1                      //edge of the TX data pin
+
+struct SDI12CaptureHeader                                                               //start of a capture file, 32 bytes
+{
+    char magic[4];                                                                      //"SDIC"
+    uint16_t version;                                                                   //SDI12_CAPTURE_VERSION
+    uint16_t reserved;
+    uint32_t bitNs;                                                                     //nominal bit period of the bus
+    uint32_t reserved2;
+    uint64_t startNs;                                                                   //CLOCK_MONOTONIC time the first edge counts from
+    int64_t wallNs;                                                                     //CLOCK_REALTIME at startNs, nanoseconds since the Unix epoch
+};
+
+struct SDI12CaptureEdge                                                                 //one recorded edge
+{
+    uint64_t ns;                                                                        //CLOCK_MONOTONIC time of the edge
+    uint8_t pin;                                                                        //SDI12_CAPTURE_RX or SDI12_CAPTURE_TX
+    uint8_t level;                                                                      //SDI12_LOW or SDI12_HIGH
+};
+
+class SDI12Capture
+{
+    private:
+        std::mutex _lock;                                                               //held while encoding and writing
+        std::atomic<bool> _open;                                                        //a file is open
+        int _fd;                                                                        //capture file, -1 if none
+        uint64_t _lastNs;                                                               //time of the previous edge
+        size_t _used;                                                                   //bytes in _buffer
+        uint64_t _edges;                                                                //edges recorded
+        uint64_t _bytes;                                                                //bytes written to the file
+        uint8_t _buffer[SDI12_CAPTURE_BUFFER];                                          //encoded edges not written yet
+        void put(uint64_t ns, uint8_t pin, uint8_t level);                              //encodes one edge, _lock held
+        void drain();                                                                   //writes _buffer out, _lock held
+    public:
+        SDI12Capture();
+        ~SDI12Capture();                                                                //closes the file
+        SDI12Capture(const SDI12Capture &) = delete;
+        SDI12Capture &operator=(const SDI12Capture &) = delete;
+        bool open(const char *path, uint32_t bitNs = SDI12_BIT_NS);                     //starts recording to path, replacing a capture already open
+        void close();                                                                   //writes what is buffered and closes the file
+        bool active() const                                                             //true while a file is open, one relaxed load
+        {
+            return _open.load(std::memory_order_relaxed);
+        }
+        void rx(const SDI12Edge *edges, int count);                                     //records edges of the RX data pin
+        void tx(const SDI12Edge *edges, int count, uint64_t startNs);                   //records a waveform, edge times are offsets from startNs
+        uint64_t edges();                                                               //returns the number of edges recorded
+        uint64_t bytes();                                                               //returns the size of the file so far, header and buffer included
+};
+
+class SDI12CaptureReader
+{
+    private:
+        const uint8_t *_map;                                                            //the mapped file, 0 if it is not a capture
+        size_t _length;                                                                 //its size
+        size_t _at;                                                                     //offset of the next edge
+        uint64_t _ns;                                                                   //time of the previous edge
+    public:
+        SDI12CaptureReader(const char *path);                                           //maps a capture file
+        ~SDI12CaptureReader();
+        SDI12CaptureReader(const SDI12CaptureReader &) = delete;
+        SDI12CaptureReader &operator=(const SDI12CaptureReader &) = delete;
+        bool ready() const;                                                             //true if the file is a capture of this version
+        const SDI12CaptureHeader &header() const;                                       //returns the header, ready() must be true
+        bool next(SDI12CaptureEdge &edge);                                              //returns the next edge, false at the end or at a truncated edge
+        void rewind();                                                                  //goes back to the first edge
+};
+
+typedef void (*SDI12ReplayHandler)(uint8_t pin, const SDI12Frame &frame, void *user);  //called for every frame decoded on pin
+
+class SDI12Replay
+{
+    private:
+        SDI12Decoder _decoder[2];                                                       //RX and TX decoders
+        uint32_t _bitNs;                                                                //nominal bit period
+        bool _profiles;                                                                 //learn a bit period per address as SDI12 does
+        uint32_t _profile[128];                                                         //bit period learnt per address, 0 if none
+        char _address;                                                                  //first character of the last command
+        bool _command;                                                                  //the next TX frame starts a command
+        void frame(uint8_t pin, const SDI12Frame &frame, SDI12ReplayHandler handler, void *user);   //learns from and hands over one frame
+    public:
+        SDI12Replay(uint32_t bitNs = SDI12_BIT_NS, bool profiles = true);
+        uint64_t run(SDI12CaptureReader &reader, SDI12ReplayHandler handler = 0, void *user = 0);  //decodes every edge of reader, returns how many
+        const SDI12Decoder &decoder(uint8_t pin) const;                                 //returns the decoder of SDI12_CAPTURE_RX or SDI12_CAPTURE_TX
+        uint32_t profile(char address) const;                                           //returns the bit period learnt for address, 0 if none
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef __SDI12COMMAND_H__
+#define __SDI12COMMAND_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <string_view>
+
+/* =============================== Command builder ==============================
+An SDI-12 command is the sensor address, the command and a '!', for example "0M!",
+"3D0!" or "?!". SDI12Command builds one in a fixed array, so building and sending a
+command never allocates, and it can be built at compile time:
+    constexpr SDI12Command measure('0', "M");       // "0M!"
+If the text does not fit, overflow() is true and the command is not sent.
+*/
+#define SDI12_COMMAND_MAX        40                     //longest command, including address and '!'
+
+class SDI12Command
+{
+    private:
+        char _text[SDI12_COMMAND_MAX];                                                  //address, command and '!'
+        uint8_t _length;                                                                //characters in _text
+        bool _overflow;                                                                 //text was longer than SDI12_COMMAND_MAX
+    public:
+        constexpr SDI12Command() : _text(), _length(0), _overflow(false)
+        {
+        }
+        constexpr SDI12Command(char address, std::string_view command) : _text(), _length(0), _overflow(false)
+        {
+            append(address);
+            append(command);
+            append('!');
+        }
+        constexpr SDI12Command &append(char c)                                         //adds one character
+        {
+            if(_length < SDI12_COMMAND_MAX)
+            {
+                _text[_length++] = c;
+            }
+            else
+            {
+                _overflow = true;
+            }
+            return *this;
+        }
+        constexpr SDI12Command &append(std::string_view text)                          //adds every character of text
+        {
+            for(size_t i = 0; i < text.size(); i++)
+            {
+                append(text[i]);
+            }
+            return *this;
+        }
+        constexpr std::string_view view() const                                        //returns the command text
+        {
+            return std::string_view(_text, _length);
+        }
+        constexpr char address() const                                                  //returns the sensor address, 0 if empty
+        {
+            return _length ? _text[0] : 0;
+        }
+        constexpr bool overflow() const                                                 //true if the text did not fit
+        {
+            return _overflow;
+        }
+};
+
+static_assert(SDI12Command('0', "M").view() == "0M!", "address + command + '!'");
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef __SDI12CONFIG_H__
+#define __SDI12CONFIG_H__
+
+#include <inttypes.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <SDI12.h>
+
+class SDI12Scheduler;
+
+/* ================================ Configuration ===============================
+Describes the buses of a data logger and the sensors it polls, in the key = value format of
+the old ConfigFile (';' starts a comment), with a [bus] or [sensor] section per bus or sensor:
+
+    [bus]
+    name     = north                ; sensors refer to the bus by name
+    txEnable = 4                    ; BCM pins of the SN74HCT240, as given to SDI12
+    txData   = 17
+    rxEnable = 27
+    rxData   = 22
+    ; serial = /dev/serial0         ; instead of txData and rxData: the bus is on this UART
+
+    [sensor]
+    bus      = north                ; may be left out when there is only one bus
+    address  = 0
+    command  = MC                   ; M, MC, C or CC, optionally followed by 1-9, M if left out
+    interval = 10min                ; ms, s, min or h, a bare number is seconds, 0 measures once
+
+The text is parsed in one pass over string_views, numbers with std::from_chars, into an
+SDI12Config: fixed arrays of plain structs, so the code that runs the buses reads fields
+instead of looking keys up and converting strings. Every error is reported with its line
+number, parsing goes on after one, and a text with any error yields no configuration at all.
+An SDI12Config is immutable once built: parse() and load() hand out a shared_ptr to a const
+snapshot, which a reader keeps for as long as it uses it, however often it is reloaded.
+schedule() adds the sensors of one bus to an SDI12Scheduler.
+*/
+#define SDI12_CONFIG_BUSES       8                      //largest number of buses
+#define SDI12_CONFIG_SENSORS     128                    //largest number of sensors, all buses together
+#define SDI12_CONFIG_NAME        16                     //bus name, terminator included
+#define SDI12_CONFIG_PATH        64                     //serial device path, terminator included
+#define SDI12_CONFIG_MESSAGE     96                     //error message, terminator included
+
+struct SDI12BusConfig                                                                   //one [bus] section
+{
+    char name[SDI12_CONFIG_NAME];                                                       //name the sensors refer to
+    uint8_t txEnable;                                                                   //SN74HCT240 TX output enable pin
+    uint8_t txDataPin;                                                                  //TX data pin, SDI12_NO_PIN on a serial bus
+    uint8_t rxEnable;                                                                   //SN74HCT240 RX output enable pin
+    uint8_t rxDataPin;                                                                  //RX data pin, SDI12_NO_PIN on a serial bus
+    char serial[SDI12_CONFIG_PATH];                                                     //tty of a serial bus, empty for a bus on the data pins
+};
+
+struct SDI12SensorConfig                                                                //one [sensor] section
+{
+    uint8_t bus;                                                                        //index of its bus
+    char address;                                                                       //sensor address
+    char command[4];                                                                    //measurement command without address and '!', e.g. "MC2"
+    uint8_t commandLength;                                                              //characters in command
+    std::chrono::milliseconds interval;                                                 //polling interval, 0 measures once
+    std::string_view measurement() const { return std::string_view(command, commandLength); }
+};
+
+struct SDI12ConfigError                                                                 //one problem found by parse()
+{
+    uint32_t line;                                                                      //line number from 1, 0 for the file as a whole
+    char message[SDI12_CONFIG_MESSAGE];                                                 //what is wrong
+};
+
+class SDI12Config
+{
+    private:
+        SDI12BusConfig _buses[SDI12_CONFIG_BUSES];                                      //buses in the order of their sections
+        uint8_t _busCount;                                                              //buses in _buses
+        SDI12SensorConfig _sensors[SDI12_CONFIG_SENSORS];                               //sensors in the order of their sections
+        uint8_t _sensorCount;                                                           //sensors in _sensors
+        SDI12Config();
+        friend class SDI12ConfigParser;
+    public:
+        static std::shared_ptr<const SDI12Config> parse(std::string_view text, std::vector<SDI12ConfigError> &errors);   //0 and errors if text has any
+        static std::shared_ptr<const SDI12Config> load(const char *path, std::vector<SDI12ConfigError> &errors);         //parse() of a file
+        uint8_t buses() const;                                                          //returns the number of buses
+        const SDI12BusConfig &bus(uint8_t index) const;                                 //returns a bus, index < buses()
+        int findBus(std::string_view name) const;                                       //returns the index of the named bus, -1 if none
+        uint8_t sensors() const;                                                        //returns the number of sensors
+        const SDI12SensorConfig &sensor(uint8_t index) const;                           //returns a sensor, index < sensors()
+        int findSensor(uint8_t bus, char address) const;                                //returns the index of the sensor at address on bus, -1 if none
+        uint8_t schedule(SDI12Scheduler &scheduler, uint8_t bus) const;                 //adds the sensors of bus to scheduler, returns how many were added
+};
+
+/* ================================= Hot reload =================================
+An SDI12ConfigWatcher loads a configuration file, then watches it with inotify on a thread of
+its own and loads it again whenever it is written, so intervals can be changed and sensors
+added or removed without restarting the process:
+- The directory of the file is watched rather than the file, so a file replaced by an editor
+or by mv (a new inode renamed over the old one) is followed as well as one written in place.
+Events are collected for SDI12_CONFIG_SETTLE_MS after the last one before the file is read,
+and a file whose text has not changed is not parsed again.
+- A text that parses is published as a new snapshot with an atomic store of the shared_ptr,
+and generation() is incremented after it. A text with errors is not published: the previous
+snapshot stays current and the errors go to the handler.
+- Readers never wait for a reload. generation() is one atomic load, so an SDI12Scheduler
+following the watcher (see SDI12Scheduler::follow()) compares it between measurements and
+only takes the new snapshot, with current(), when it has changed. A snapshot a reader holds
+stays valid however many reloads come after it.
+The pins of a bus are published like everything else but the SDI12 objects already running
+keep theirs; only the sensors, their commands and intervals are applied on the fly.
+*/
+#define SDI12_CONFIG_SETTLE_MS   50                     //quiet time after the last change before the file is read
+
+typedef void (*SDI12ConfigHandler)(const std::shared_ptr<const SDI12Config> &config, const std::vector<SDI12ConfigError> &errors, void *user);   //every load, config is 0 if it had errors
+
+class SDI12ConfigWatcher
+{
+    private:
+        std::string _path;                                                              //file watched
+        std::string _name;                                                              //its name in its directory
+        std::string _text;                                                              //text of the last load
+        std::atomic<std::shared_ptr<const SDI12Config>> _current;                       //newest snapshot
+        std::atomic<uint32_t> _generation;                                              //snapshots published
+        SDI12ConfigHandler _handler;                                                    //called after every load
+        void *_user;                                                                    //passed to the handler
+        int _inotify;                                                                   //inotify descriptor watching the directory, -1 if not watching
+        int _stop;                                                                      //eventfd the destructor wakes the thread with
+        std::thread _thread;                                                            //watching thread
+        void load();                                                                    //reads and parses the file, publishes it if it parsed
+        void watch();                                                                   //body of the watching thread
+    public:
+        SDI12ConfigWatcher(const char *path, SDI12ConfigHandler handler = 0, void *user = 0);    //loads the file and starts watching it
+        ~SDI12ConfigWatcher();
+        SDI12ConfigWatcher(const SDI12ConfigWatcher &) = delete;
+        SDI12ConfigWatcher &operator=(const SDI12ConfigWatcher &) = delete;
+        bool watching() const;                                                          //true if inotify is watching the file
+        std::shared_ptr<const SDI12Config> current() const;                             //returns the newest snapshot, 0 if the file never parsed
+        uint32_t generation() const;                                                    //returns the number of snapshots published
+};
+
+#endif
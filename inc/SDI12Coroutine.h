@@ -0,0 +1,235 @@
+#ifndef __SDI12COROUTINE_H__
+#define __SDI12COROUTINE_H__
+
+#include <inttypes.h>
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <type_traits>
+#include <vector>
+#include <SDI12.h>
+#include <SDI12Worker.h>
+#include <SDI12Scheduler.h>
+
+/* ============================== Coroutine interface ===========================
+Lets a sensor workflow be written as straight line code that reads like the blocking
+calls, while hundreds of them share one thread:
+
+    SDI12Task<> poll(SDI12 &bus, char address)
+    {
+        SDI12Transaction id = co_await bus.identify(address);
+        for(;;)
+        {
+            SDI12Reading reading = co_await bus.measure(address);
+            ...
+            co_await sdi12Sleep(std::chrono::seconds(60));
+        }
+    }
+
+    SDI12Executor executor;
+    executor.spawn(poll(bus0, '0'));
+    executor.spawn(poll(bus1, '3'));
+    executor.run();
+
+- SDI12Task<T> is the coroutine type. A task does not start until it is awaited or given to
+spawn(); awaiting it runs it and resumes the caller with its co_return value by symmetric
+transfer, no queue and no thread switch in between. A spawned task is destroyed when it
+ends. Tasks do not throw: an exception escaping one terminates, as everywhere else here.
+- SDI12::command() is transact() and SDI12::identify() is aI!, both give the response line
+copied into an SDI12Transaction (see SDI12Worker.h). SDI12::measure() runs aM! (or aMC!, aC!,
+aCC!), waits for the service request or ttt and collects aD0!..aD9! into an SDI12Reading, as
+the scheduler does (see SDI12Scheduler.h). Commands go through SDI12::submit(), so a task
+waiting for a response costs nothing until the eventFd() of its bus is readable.
+- Each bus is taken by one task at a time, in the order they asked; the others wait in a
+list threaded through their own frames. measure() keeps the bus from aM! to its last aDn!
+so the sensor is not interrupted, and lets it go during the ttt of aC!/aCC!.
+- SDI12Executor is one epoll loop on the calling thread. Buses are added to it on their
+first use. run() resumes the ready tasks, then sleeps in epoll_wait() until a bus has news
+or the next sdi12Sleep() is due, and returns once every spawned task has ended. fd() is
+the epoll descriptor itself, so an application loop that already has one can add it and
+call runOnce() when it is readable, after the time nextWake() gives at the latest.
+Everything, the buses included, must be used from the executor's thread only while it runs
+them. Do not pass a temporary string_view to measure() unless it is awaited at once: a task
+starts when awaited.
+*/
+#define SDI12_EXECUTOR_BUSES     16                     //buses one executor drives
+
+class SDI12Executor;
+struct SDI12Waiter;
+
+struct SDI12Promise                                                                     //what every task promise holds
+{
+    SDI12Executor *executor = 0;                                                        //executor running the task, from spawn() or the task awaiting it
+    std::coroutine_handle<> continuation;                                               //task to resume when this one ends, none if spawned
+};
+
+template<typename T> struct SDI12PromiseValue : SDI12Promise                           //co_return value of a task
+{
+    T value;
+    void return_value(T result)
+    {
+        value = std::move(result);
+    }
+};
+
+template<> struct SDI12PromiseValue<void> : SDI12Promise
+{
+    void return_void()
+    {
+    }
+};
+
+struct SDI12FinalAwaiter                                                                //end of a task, resumes its caller or frees a spawned task
+{
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+    template<typename P> std::coroutine_handle<> await_suspend(std::coroutine_handle<P> done) noexcept
+    {
+        return finish(done.promise(), done);
+    }
+    void await_resume() const noexcept
+    {
+    }
+    static std::coroutine_handle<> finish(SDI12Promise &promise, std::coroutine_handle<> done) noexcept;
+};
+
+template<typename T = void>
+class SDI12Task
+{
+    public:
+        struct promise_type : SDI12PromiseValue<T>
+        {
+            SDI12Task get_return_object()
+            {
+                return SDI12Task(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+            std::suspend_always initial_suspend() noexcept                              //started by co_await or spawn()
+            {
+                return {};
+            }
+            SDI12FinalAwaiter final_suspend() noexcept
+            {
+                return {};
+            }
+            void unhandled_exception()
+            {
+                std::terminate();
+            }
+        };
+    private:
+        std::coroutine_handle<promise_type> _handle;                                    //the coroutine frame, none once spawned or moved
+        friend class SDI12Executor;
+    public:
+        explicit SDI12Task(std::coroutine_handle<promise_type> handle) : _handle(handle)
+        {
+        }
+        SDI12Task(SDI12Task &&other) noexcept : _handle(other._handle)
+        {
+            other._handle = 0;
+        }
+        SDI12Task(const SDI12Task &) = delete;
+        SDI12Task &operator=(const SDI12Task &) = delete;
+        ~SDI12Task()                                                                    //destroys a task never started or finished
+        {
+            if(_handle)
+            {
+                _handle.destroy();
+            }
+        }
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+        template<typename P> std::coroutine_handle<> await_suspend(std::coroutine_handle<P> caller) noexcept    //runs the task on the caller's executor
+        {
+            _handle.promise().executor = caller.promise().executor;
+            _handle.promise().continuation = caller;
+            return _handle;
+        }
+        T await_resume()
+        {
+            if constexpr(!std::is_void_v<T>)
+            {
+                return std::move(_handle.promise().value);
+            }
+        }
+};
+
+struct SDI12SleepAwaiter                                                                //returned by sdi12Sleep()
+{
+    std::chrono::steady_clock::time_point until;                                        //when the task goes on
+    bool await_ready() const noexcept
+    {
+        return until <= std::chrono::steady_clock::now();
+    }
+    template<typename P> void await_suspend(std::coroutine_handle<P> task)
+    {
+        suspend(task.promise().executor, task);
+    }
+    void await_resume() const noexcept
+    {
+    }
+    void suspend(SDI12Executor *executor, std::coroutine_handle<> task);
+};
+
+SDI12SleepAwaiter sdi12Sleep(std::chrono::steady_clock::duration duration);            //co_await suspends the task for duration
+SDI12SleepAwaiter sdi12SleepUntil(std::chrono::steady_clock::time_point until);        //co_await suspends the task until then
+
+class SDI12Executor
+{
+    private:
+        struct Bus                                                                      //a bus the tasks use
+        {
+            SDI12 *bus;
+            bool taken;                                                                 //a task holds the bus
+            SDI12Waiter *first;                                                         //tasks waiting for the bus, oldest first
+            SDI12Waiter *last;
+            SDI12Waiter *exchange;                                                      //task waiting for completed(), 0 if none
+            SDI12Waiter *line;                                                          //task waiting for a line sent unasked, 0 if none
+            std::chrono::steady_clock::time_point lineUntil;                            //when that wait ends
+        };
+        struct Timer                                                                    //a task in sdi12Sleep()
+        {
+            std::chrono::steady_clock::time_point due;                                  //when it goes on
+            std::coroutine_handle<> task;
+            bool operator<(const Timer &other) const                                    //heap order, earliest on top
+            {
+                return due > other.due;
+            }
+        };
+        int _epoll;                                                                     //epoll descriptor, every bus's eventFd()
+        Bus _buses[SDI12_EXECUTOR_BUSES];                                               //buses added so far
+        uint8_t _busCount;
+        std::deque<std::coroutine_handle<>> _ready;                                     //tasks to resume, in order
+        std::vector<Timer> _timers;                                                     //binary heap of sleeping tasks
+        uint64_t _resumes;                                                              //tasks resumed from _ready
+        std::vector<std::coroutine_handle<>> _spawned;                                  //spawned tasks not ended, destroyed with the executor
+        Bus *attach(SDI12 &bus);                                                        //returns the entry of bus, added on first use, 0 if full
+        void serve(Bus &bus);                                                           //the eventFd() of bus is readable
+        bool checkLine(Bus &bus);                                                       //hands a line or error on bus to its line waiter, false if none yet
+        void drain();                                                                   //resumes every ready task
+        void expire(std::chrono::steady_clock::time_point now);                         //readies the sleepers and line waiters due by now
+        friend struct SDI12FinalAwaiter;
+        friend struct SDI12SleepAwaiter;
+        friend struct SDI12TakeAwaiter;
+        friend struct SDI12ExchangeAwaiter;
+        friend struct SDI12LineAwaiter;
+        friend struct SDI12BusHold;
+    public:
+        SDI12Executor();
+        ~SDI12Executor();                                                               //destroys the tasks still suspended in it
+        SDI12Executor(const SDI12Executor &) = delete;
+        SDI12Executor &operator=(const SDI12Executor &) = delete;
+        void spawn(SDI12Task<> task);                                                   //starts task on the next runOnce()
+        bool runOnce(std::chrono::milliseconds wait);                                  //runs what is ready, waits up to wait for more, false once no task is left
+        void run();                                                                     //runs until every spawned task has ended
+        int fd() const;                                                                 //epoll descriptor, readable when a bus has news
+        std::chrono::steady_clock::time_point nextWake() const;                         //when runOnce() is needed at the latest, max() if never
+        uint32_t tasks() const;                                                         //returns the number of spawned tasks not ended
+        uint64_t resumes() const;                                                       //returns the number of times a task was resumed from the loop
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef __SDI12CRC_H__
+#define __SDI12CRC_H__
+
+#include <inttypes.h>
+#include <string_view>
+
+/* ================================== SDI-12 CRC ================================
+Responses to the CRC commands (aMC!, aCC!, aRC0!, and aD0! after aMC!/aCC!) end with a
+CRC-16 of everything before it, from the address to the last value. The CRC is the
+reflected 0xA001 polynomial with an initial value of 0, and it is sent as 3 printable
+characters holding 4, 6 and 6 bits of it, each ORed with 0x40.
+The CRC of every possible byte is computed at compile time, so a response is checked with
+one table lookup per character instead of 8 shifts.
+*/
+#define SDI12_CRC_LENGTH         3                      //ASCII characters of an encoded CRC
+
+struct SDI12CrcTable
+{
+    uint16_t crc[256];                                                                  //CRC of every byte value
+};
+
+constexpr SDI12CrcTable sdi12MakeCrcTable()
+{
+    SDI12CrcTable table = {};
+    for(uint16_t byte = 0; byte < 256; byte++)
+    {
+        uint16_t crc = byte;
+        for(uint8_t bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+        table.crc[byte] = crc;
+    }
+    return table;
+}
+
+inline constexpr SDI12CrcTable SDI12_CRC = sdi12MakeCrcTable();
+
+// returns the CRC-16 of text
+constexpr uint16_t sdi12Crc(std::string_view text)
+{
+    uint16_t crc = 0;
+    for(size_t i = 0; i < text.size(); i++)
+    {
+        crc = (crc >> 8) ^ SDI12_CRC.crc[(crc ^ (uint8_t)text[i]) & 0xFF];
+    }
+    return crc;
+}
+
+// returns character index (0, 1 or 2) of the 3 character ASCII encoding of crc
+constexpr char sdi12CrcChar(uint16_t crc, uint8_t index)
+{
+    return (char)(0x40 | (index == 0 ? (crc >> 12) : index == 1 ? ((crc >> 6) & 0x3F) : (crc & 0x3F)));
+}
+
+// true if the last 3 characters of line (a response without <CR><LF>) are the CRC of the rest
+constexpr bool sdi12CrcValid(std::string_view line)
+{
+    if(line.size() <= SDI12_CRC_LENGTH)
+    {
+        return false;
+    }
+    size_t length = line.size() - SDI12_CRC_LENGTH;
+    uint16_t crc = sdi12Crc(line.substr(0, length));
+    return line[length] == sdi12CrcChar(crc, 0) && line[length + 1] == sdi12CrcChar(crc, 1) && line[length + 2] == sdi12CrcChar(crc, 2);
+}
+
+static_assert(sdi12CrcValid("0+3.14OqZ"), "example response of the SDI-12 standard");
+
+#endif
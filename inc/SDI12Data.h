@@ -0,0 +1,40 @@
+#ifndef __SDI12DATA_H__
+#define __SDI12DATA_H__
+
+#include <inttypes.h>
+#include <string_view>
+
+/* ============================ Data response parser ============================
+Parses the response to aD0!..aD9! and aR0!..aR9!, for example "0+3.14-0.25+1013.2": the
+sensor address followed by values that each start with their sign. The line is parsed in
+place (a view returned by SDI12::awaitResponse() can be given directly) into a fixed
+array, nothing is allocated.
+Each value must follow the SDI-12 format: a '+' or '-', 1 to 7 digits with at most one
+decimal point among them. Anything else makes parse() fail and count() is 0.
+A measurement can be spread over several responses (aD0!, aD1!, ...): parse() with append
+set adds the values of the next response after the ones already held.
+sdi12ParseTiming() parses the atttn (or atttnn) answer to aM!, aC!, aIM! and aIC!: ttt
+seconds until the data is ready and n values.
+*/
+#define SDI12_MAX_VALUES         99                     //most values of one measurement (aC! announces up to 99)
+#define SDI12_MAX_DIGITS         7                      //digits in one value
+
+class SDI12Data
+{
+    private:
+        char _address;                                                                  //sensor address of the response
+        uint8_t _count;                                                                 //values parsed
+        double _values[SDI12_MAX_VALUES];                                               //values in the order received
+    public:
+        SDI12Data();
+        void clear(char address);                                                       //no values, from the sensor at address
+        bool parse(std::string_view line, bool append = false);                         //parses a response without <CR><LF>, false if malformed
+        char address() const;                                                           //returns the sensor address
+        uint8_t count() const;                                                          //returns the number of values
+        double value(uint8_t index) const;                                              //returns a value, 0 if index is out of range
+        const double *values() const;                                                   //returns the array of values
+};
+
+bool sdi12ParseTiming(std::string_view line, uint16_t &ttt, uint8_t &values);          //parses atttn/atttnn, false if malformed
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef __SDI12DECODER_H__
+#define __SDI12DECODER_H__
+
+#include <inttypes.h>
+#include <SDI12Gpio.h>
+#include <SDI12FrameTable.h>
+
+/* ============================ Edge timestamp decoder ==========================
+Rebuilds 7E1 SDI-12 frames from the edges of the RX data pin instead of sampling the pin
+in a busy loop. The pin is HIGH when the line is marking (idle). A falling edge from idle
+is the start bit; every bit of the frame is then read at its centre, start + (n + 1/2)
+bit periods, as the level left by the last edge before that time. Only edges and
+the time the pending frame completes matter, so the caller sleeps between them.
+Sensor clocks are allowed some error, and a fixed 833.333 us walks the later bit centres
+towards the edges of a sensor that is a few percent off. The decoder recovers the clock
+within every frame instead: each edge inside a frame lies on a known bit boundary, so the
+bit centres after it are re-centred towards that edge, and the period is re-estimated from the
+time since the start bit. The estimate starts from bitPeriod(), which the SDI12 object sets
+to what it learnt of the addressed sensor in earlier frames (its timing profile), and each
+frame reports the period it measured so the profile can follow the sensor.
+The decoder has no pins, no clock and no threads: it can be fed recorded or synthetic
+edge streams as fast as the CPU allows.
+*/
+#define SDI12_FRAME_OK           0                      //frame decoded correctly
+#define SDI12_FRAME_PARITY       1                      //even parity check failed
+#define SDI12_FRAME_STOP         2                      //stop bit was not marking
+#define SDI12_BIT_MIN_NS         (SDI12_BIT_NS - SDI12_BIT_NS / 10)    //fastest sensor clock followed, 10 % fast
+#define SDI12_BIT_MAX_NS         (SDI12_BIT_NS + SDI12_BIT_NS / 10)    //slowest sensor clock followed, 10 % slow
+#define SDI12_BIT_WEIGHT         16                     //bits of evidence bitPeriod() counts for in a frame's estimate
+#define SDI12_BIT_MEASURE        4                      //bit boundary from which a frame reports its period
+
+struct SDI12Frame                                                                       //one decoded character
+{
+    uint64_t ns;                                                                        //time of the start bit edge
+    uint8_t data;                                                                       //7 bit ASCII character
+    uint8_t status;                                                                     //SDI12_FRAME_OK, SDI12_FRAME_PARITY or SDI12_FRAME_STOP
+    uint32_t bitNs;                                                                     //bit period measured from the frame's edges, 0 if too few edges
+};
+
+class SDI12Decoder
+{
+    private:
+        uint32_t _bitNs;                                                                //expected bit period in nanoseconds, see bitPeriod()
+        uint32_t _frameBitNs;                                                           //bit period of the frame being decoded
+        uint32_t _measuredNs;                                                           //period measured from the start bit, 0 until SDI12_BIT_MEASURE
+        uint64_t _anchorNs;                                                             //time of the last edge inside the frame
+        uint8_t _anchorBit;                                                             //bit boundary that edge lies on, 0 for the start bit
+        uint8_t _level;                                                                 //line level since the last edge
+        bool _inFrame;                                                                  //a start bit has been seen
+        uint64_t _frameNs;                                                              //time of the start bit edge
+        uint8_t _bit;                                                                   //next bit of the frame to sample
+        uint16_t _raw;                                                                  //bits sampled so far, start bit in bit 0
+        uint32_t _frames;                                                               //frames decoded
+        uint32_t _errors;                                                               //frames with a parity or stop bit error
+        bool sample(uint64_t ns, SDI12Frame &out);                                      //samples every bit centre before ns
+        void recentre(uint64_t ns);                                                     //an edge inside the frame, re-centres and re-estimates
+    public:
+        SDI12Decoder(uint32_t bitNs = SDI12_BIT_NS);
+        void reset(uint8_t level = SDI12_HIGH);                                         //drops any partial frame, line level is level
+        bool feed(const SDI12Edge &edge, SDI12Frame &out);                              //adds an edge, true if it completed a frame
+        bool advance(uint64_t ns, SDI12Frame &out);                                     //time has reached ns with no edge, true if a frame completed
+        uint64_t deadline() const;                                                      //time the pending frame completes, 0 if none is pending
+        void bitPeriod(uint32_t bitNs);                                                 //expected bit period of the next frames, clamped to SDI12_BIT_MIN_NS..SDI12_BIT_MAX_NS
+        uint32_t bitPeriod() const;                                                     //returns the expected bit period
+        uint32_t frames() const;                                                        //returns the number of frames decoded
+        uint32_t errors() const;                                                        //returns the number of frames with errors
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef __SDI12EMULATOR_H__
+#define __SDI12EMULATOR_H__
+
+#include <inttypes.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <SDI12Gpio.h>
+#include <SDI12Decoder.h>
+#include <SDI12Command.h>
+
+/* ============================== Bus and sensor emulator =======================
+A pin backend that stands for the whole SDI-12 line, with one or more virtual sensors on
+it, so the SDI12 object runs unchanged on a machine with no GPIO at all:
+- Every level the SDI12 object writes to the TX data pin is timestamped and decoded with
+an SDI12Decoder, as a sensor's UART would. A break (spacing for 12 ms or more) wakes the
+sensors; a command that starts after more than 100 ms of marking without a break finds them
+asleep and is ignored, as the standard allows.
+- A sensor answers a!, aI!, aIM!, aM! and aD0!. Its response is turned into RX data pin
+edges scheduled after the command's stop bit, using the sensor's own bit period (skewed
+by skewPpm) with every edge moved by up to jitterNs. After aM! with a ttt above 0 the
+sensor sends its service request readyMs after the response. A new command cancels
+anything a sensor had not sent yet. With damageEvery, every n-th response has one data bit
+of its second character flipped, which the receiver sees as a parity error.
+- waitEdges() hands out the RX edges once their time has come, with the time they were
+scheduled for as their timestamp, just like the kernel timestamps of SDI12ChipGpio.
+Pins other than the TX and RX data pins (the SN74HCT240 enables) only keep their level.
+*/
+#define SDI12_EMULATOR_BREAK_NS  12000000               //spacing that counts as a break
+#define SDI12_EMULATOR_SLEEP_NS  100000000              //marking after which the sensors sleep
+
+struct SDI12SensorModel                                                                 //behaviour of one virtual sensor
+{
+    char address = '0';                                                                 //sensor address
+    std::string id = "14EMULATE SDI12 001";                                             //aI! response after the address
+    std::string data = "+1.0";                                                          //aD0! response after the address, n is the number of signs
+    uint16_t ttt = 0;                                                                   //seconds announced by aM! and aIM!
+    uint32_t readyMs = 0;                                                               //time after the aM! response until the service request
+    uint32_t responseUs = 9000;                                                         //command stop bit to response start bit, at most 15 ms
+    int32_t skewPpm = 0;                                                                //sensor clock error, + is slower
+    uint32_t jitterNs = 0;                                                              //largest random error of one edge
+    uint32_t seed = 1;                                                                  //seed of the jitter
+    uint32_t damageEvery = 0;                                                           //every n-th response has a character with a parity error, 0 never
+};
+
+class SDI12Emulator : public SDI12Gpio
+{
+    private:
+        struct Sensor
+        {
+            SDI12SensorModel model;
+            std::mt19937 random;                                                        //jitter source
+            uint32_t responses;                                                         //responses sent, for damageEvery
+        };
+        uint8_t _txDataPin;                                                             //pin the SDI12 object transmits on
+        uint8_t _rxDataPin;                                                             //pin the SDI12 object receives on
+        std::vector<Sensor> _sensors;                                                   //sensors on the line
+        SDI12Decoder _decoder;                                                          //decodes the TX data pin
+        uint8_t _txLevel;                                                               //level of the TX data pin
+        uint64_t _spacingNs;                                                            //when the TX data pin last went LOW
+        uint64_t _markingNs;                                                            //when the line last went back to marking, 0 while asleep
+        bool _ignoring;                                                                 //the current command started while the sensors slept
+        SDI12Command _command;                                                          //characters of the command being received
+        std::deque<SDI12Edge> _rx;                                                      //RX edges not handed out yet, in time order
+        uint8_t _rxLevel;                                                               //level of the RX data pin after the last edge handed out
+        uint8_t _rxEdge;                                                                //edge detection of the RX data pin
+        uint8_t _level[SDI12_MAX_PINS];                                                 //level of the other pins
+        std::atomic<uint32_t> _commands;                                                //commands answered
+        std::atomic<uint32_t> _ignored;                                                 //commands ignored, sensors asleep or address unknown
+        std::atomic<uint32_t> _errors;                                                  //TX frames with a parity or stop bit error
+        std::mutex _lock;                                                               //guards everything above that is not atomic
+        std::condition_variable _changed;                                               //signalled on every TX write and by wake()
+        bool _woken;                                                                    //wake() was called
+        void complete(uint64_t ns);                                                     //completes a TX frame whose stop bit has passed
+        void receive(const SDI12Frame &frame);                                          //one character from the SDI12 object
+        void execute(uint64_t ns);                                                      //runs the command in _command, its stop bit ended at ns
+        uint64_t respond(Sensor &sensor, std::string_view text, uint64_t ns);           //schedules address + text + <CR><LF> from ns, returns its end
+    public:
+        SDI12Emulator(uint8_t txDataPin, uint8_t rxDataPin);
+        void addSensor(const SDI12SensorModel &model);                                  //puts a sensor on the line, before begin()
+        void write(uint8_t pin, uint8_t level);
+        uint8_t read(uint8_t pin);
+        void pull(uint8_t pin, uint8_t pud);
+        bool setEdge(uint8_t pin, uint8_t edge);
+        int waitEdges(uint8_t pin, SDI12Edge *edges, int max, int64_t timeoutUs);
+        void wake();
+        uint32_t commands() const;                                                      //returns the number of commands answered
+        uint32_t ignored() const;                                                       //returns the number of commands ignored
+        uint32_t errors() const;                                                        //returns the number of TX frames with errors
+};
+
+#endif
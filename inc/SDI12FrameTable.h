@@ -0,0 +1,63 @@
+#ifndef __SDI12FRAMETABLE_H__
+#define __SDI12FRAMETABLE_H__
+
+#include <inttypes.h>
+
+/* ============================== 7E1 frame table ===============================
+Every SDI-12 character is sent as a 10 bit frame, in the order the bits are on the line:
+bit 0 start bit (0), bits 1-7 the 7 data bits least significant first, bit 8 the even
+parity bit, bit 9 the stop bit (1). In the levels of the TX and RX data pins a 0 is LOW
+and a 1 is HIGH.
+The frame of each of the 128 ASCII codes is computed at compile time, so the transmitter
+encodes a character and the receiver validates one with a single table lookup instead of
+computing the parity with the 0x6996 nibble trick on every character:
+- encode: SDI12_FRAMES.frame[c]
+- decode: a sampled frame is valid if it is the frame of its own data bits.
+*/
+#define SDI12_BIT_NS             833333                 //1200 baud bit period in nanoseconds
+#define SDI12_FRAME_BITS         10                     //start, 7 data, parity, stop
+
+struct SDI12FrameTable
+{
+    uint16_t frame[128];                                                                //10 bit frame of every ASCII code
+};
+
+// even parity of the 7 data bits, the parity bit that makes the number of ones even
+constexpr uint16_t sdi12Parity(uint8_t c)
+{
+    uint16_t ones = 0;
+    for(uint8_t mask = 0x01; mask < 0x80; mask <<= 1)
+    {
+        ones += (c & mask) ? 1 : 0;
+    }
+    return ones & 1;
+}
+
+constexpr SDI12FrameTable sdi12MakeFrames()
+{
+    SDI12FrameTable table = {};
+    for(uint16_t c = 0; c < 128; c++)
+    {
+        table.frame[c] = (uint16_t)((c << 1) | (sdi12Parity(c) << 8) | (1 << 9));
+    }
+    return table;
+}
+
+inline constexpr SDI12FrameTable SDI12_FRAMES = sdi12MakeFrames();
+
+// returns the 10 bit frame of a character, the MSB of c is ignored
+constexpr uint16_t sdi12Encode(uint8_t c)
+{
+    return SDI12_FRAMES.frame[c & 0x7F];
+}
+
+// true if raw, 10 sampled bits, has a start bit, a stop bit and the right parity
+constexpr bool sdi12FrameValid(uint16_t raw)
+{
+    return SDI12_FRAMES.frame[(raw >> 1) & 0x7F] == (raw & 0x3FF);
+}
+
+static_assert(sdi12Encode('a') == 0x3C2, "'a' is 110 0001, odd number of ones, parity bit 1");
+static_assert(sdi12FrameValid(sdi12Encode('0')) && !sdi12FrameValid(sdi12Encode('0') ^ 0x100), "parity is checked");
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef __SDI12GPIO_H__
+#define __SDI12GPIO_H__
+
+#include <inttypes.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+/* ================================ GPIO backends ==============================
+The SDI12 object never touches a pin directly. Every level write, level read, pull
+resistor change and edge detection change goes through an SDI12Gpio backend so the
+same bus logic can run on the Raspberry Pi (SDI12ChipGpio, or SDI12MmioGpio straight on
+the GPIO registers) or against an in-memory pin model (SDI12MockGpio). Pin numbers are
+BCM numbers, which are also the line offsets of /dev/gpiochip0 on the Pi.
+writeMask() drives several pins in one call, a state change of the SDI12 object is one
+writeMask(). Backends that can, do it in one register write; the default writes the pins
+one at a time, the HIGH ones first. The output enables of the SN74HCT240 are active LOW,
+so either way a driver is released before the other one is enabled.
+The level, pull and edge values below have the same numeric values as the wiringPi
+HIGH/LOW, PUD_* and INT_EDGE_* constants.
+wake() makes a waitEdges() sleeping in another thread return at once, with whatever edges
+it has, so the listening thread can pick up a submitted command (SDI12::submit()) or stop
+without waiting for its timeout. The default does nothing and the wait simply times out.
+SDI12ChipGpio is the only code that needs wiringPi. Built with SDI12_CHIP_GPIO defined to 0
+(make HARDWARE=0) it is left out, nothing else needs the Pi, and an SDI12 object must be
+given its backend, for example an SDI12Emulator (SDI12Emulator.h).
+*/
+#ifndef SDI12_CHIP_GPIO
+#define SDI12_CHIP_GPIO          1                      //0 builds without the Raspberry Pi backend and wiringPi
+#endif
+#define SDI12_LOW                0                      //pin level LOW
+#define SDI12_HIGH               1                      //pin level HIGH
+#define SDI12_PUD_OFF            0                      //no pull resistor
+#define SDI12_PUD_DOWN           1                      //pull down resistor
+#define SDI12_PUD_UP             2                      //pull up resistor
+#define SDI12_EDGE_NONE          0                      //edge detection disabled
+#define SDI12_EDGE_FALLING       1                      //detect falling edges
+#define SDI12_EDGE_RISING        2                      //detect rising edges
+#define SDI12_EDGE_BOTH          3                      //detect both edges
+#define SDI12_MAX_PINS           64                     //highest BCM pin number + 1 handled by the backends
+
+struct SDI12Edge                                                                        //one edge seen on an input pin
+{
+    uint64_t ns;                                                                        //CLOCK_MONOTONIC time of the edge in nanoseconds
+    uint8_t level;                                                                      //level of the pin after the edge
+};
+
+class SDI12Gpio
+{
+    public:
+        virtual ~SDI12Gpio() {}
+        virtual void write(uint8_t pin, uint8_t level) = 0;                             //drive an output pin HIGH or LOW
+        virtual void writeMask(uint64_t high, uint64_t low)                             //drive the pins in high HIGH, then the pins in low LOW, bit n is BCM pin n
+        {
+            for(; high; high &= high - 1)                                               //lowest pin left first
+            {
+                write(__builtin_ctzll(high), SDI12_HIGH);
+            }
+            for(; low; low &= low - 1)
+            {
+                write(__builtin_ctzll(low), SDI12_LOW);
+            }
+        }
+        virtual uint8_t read(uint8_t pin) = 0;                                          //returns the level of a pin
+        virtual void pull(uint8_t pin, uint8_t pud) = 0;                                //sets the pull resistor of an input pin
+        virtual bool setEdge(uint8_t pin, uint8_t edge) = 0;                            //sets edge detection of an input pin, false on failure
+        virtual int waitEdges(uint8_t pin, SDI12Edge *edges, int max, int64_t timeoutUs) = 0;   //sleeps until edges are seen on pin, returns how many were stored
+        virtual void wake() {}                                                          //ends a waitEdges() sleeping in another thread early
+};
+
+/* Raspberry Pi backend. Levels and pulls use wiringPi (the application must have called
+wiringPiSetupGpio()). Edge detection uses the GPIO character device: the line is requested
+once on the first setEdge() and later changes are a single GPIO_V2_LINE_SET_CONFIG_IOCTL on
+the same file descriptor, so no process is forked and nothing is re-opened. waitEdges() sleeps
+in ppoll() on that descriptor and returns the kernel timestamps of the edges. wake() writes
+an eventfd that ppoll() watches as well.
+*/
+class SDI12ChipGpio : public SDI12Gpio
+{
+    private:
+        int _chipFd;                                                                    //file descriptor of the gpiochip device
+        int _lineFd[SDI12_MAX_PINS];                                                    //requested line per pin, -1 if not requested
+        int _wakeFd;                                                                    //eventfd written by wake()
+        bool requestLine(uint8_t pin, uint64_t flags);                                  //requests a line with the given v2 flags
+    public:
+        SDI12ChipGpio(const char *chip = "/dev/gpiochip0");                            //opens the chip device
+        ~SDI12ChipGpio();                                                               //releases every requested line and the chip
+        void write(uint8_t pin, uint8_t level);
+        uint8_t read(uint8_t pin);
+        void pull(uint8_t pin, uint8_t pud);
+        bool setEdge(uint8_t pin, uint8_t edge);
+        int waitEdges(uint8_t pin, SDI12Edge *edges, int max, int64_t timeoutUs);
+        void wake();
+};
+
+/* Raspberry Pi register backend. The GPIO register block (/dev/gpiomem, which needs no root)
+is mapped once and every access is a single load or store: a level write is one store to
+GPSET or GPCLR, a level read one load of GPLEV, and writeMask() is one store to GPSET and
+one to GPCLR per bank, so the pins of a state change switch together instead of one
+wiringPi call apart. A pin becomes an output on its first write and an input on pull() or
+setEdge(); these read-modify-write GPFSEL under a lock, the level accesses need none.
+Pull resistors use GPIO_PUP_PDN_CNTRL on the BCM2711 (Pi 4) and the GPPUD/GPPUDCLK sequence
+on older chips, told apart by the value the BCM2835 returns from the BCM2711 register.
+Registers have no edge detection a process can sleep on: setEdge(), waitEdges() and wake() go
+to the edges backend, an SDI12ChipGpio for example, or fail without one.
+Nothing here needs a Pi: the block can be an ordinary file of SDI12_MMIO_LENGTH bytes or
+anonymous memory. GPSET and GPCLR then simply keep the last mask stored, and GPLEV reads what
+the caller put there.
+*/
+#define SDI12_MMIO_LENGTH        4096                   //bytes of the mapped register block
+#define SDI12_MMIO_PINS          58                     //BCM pins with GPIO registers
+
+class SDI12MmioGpio : public SDI12Gpio
+{
+    private:
+        volatile uint32_t *_reg;                                                        //GPIO register block, 0 if it could not be mapped
+        void *_map;                                                                     //mapping made by the constructor, 0 if the caller gave the block
+        SDI12Gpio *_edges;                                                              //backend for setEdge() and waitEdges(), may be 0
+        bool _bcm2711;                                                                  //pull resistors through GPIO_PUP_PDN_CNTRL
+        std::atomic<uint64_t> _outputs;                                                 //pins switched to output
+        std::mutex _lock;                                                               //guards GPFSEL and the pull registers
+        void function(uint8_t pin, uint32_t select);                                    //sets the GPFSEL function of a pin
+    public:
+        SDI12MmioGpio(const char *path = "/dev/gpiomem", long offset = 0, SDI12Gpio *edges = 0);  //maps the block from a device or file
+        SDI12MmioGpio(volatile uint32_t *registers, SDI12Gpio *edges = 0);             //uses a block of SDI12_MMIO_LENGTH bytes the caller owns
+        ~SDI12MmioGpio();                                                               //unmaps the block
+        bool mapped() const;                                                            //true if the register block is usable
+        void write(uint8_t pin, uint8_t level);
+        void writeMask(uint64_t high, uint64_t low);
+        uint8_t read(uint8_t pin);
+        void pull(uint8_t pin, uint8_t pud);
+        bool setEdge(uint8_t pin, uint8_t edge);
+        int waitEdges(uint8_t pin, SDI12Edge *edges, int max, int64_t timeoutUs);
+        void wake();
+};
+
+/* In-memory backend. Pins are plain bytes, so state changes cost nothing but the virtual
+call. Pull resistors move an undriven pin to the pulled level. The counters allow a caller
+to check what a state change did and to time transitions without hardware. injectEdge() plays
+the part of a sensor: it changes the level of a pin and, if edge detection is enabled for
+that edge, queues it for waitEdges(), which may be sleeping in another thread.
+*/
+class SDI12MockGpio : public SDI12Gpio
+{
+    private:
+        std::atomic<uint8_t> _level[SDI12_MAX_PINS];                                    //current level of every pin
+        uint8_t _pud[SDI12_MAX_PINS];                                                   //pull resistor of every pin
+        uint8_t _edge[SDI12_MAX_PINS];                                                  //edge detection setting of every pin
+        std::atomic<uint32_t> _writes;                                                  //number of write() calls, buses may share the mock
+        std::atomic<uint32_t> _edgeChanges;                                             //number of setEdge() calls
+        std::deque<SDI12Edge> _edges[SDI12_MAX_PINS];                                   //edges waiting for waitEdges(), per pin
+        std::mutex _lock;                                                               //guards the edge queues
+        std::condition_variable _edgeReady;                                             //signalled by injectEdge() and wake()
+        bool _woken;                                                                    //wake() was called, guarded by _lock
+    public:
+        SDI12MockGpio();
+        void write(uint8_t pin, uint8_t level);
+        uint8_t read(uint8_t pin);
+        void pull(uint8_t pin, uint8_t pud);
+        bool setEdge(uint8_t pin, uint8_t edge);
+        int waitEdges(uint8_t pin, SDI12Edge *edges, int max, int64_t timeoutUs);
+        void wake();
+        void injectEdge(uint8_t pin, uint64_t ns, uint8_t level);                      //drives an input pin from outside, as a sensor would
+        uint8_t edge(uint8_t pin) const;                                                //returns the edge detection setting of a pin
+        uint8_t pud(uint8_t pin) const;                                                 //returns the pull resistor setting of a pin
+        uint32_t writes() const;                                                        //returns the number of write() calls
+        uint32_t edgeChanges() const;                                                   //returns the number of setEdge() calls
+};
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef __SDI12LOG_H__
+#define __SDI12LOG_H__
+
+#include <inttypes.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <SDI12Scheduler.h>
+
+/* ================================ Measurement log =============================
+Stores readings in binary instead of text: one fixed 24 byte SDI12LogRecord per value, with
+the time the measurement started, the bus, the sensor address, the value index, the value
+and the status of the reading. A reading that failed is stored as one record with
+SDI12_LOG_NO_VALUE, so gaps are logged as well.
+Records are appended to segment files in one directory, 00000001.sdl, 00000002.sdl, ...:
+- A segment is created at its full size (segmentBytes) and mapped MAP_SHARED; append() copies
+the records into the mapping and nothing is written to the file until a commit.
+- commit() msyncs the records appended since the last one, then the segment header with the
+new record count, so after a crash or power cut the header never counts a record that did
+not reach the card. It runs every flushRecords records (170 fill one 4 KiB page) or
+SDI12_LOG_FLUSH_MS after the last commit, so the card sees whole pages written at a slow
+pace instead of a line per value.
+- A segment is closed when it is full or segmentTime after it was opened. Closing commits,
+marks it closed and truncates the file to its records.
+- index.sdx holds one SDI12LogIndex per segment: the first and last record time and the
+record count, rewritten at every commit. A query reads the index and only maps the
+segments whose time span overlaps the range asked for.
+A segment left open by a crash is closed by the next SDI12Log opened on the directory.
+Several schedulers (one thread per bus) can share one SDI12Log: append() takes a mutex.
+SDI12LogReader needs no SDI12Log: it maps the index and the segments read-only, so a query
+tool can run while the logger is appending and sees everything up to the last commit.
+The files are the in-memory structs, little endian as on the Pi.
+*/
+#define SDI12_LOG_VERSION        1                      //format of the segment and index files
+#define SDI12_LOG_SEGMENT_BYTES  (1024 * 1024)          //default segment size
+#define SDI12_LOG_SEGMENT_TIME   86400                  //default segment lifetime in seconds
+#define SDI12_LOG_FLUSH_RECORDS  170                    //default records per commit, one 4 KiB page
+#define SDI12_LOG_FLUSH_MS       60000                  //longest time between two commits
+#define SDI12_LOG_NO_VALUE       0x01                   //flag of a reading that has no values
+
+struct SDI12LogRecord                                                                   //one value, 24 bytes
+{
+    int64_t ns;                                                                         //when the measurement started, nanoseconds since the Unix epoch
+    double value;                                                                       //the value, NaN with SDI12_LOG_NO_VALUE
+    uint8_t bus;                                                                        //bus index given to append()
+    char address;                                                                       //sensor address
+    uint8_t index;                                                                      //position of the value in the reading
+    uint8_t status;                                                                     //SDI12Status of the reading
+    uint8_t flags;                                                                      //SDI12_LOG_*
+    uint8_t reserved[3];
+};
+
+struct SDI12LogHeader                                                                   //start of every segment, 64 bytes
+{
+    char magic[4];                                                                      //"SDIL"
+    uint16_t version;                                                                   //SDI12_LOG_VERSION
+    uint16_t recordSize;                                                                //sizeof(SDI12LogRecord)
+    uint32_t sequence;                                                                  //number of the segment, from 1
+    uint32_t closed;                                                                    //1 once the segment is complete
+    uint64_t count;                                                                     //records committed
+    int64_t firstNs;                                                                    //earliest record time
+    int64_t lastNs;                                                                     //latest record time
+    uint8_t reserved[24];
+};
+
+struct SDI12LogIndex                                                                    //one segment in index.sdx, 32 bytes
+{
+    uint32_t sequence;                                                                  //number of the segment
+    uint32_t closed;                                                                    //1 once the segment is complete
+    uint64_t count;                                                                     //records committed
+    int64_t firstNs;                                                                    //earliest record time
+    int64_t lastNs;                                                                     //latest record time
+};
+
+typedef bool (*SDI12LogVisitor)(const SDI12LogRecord &record, void *user);             //called for every record found, false stops the query
+
+class SDI12Log
+{
+    private:
+        std::mutex _lock;                                                               //held by append(), commit() and the destructor
+        std::string _directory;                                                         //where the segments are
+        uint64_t _segmentBytes;                                                         //size of a segment
+        int64_t _segmentNs;                                                             //lifetime of a segment
+        uint32_t _flushRecords;                                                         //records per commit
+        int _indexFd;                                                                   //index.sdx, -1 if the directory could not be used
+        int _segmentFd;                                                                 //open segment, -1 if none
+        uint8_t *_map;                                                                  //its mapping
+        SDI12LogHeader *_header;                                                        //its header, at the start of _map
+        SDI12LogRecord *_records;                                                       //its records, after the header
+        uint64_t _capacity;                                                             //records that fit in it
+        uint64_t _count;                                                                //records appended to it
+        uint32_t _sequence;                                                             //its number, the next one is _sequence + 1
+        uint32_t _indexEntry;                                                           //its entry in index.sdx
+        int64_t _openedNs;                                                              //when it was opened
+        int64_t _firstNs;                                                               //earliest record time in it
+        int64_t _lastNs;                                                                //latest record time in it
+        std::chrono::steady_clock::time_point _committed;                               //time of the last commit
+        bool open(int64_t now);                                                         //starts segment _sequence + 1
+        void close();                                                                   //commits and closes the open segment
+        void commitLocked();                                                            //commit() with _lock held
+        void writeIndex();                                                              //rewrites the index entry of the open segment
+        void recover();                                                                 //closes a segment a crash left open
+    public:
+        SDI12Log(const char *directory, uint64_t segmentBytes = SDI12_LOG_SEGMENT_BYTES, std::chrono::seconds segmentTime = std::chrono::seconds(SDI12_LOG_SEGMENT_TIME), uint32_t flushRecords = SDI12_LOG_FLUSH_RECORDS);
+        ~SDI12Log();                                                                    //commits and closes the open segment
+        SDI12Log(const SDI12Log &) = delete;
+        SDI12Log &operator=(const SDI12Log &) = delete;
+        bool ready() const;                                                             //true if the directory and its index could be opened
+        bool append(uint8_t bus, const SDI12Reading &reading);                          //stores one record per value, false if it could not
+        void commit();                                                                  //makes every record appended so far durable
+        uint32_t segment() const;                                                       //returns the number of the open or last segment
+};
+
+class SDI12LogReader
+{
+    private:
+        std::string _directory;                                                         //where the segments are
+    public:
+        SDI12LogReader(const char *directory);
+        uint32_t segments() const;                                                      //returns the number of segments in the index
+        uint64_t query(int64_t fromNs, int64_t toNs, SDI12LogVisitor visitor, void *user = 0) const;   //visits the records from fromNs to toNs included, returns how many
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef __SDI12REGISTRY_H__
+#define __SDI12REGISTRY_H__
+
+#include <inttypes.h>
+#include <SDI12.h>
+#include <SDI12Crc.h>
+
+/* ================================ Sensor registry =============================
+Keeps what is known about the sensors of one bus, so it does not have to be asked for again
+every time the acquisition process starts:
+- the address,
+- the identification, the answer to aI!: aa SDI-12 version, 8 characters of vendor,
+6 of model, 3 of sensor version and up to 13 optional characters,
+- the measurement capabilities, the answer to aIM! (SDI-12 1.4): ttt seconds and n values
+of aM!. Both are 0 for older sensors that do not answer aIM!.
+The registry is saved to a small binary cache file. On startup load() reads it and verify()
+sends one a! to every cached sensor, dropping the ones that do not answer. Only when there
+is no usable cache does discover() have to scan all 62 addresses and identify every sensor
+it finds, so a restart costs one short round trip per sensor instead of a full rescan:
+
+    if(!registry.load(path) || registry.verify() == 0)
+    {
+        registry.discover();
+    }
+    registry.save(path);
+
+a! only checks that a sensor still answers at its address. A sensor replaced by another one
+at the same address keeps its cached identification until refresh() is called for it.
+*/
+#define SDI12_ID_LENGTH          33                     //longest aI! response without <CR><LF>
+#define SDI12_CACHE_VERSION      1                      //format of the cache file, a different version is not loaded
+
+struct SDI12Sensor                                                                      //one sensor of the bus
+{
+    char address;                                                                       //sensor address
+    uint8_t idLength;                                                                   //characters in id
+    char id[SDI12_ID_LENGTH];                                                           //aI! response without <CR><LF>, not terminated
+    uint16_t ttt;                                                                       //seconds aM! takes, from aIM!
+    uint8_t values;                                                                     //values aM! returns, from aIM!
+};
+
+class SDI12Registry
+{
+    private:
+        SDI12 &_bus;                                                                    //bus the sensors are on
+        SDI12Sensor _sensors[SDI12_MAX_SENSORS];                                        //known sensors, in the order found
+        uint8_t _count;                                                                 //sensors in _sensors
+        SDI12Status acknowledge(char address, uint8_t retries);                         //sends a!, SDI12_OK if the sensor answered
+        bool identify(char address, SDI12Sensor &sensor);                               //sends aI! and aIM!, false if aI! was not answered
+    public:
+        SDI12Registry(SDI12 &bus);
+        bool load(const char *path);                                                    //reads the cache file, false and empty if missing or corrupt
+        bool save(const char *path) const;                                              //writes the cache file, replaced in one rename
+        uint8_t verify();                                                               //checks every known sensor with a!, returns how many answered
+        uint8_t discover();                                                             //scans every address and identifies new sensors, returns the count
+        bool refresh(char address);                                                     //identifies the sensor at address again, false if it does not answer
+        void clear();                                                                   //forgets every sensor
+        uint8_t count() const;                                                          //returns the number of known sensors
+        const SDI12Sensor &sensor(uint8_t index) const;                                 //returns a known sensor, index < count()
+        const SDI12Sensor *find(char address) const;                                    //returns the sensor at address, 0 if unknown
+};
+
+#endif
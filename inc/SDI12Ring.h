@@ -0,0 +1,146 @@
+#ifndef __SDI12RING_H__
+#define __SDI12RING_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <atomic>
+#include <string.h>
+#include <string_view>
+
+/* ============================ Receive ring buffer =============================
+Single producer (the listening thread) / single consumer (the application) circular
+buffer of received characters.
+- The capacity is rounded up to a power of two, so an index is wrapped with a mask
+instead of a modulo.
+- _head and _tail count characters since the start and are never wrapped themselves:
+tail - head is the number of characters stored, even when the buffer is completely full,
+and every access wraps the index it uses. Only the producer writes _tail, only the
+consumer writes _head. The producer publishes a character with a release store of _tail
+after writing it, the consumer frees space with a release store of _head after reading,
+so neither side ever sees a character that is half written.
+- readInto(), peekRange() and skip() move a whole run of characters in one call.
+- The storage is mirrored: every character is written at its index and again one
+capacity further on. Any run of stored characters is then contiguous in memory, so
+view() hands out a std::string_view of it without copying, even across the wrap.
+*/
+class SDI12Ring
+{
+    private:
+        char *_buffer;                                                                  //storage, twice _mask + 1 characters (mirrored)
+        size_t _mask;                                                                   //capacity - 1
+        std::atomic<size_t> _head;                                                      //characters consumed, written by the consumer
+        std::atomic<size_t> _tail;                                                      //characters produced, written by the producer
+    public:
+        SDI12Ring(size_t capacity)
+        {
+            size_t size = 1;
+            while(size < capacity)
+            {
+                size <<= 1;
+            }
+            _buffer = new char[2 * size];
+            _mask = size - 1;
+            _head = 0;
+            _tail = 0;
+        }
+        ~SDI12Ring()
+        {
+            delete[] _buffer;
+        }
+        SDI12Ring(const SDI12Ring &) = delete;
+        SDI12Ring &operator=(const SDI12Ring &) = delete;
+
+        size_t capacity() const                                                         //returns the number of characters the ring holds
+        {
+            return _mask + 1;
+        }
+        // producer side
+        bool push(char c)                                                               //stores c, false if the ring is full
+        {
+            size_t tail = _tail.load(std::memory_order_relaxed);
+            if(tail - _head.load(std::memory_order_acquire) > _mask)
+            {
+                return false;
+            }
+            _buffer[tail & _mask] = c;
+            _buffer[(tail & _mask) + _mask + 1] = c;                                    //mirror
+            _tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+        // consumer side
+        size_t available() const                                                        //returns the number of characters stored
+        {
+            return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_relaxed);
+        }
+        int peek(size_t offset = 0) const                                               //returns the character offset places after the head, -1 if none
+        {
+            size_t head = _head.load(std::memory_order_relaxed);
+            if(offset >= _tail.load(std::memory_order_acquire) - head)
+            {
+                return -1;
+            }
+            return (uint8_t)_buffer[(head + offset) & _mask];
+        }
+        int last(size_t back = 0) const                                                 //returns the character back places before the newest one, -1 if none
+        {
+            size_t tail = _tail.load(std::memory_order_acquire);
+            if(back >= tail - _head.load(std::memory_order_relaxed))
+            {
+                return -1;
+            }
+            return (uint8_t)_buffer[(tail - 1 - back) & _mask];
+        }
+        size_t peekRange(char *dst, size_t offset, size_t max) const                    //copies up to max characters from offset after the head, returns how many
+        {
+            size_t head = _head.load(std::memory_order_relaxed) + offset;
+            size_t tail = _tail.load(std::memory_order_acquire);
+            size_t count = (tail > head) ? tail - head : 0;
+            if(count > max)
+            {
+                count = max;
+            }
+            memcpy(dst, _buffer + (head & _mask), count);                               //contiguous thanks to the mirror
+            return count;
+        }
+        std::string_view view(size_t offset, size_t max) const                          //up to max characters from offset after the head, without copying
+        {
+            size_t head = _head.load(std::memory_order_relaxed) + offset;
+            size_t tail = _tail.load(std::memory_order_acquire);
+            size_t count = (tail > head) ? tail - head : 0;
+            if(count > max)
+            {
+                count = max;
+            }
+            return std::string_view(_buffer + (head & _mask), count);
+        }
+        size_t skip(size_t count)                                                       //consumes up to count characters, returns how many
+        {
+            size_t head = _head.load(std::memory_order_relaxed);
+            size_t stored = _tail.load(std::memory_order_acquire) - head;
+            if(count > stored)
+            {
+                count = stored;
+            }
+            _head.store(head + count, std::memory_order_release);
+            return count;
+        }
+        size_t readInto(char *dst, size_t max)                                          //consumes up to max characters into dst, returns how many
+        {
+            return skip(peekRange(dst, 0, max));
+        }
+        int read()                                                                      //consumes one character, -1 if none
+        {
+            int c = peek();
+            if(c >= 0)
+            {
+                skip(1);
+            }
+            return c;
+        }
+        void clear()                                                                    //consumes every stored character
+        {
+            _head.store(_tail.load(std::memory_order_acquire), std::memory_order_release);
+        }
+};
+
+#endif
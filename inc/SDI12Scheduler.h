@@ -0,0 +1,98 @@
+#ifndef __SDI12SCHEDULER_H__
+#define __SDI12SCHEDULER_H__
+
+#include <inttypes.h>
+#include <chrono>
+#include <atomic>
+#include <string_view>
+#include <SDI12.h>
+#include <SDI12Crc.h>
+#include <SDI12Config.h>
+
+/* ============================ Measurement scheduler ===========================
+Runs the aM! -> atttn -> (service request or ttt) -> aD0!..aD9! sequence for every sensor
+of one bus, so the application does not have to.
+- Every sensor has a measurement command and a polling interval. The sensors are kept in a
+deadline queue (a binary heap ordered by the time each one is due), so the bus always
+starts the measurement that is due first and never sits idle while one is due.
+- After aM! the sensor answers atttn: ready in ttt seconds with n values. The scheduler
+sleeps in awaitResponse() until the sensor's service request (a<CR><LF>) arrives or ttt
+passes, whichever is first, and asks for the data straight away. Most sensors finish well
+before their ttt, so this is where most of the bus time is won.
+- The values of aD0!, aD1!, ... are collected until the n values announced by atttn have
+been received and are handed to the reading handler in one SDI12Reading.
+The SDI-12 standard lets a sensor abort an aM! measurement when it sees any other traffic
+on the bus, so the bus is kept quiet while an aM! is pending: from aM! until the service
+request, or the whole ttt if the sensor sends none, no other sensor on the bus is served.
+With several slow sensors on one bus their aM! measurements run one after the other and a
+round takes the sum of their ttt, whatever the polling intervals ask for.
+Concurrent measurements (aC!, aCC!) do not have that limit and send no service request.
+The scheduler sends them, puts the sensor back in the queue due at the end of its ttt and
+goes on with the other sensors; when the sensor comes up again its data is harvested. So
+the bus is only taken for the command and the data, and the measurements of all sensors
+overlap: give aC! (aCC! with a CRC) to every sensor of a shared bus that supports it.
+With aMC!/aCC! every data response carries a CRC (see SDI12Crc.h). A data response that
+fails its CRC, its parity or does not arrive is asked for again on its own, up to
+SDI12_DATA_RETRIES times, instead of running the whole measurement again.
+A scheduler can follow an SDI12ConfigWatcher instead of being given its sensors with add():
+the sensors of its bus in the newest snapshot are applied between two measurements, so a
+reload never interrupts a command on the wire. Sensors still listed keep their place in the
+queue with their new command and interval, new ones are due at once and removed ones leave
+the queue, a concurrent measurement already started being harvested first.
+*/
+#define SDI12_DATA_RETRIES       3                      //times a failed aDn! is sent again
+
+struct SDI12Reading                                                                     //result of one measurement
+{
+    char address;                                                                       //sensor address
+    SDI12Status status;                                                                 //SDI12_OK if data holds every value announced by the sensor
+    std::chrono::steady_clock::time_point time;                                         //when the measurement was started
+    SDI12Data data;                                                                     //the values, in the order received
+};
+
+typedef void (*SDI12ReadingHandler)(const SDI12Reading &reading, void *user);           //called for every finished measurement
+
+class SDI12Scheduler
+{
+    private:
+        struct Entry                                                                    //one sensor in the deadline queue
+        {
+            std::chrono::steady_clock::time_point due;                                  //when its next measurement starts
+            std::chrono::milliseconds interval;                                         //polling interval, 0 runs once
+            SDI12Command command;                                                       //measurement command, e.g. "0M!"
+            bool concurrent;                                                            //aC! family, the bus is free while it measures
+            bool crc;                                                                   //aMC!/aCC!, data responses carry a CRC
+            bool harvesting;                                                            //measurement started, due is when its data is ready
+            bool stale;                                                                 //configuration changed while harvesting, applied after it
+            uint8_t values;                                                             //values announced by atttn
+            std::chrono::steady_clock::time_point started;                              //when the measurement was started
+        };
+        SDI12 &_bus;                                                                    //bus the sensors are on
+        Entry _queue[SDI12_MAX_SENSORS];                                                //binary heap, earliest due first
+        uint8_t _count;                                                                 //sensors in the queue
+        SDI12ReadingHandler _handler;                                                   //reading handler
+        void *_user;                                                                    //passed to the reading handler
+        SDI12Reading _reading;                                                          //reused for every measurement, nothing is allocated
+        const SDI12ConfigWatcher *_watcher;                                             //configuration followed, 0 if none
+        char _busName[SDI12_CONFIG_NAME];                                               //name of this bus in it
+        uint32_t _applied;                                                              //generation of the snapshot applied
+        std::shared_ptr<const SDI12Config> _config;                                     //that snapshot, 0 before the first
+        int _configBus;                                                                 //index of this bus in _config, -1 if it is not there
+        static bool later(const Entry &a, const Entry &b);                              //heap order, earliest due on top
+        static bool configure(Entry &entry, char address, std::string_view command, std::chrono::milliseconds interval);   //sets command and interval, false if the command does not fit
+        void apply();                                                                   //applies the newest snapshot of _watcher
+        bool refresh(Entry &entry);                                                     //applies _config to one sensor, false if it was removed
+        bool start(Entry &entry, uint16_t &ttt);                                        //sends the measurement command, false and reading delivered on failure
+        void harvest(Entry &entry);                                                     //collects the data and delivers the reading
+        void deliver();                                                                 //hands _reading to the reading handler
+    public:
+        SDI12Scheduler(SDI12 &bus);
+        bool add(char address, std::string_view command = "M", std::chrono::milliseconds interval = std::chrono::milliseconds(0));   //adds a sensor ("M", "MC", "C", "CC", ...), false if full
+        void follow(const SDI12ConfigWatcher &watcher, std::string_view bus = std::string_view());    //takes the sensors of bus (the only one if empty) from watcher, applied from the next runOnce()
+        void onReading(SDI12ReadingHandler handler, void *user = 0);                    //sets the reading handler
+        uint8_t pending() const;                                                        //returns the number of sensors in the queue
+        bool runOnce(std::chrono::steady_clock::time_point until);                      //runs the next measurement due before until, false if none was
+        void run(const std::atomic<bool> &running);                                     //runs measurements until running is false
+};
+
+#endif
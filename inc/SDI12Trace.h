@@ -0,0 +1,202 @@
+#ifndef __SDI12TRACE_H__
+#define __SDI12TRACE_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <atomic>
+#include <time.h>
+
+/* ================================ Instrumentation =============================
+Counters, a trace of recent events and a latency histogram for one bus, written by the
+listening thread and the application and readable from any other thread while the bus
+runs. Nothing here locks, allocates or prints, so watching a bus does not change its timing.
+- Counters are relaxed atomic increments and are always kept.
+- The trace and the histogram cost one relaxed load each while disabled (the default).
+enable() turns them on at run time.
+- The trace is a ring of SDI12_TRACE_SIZE events that overwrites the oldest. Every slot has a
+sequence number that is odd while the slot is written, so events() can read the ring while
+it is written and skips a slot that changed under it instead of returning a torn event.
+- The histogram holds the latency from an RX edge (kernel timestamp) to the moment the
+decoder sees it, in power of two buckets: bucket b counts latencies from 2^(b-1) to 2^b ns.
+Built with SDI12_TRACE defined to 0 every call compiles to nothing and every reading is 0.
+*/
+#ifndef SDI12_TRACE
+#define SDI12_TRACE              1                      //0 removes all instrumentation
+#endif
+#define SDI12_TRACE_SIZE         256                    //events kept, a power of two
+#define SDI12_LATENCY_BUCKETS    32                     //bucket 31 holds everything from about 1 s up
+
+enum SDI12Counter                                                                       //per bus counters
+{
+    SDI12_COUNT_FRAMES = 0,                                                             //characters received without error
+    SDI12_COUNT_PARITY,                                                                 //characters with a parity error
+    SDI12_COUNT_STOP,                                                                   //characters with a missing stop bit
+    SDI12_COUNT_OVERFLOW,                                                               //characters lost to a full buffer
+    SDI12_COUNT_RETRIES,                                                                //commands sent again after a failed response
+    SDI12_COUNT_COMMANDS,                                                               //commands sent
+    SDI12_COUNT_BREAKS,                                                                 //commands that needed the wake up break
+    SDI12_COUNT_TIMEOUTS,                                                               //awaitResponse() deadlines that passed
+    SDI12_COUNTERS                                                                      //number of counters
+};
+
+enum SDI12Event                                                                         //trace event types
+{
+    SDI12_EVENT_COMMAND = 0,                                                            //command sent, data = address, value = length
+    SDI12_EVENT_FRAME,                                                                  //character received, data = character
+    SDI12_EVENT_PARITY,                                                                 //parity error, data = character
+    SDI12_EVENT_STOP,                                                                   //missing stop bit, data = character
+    SDI12_EVENT_OVERFLOW,                                                               //buffer full, data = character
+    SDI12_EVENT_RESPONSE,                                                               //<CR><LF> received, value = characters in the buffer
+    SDI12_EVENT_TIMEOUT,                                                                //awaitResponse() deadline passed
+    SDI12_EVENT_RETRY,                                                                  //command sent again, data = address
+    SDI12_EVENT_REJECTED                                                                //command too long, not sent, value = length
+};
+
+struct SDI12TraceEvent
+{
+    uint64_t ns;                                                                        //CLOCK_MONOTONIC time
+    uint8_t event;                                                                      //SDI12Event
+    uint8_t data;                                                                       //character or address
+    uint32_t value;                                                                     //depends on event
+};
+
+class SDI12Trace
+{
+    private:
+        struct Slot
+        {
+            std::atomic<uint64_t> seq;                                                  //2 * index + 2 once written, odd while being written
+            std::atomic<uint64_t> ns;
+            std::atomic<uint64_t> packed;                                               //value << 16 | data << 8 | event
+        };
+        std::atomic<uint64_t> _counters[SDI12_COUNTERS];                                //SDI12Counter values
+        std::atomic<uint32_t> _latency[SDI12_LATENCY_BUCKETS];                          //edge to decoder latency histogram
+        std::atomic<bool> _enabled;                                                     //trace and histogram on
+        std::atomic<uint64_t> _next;                                                    //events ever written
+        Slot _slots[SDI12_TRACE_SIZE];                                                  //the trace ring
+
+        static uint64_t now()
+        {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+        }
+    public:
+        SDI12Trace()
+        {
+            _enabled = false;
+            reset();
+        }
+        SDI12Trace(const SDI12Trace &) = delete;
+        SDI12Trace &operator=(const SDI12Trace &) = delete;
+
+        void enable(bool on)                                                            //turns the trace and the histogram on or off
+        {
+            _enabled.store(on, std::memory_order_relaxed);
+        }
+        bool enabled() const
+        {
+            return SDI12_TRACE && _enabled.load(std::memory_order_relaxed);
+        }
+        void reset()                                                                    //zeroes the counters, the histogram and the trace
+        {
+            for(int i = 0; i < SDI12_COUNTERS; i++)
+            {
+                _counters[i].store(0, std::memory_order_relaxed);
+            }
+            for(int i = 0; i < SDI12_LATENCY_BUCKETS; i++)
+            {
+                _latency[i].store(0, std::memory_order_relaxed);
+            }
+            for(int i = 0; i < SDI12_TRACE_SIZE; i++)
+            {
+                _slots[i].seq.store(0, std::memory_order_relaxed);
+            }
+            _next.store(0, std::memory_order_release);
+        }
+
+        // writers, any thread
+        void count(SDI12Counter counter)                                                //adds one to counter
+        {
+#if SDI12_TRACE
+            _counters[counter].fetch_add(1, std::memory_order_relaxed);
+#else
+            (void)counter;
+#endif
+        }
+        void event(SDI12Event event, uint8_t data = 0, uint32_t value = 0, uint64_t ns = 0)    //adds an event to the trace, ns = 0 is now
+        {
+#if SDI12_TRACE
+            if(!_enabled.load(std::memory_order_relaxed))
+            {
+                return;
+            }
+            uint64_t index = _next.fetch_add(1, std::memory_order_relaxed);
+            Slot &slot = _slots[index & (SDI12_TRACE_SIZE - 1)];
+            slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.ns.store(ns ? ns : now(), std::memory_order_relaxed);
+            slot.packed.store((uint64_t)value << 16 | (uint64_t)data << 8 | event, std::memory_order_relaxed);
+            slot.seq.store(2 * index + 2, std::memory_order_release);
+#else
+            (void)event; (void)data; (void)value; (void)ns;
+#endif
+        }
+        void latency(uint64_t ns)                                                       //adds one edge to decoder latency to the histogram
+        {
+#if SDI12_TRACE
+            if(!_enabled.load(std::memory_order_relaxed))
+            {
+                return;
+            }
+            int bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+            _latency[bucket < SDI12_LATENCY_BUCKETS ? bucket : SDI12_LATENCY_BUCKETS - 1].fetch_add(1, std::memory_order_relaxed);
+#else
+            (void)ns;
+#endif
+        }
+
+        // readers, any thread
+        uint64_t counter(SDI12Counter counter) const                                    //returns a counter
+        {
+            return _counters[counter].load(std::memory_order_relaxed);
+        }
+        uint32_t histogram(uint8_t bucket) const                                        //returns the edges counted in bucket
+        {
+            return bucket < SDI12_LATENCY_BUCKETS ? _latency[bucket].load(std::memory_order_relaxed) : 0;
+        }
+        size_t events(SDI12TraceEvent *out, size_t max) const                           //copies up to max of the latest events, oldest first, returns how many
+        {
+            uint64_t next = _next.load(std::memory_order_acquire);
+            uint64_t first = next > SDI12_TRACE_SIZE ? next - SDI12_TRACE_SIZE : 0;
+            if(next - first > max)
+            {
+                first = next - max;
+            }
+            size_t count = 0;
+            for(uint64_t index = first; index < next; index++)
+            {
+                const Slot &slot = _slots[index & (SDI12_TRACE_SIZE - 1)];
+                uint64_t seq = slot.seq.load(std::memory_order_acquire);
+                if(seq != 2 * index + 2)                                                //still being written or already overwritten
+                {
+                    continue;
+                }
+                uint64_t ns = slot.ns.load(std::memory_order_relaxed);
+                uint64_t packed = slot.packed.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if(slot.seq.load(std::memory_order_relaxed) != seq)                     //overwritten while it was read
+                {
+                    continue;
+                }
+                out[count].ns = ns;
+                out[count].event = packed & 0xFF;
+                out[count].data = (packed >> 8) & 0xFF;
+                out[count].value = (uint32_t)(packed >> 16);
+                count++;
+            }
+            return count;
+        }
+};
+
+#endif
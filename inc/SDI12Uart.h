@@ -0,0 +1,51 @@
+#ifndef __SDI12UART_H__
+#define __SDI12UART_H__
+
+#include <inttypes.h>
+#include <string_view>
+#include <SDI12Decoder.h>
+
+/* ================================ Serial transport ============================
+An SDI12 object built with an SDI12Uart sends and receives through a serial tty (the
+PL011 of the Pi, /dev/serial0, or a USB adapter) instead of bit-banging the TX and RX data
+pins. The UART does the 1200 baud 7E1 framing in hardware, so no thread times bits:
+- The tty is put in raw mode at 1200 baud, 7 data bits, even parity, 1 stop bit.
+- The wake up break is the tty's own: TIOCSBRK holds the TX line spacing until TIOCCBRK,
+timed with a sleep, so it can be the exact SDI12_BREAK_NS (tcsendbreak() gives 0.25 s or
+more). hold() keeps the break on, for the HOLDING state.
+- send() writes the command and returns once tcdrain() says it has left, then drops what
+the receiver picked up meanwhile (nothing behind the SN74HCT240, whose RX side is off while
+transmitting, but a bus wired without it echoes every character).
+- The UART checks parity and framing. With INPCK and PARMRK the tty marks a character that
+failed either check as \377 \0 c; receive() turns those into SDI12_FRAME_PARITY frames (the
+tty does not say which check failed) and every other character into an SDI12_FRAME_OK frame,
+so the SDI12 object stores them exactly as it stores the frames of its edge decoder.
+Breaks sent by others on the bus are ignored (IGNBRK). wake() ends a receive() sleeping in
+another thread through an eventfd its ppoll() watches as well, as SDI12ChipGpio::wake() does.
+The SDI12 object still switches the SN74HCT240 with its enable pins; the TX and RX data
+pins are the UART's. A pseudo-terminal works as well as a UART (baud rate, breaks and
+parity have no effect on it), so the transport runs end to end against a simulated sensor
+on the other side of a pty pair, see the benchmark suite.
+*/
+#define SDI12_UART_FRAME_NS      (SDI12_FRAME_BITS * (uint64_t)SDI12_BIT_NS)   //one character on the wire
+
+class SDI12Uart
+{
+    private:
+        int _fd;                                                                        //tty file descriptor, -1 if it could not be opened
+        uint8_t _marked;                                                                //PARMRK bytes seen of a marked character, 0 to 2
+        int _wakeFd;                                                                    //eventfd written by wake()
+    public:
+        SDI12Uart(const char *path);                                                    //opens and configures the tty
+        SDI12Uart(int fd);                                                              //configures a tty the caller opened, it is closed by the destructor
+        ~SDI12Uart();
+        bool ready() const;                                                             //true if the tty is open and configured
+        int fd() const;                                                                 //returns the tty file descriptor
+        bool sendBreak(uint64_t ns);                                                    //spacing for ns, then marking
+        bool hold(bool on);                                                             //keeps the line spacing until hold(false)
+        bool send(std::string_view text);                                               //writes text, returns once it is on the wire
+        int receive(SDI12Frame *frames, int max, int64_t timeoutUs);                   //sleeps until characters arrive, returns how many frames were stored, -1 on error
+        void wake();                                                                    //ends a receive() sleeping in another thread early
+};
+
+#endif
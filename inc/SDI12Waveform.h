@@ -0,0 +1,60 @@
+#ifndef __SDI12WAVEFORM_H__
+#define __SDI12WAVEFORM_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <SDI12Gpio.h>
+#include <SDI12FrameTable.h>
+#include <string_view>
+
+/* ============================ Transmit waveform ===============================
+A whole transmission (break, marking and every 7E1 frame of the command) is compiled up
+front into one schedule of TX data pin edges, each at an offset from the start of the
+transmission. play() then writes every edge at an absolute CLOCK_MONOTONIC deadline:
+it sleeps with clock_nanosleep(TIMER_ABSTIME) until spinNs before the deadline and only
+spins for the rest. Because each deadline is absolute, being late on one edge does not
+move the next one, so timing error no longer builds up across a command the way it did
+with one relative delayMicroseconds() per bit.
+The TX data pin drives the line through the inverting SN74HCT240: LOW on the pin is
+spacing (break, start bit, 0 bits), HIGH is marking (idle, 1 bits, stop bit).
+A command whose first start bit, after the marking, follows other bus traffic within
+SDI12_MARKING_WINDOW_NS does not need the break: the sensors are still awake, so mark() adds
+only the marking (see SDI12::sendCommand()).
+*/
+#define SDI12_BREAK_NS           14161000               //break (spacing) before a command, at least 12 ms
+#define SDI12_MARKING_NS         10000000               //marking after the break, at least 8.33 ms
+#define SDI12_MARKING_WINDOW_NS  85000000               //a start bit less than this into the marking needs no break, the standard allows 87 ms
+#define SDI12_SPIN_NS            80000                  //play() spins for the last 80 us before each edge
+#define SDI12_WAVE_MAX_CHARS     40                     //longest command that can be compiled
+#define SDI12_WAVE_MAX_EDGES     (1 + SDI12_WAVE_MAX_CHARS * SDI12_FRAME_BITS)   //the break plus the worst case of every bit changing level
+
+struct SDI12Jitter                                                                      //timing report of one transmission
+{
+    uint16_t edges;                                                                     //edges written
+    int64_t maxLateNs;                                                                  //latest an edge was written after its deadline
+    int64_t meanLateNs;                                                                 //mean lateness of the edges
+    uint64_t spinNs;                                                                    //time spent spinning instead of sleeping
+};
+
+class SDI12Waveform
+{
+    private:
+        SDI12Edge _edges[SDI12_WAVE_MAX_EDGES];                                         //edge schedule, ns is the offset from the start
+        uint16_t _count;                                                                //number of edges in the schedule
+        uint64_t _ns;                                                                   //end of the schedule so far
+        uint8_t _level;                                                                 //level of the pin at the end of the schedule
+        void level(uint8_t level, uint64_t ns);                                         //holds level for ns, adds an edge if it changes
+    public:
+        SDI12Waveform();
+        void clear();                                                                   //empty schedule, pin marking
+        void wake();                                                                    //adds the break and the marking that wake the sensors
+        void mark();                                                                    //adds only the marking, for sensors that are still awake
+        bool addChar(uint8_t out);                                                      //adds one 7E1 frame, false if the schedule is full
+        bool addString(std::string_view cmd);                                           //adds a frame per character, false if the schedule is full
+        uint16_t edges() const;                                                         //returns the number of edges in the schedule
+        uint64_t duration() const;                                                      //returns the length of the transmission in nanoseconds
+        const SDI12Edge *schedule() const;                                              //returns the edge schedule, edges() long
+        uint64_t play(SDI12Gpio *gpio, uint8_t pin, SDI12Jitter *report = 0, uint32_t spinNs = SDI12_SPIN_NS) const;  //writes the schedule to pin, returns the CLOCK_MONOTONIC time offset 0 was due
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef __SDI12WORKER_H__
+#define __SDI12WORKER_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <string_view>
+#include <semaphore.h>
+#include <SDI12.h>
+
+/* ================================== I/O worker ================================
+Optional mode in which one thread owns the bus and every other thread only submits work to it.
+The worker thread can be pinned to a core, run SCHED_FIFO and lock the process memory, so
+the TX waveform is played on a thread nothing else on the Pi can preempt and no page fault
+lands in the middle of a command. The listening thread of the bus gets the same core and
+priority (see SDI12::realtimeListener()), so call SDI12::begin() before creating the worker.
+Application threads call submit(): the command goes into a bounded lock-free queue
+(several producers, one consumer, a sequence number per slot) and a std::future is returned
+that becomes ready with the response, copied out of the bus buffer, or the error.
+While a worker exists the bus belongs to it: no other thread may send or read on the bus.
+Running SCHED_FIFO and locking memory need CAP_SYS_NICE and CAP_IPC_LOCK (or root).
+realtime() reports whether they were granted; the worker runs either way.
+*/
+#define SDI12_WORKER_QUEUE       16                     //transactions waiting for the worker, a power of two
+#define SDI12_RESPONSE_MAX       96                     //longest response line a transaction keeps
+#define SDI12_WORKER_STACK       65536                  //stack touched once so it is locked in memory before any command
+
+struct SDI12Transaction                                                                 //result of one submitted command
+{
+    SDI12Status status;                                                                 //outcome, SDI12_OVERFLOW if the queue or the line did not fit
+    uint8_t length;                                                                     //characters in line
+    char line[SDI12_RESPONSE_MAX];                                                      //response without <CR><LF>, not terminated
+    std::string_view view() const                                                       //returns the response line
+    {
+        return std::string_view(line, length);
+    }
+};
+
+class SDI12Worker
+{
+    private:
+        struct Request                                                                  //one slot of the queue
+        {
+            std::atomic<size_t> seq;                                                    //position + 1 once filled, position + SDI12_WORKER_QUEUE once free again
+            SDI12Command command;
+            std::chrono::milliseconds timeout;
+            std::promise<SDI12Transaction> promise;
+        };
+        SDI12 &_bus;                                                                    //bus owned by the worker
+        Request _queue[SDI12_WORKER_QUEUE];                                             //bounded queue of submitted transactions
+        std::atomic<size_t> _enqueue;                                                   //next position submit() claims
+        size_t _dequeue;                                                                //next position the worker takes, only it touches this
+        sem_t _pending;                                                                 //one post per submitted transaction
+        std::atomic<bool> _running;                                                     //true until the destructor
+        std::atomic<bool> _realtime;                                                    //core, priority and memory lock were granted
+        int _cpu;                                                                       //core of the worker and listening threads, -1 any
+        int _priority;                                                                  //SCHED_FIFO priority, 0 leaves the normal scheduler
+        bool _lockMemory;                                                               //mlockall() before the first command
+        std::thread _thread;                                                            //the worker thread
+        void work();                                                                    //body of the worker thread
+    public:
+        SDI12Worker(SDI12 &bus, int cpu = -1, int priority = 0, bool lockMemory = false);
+        ~SDI12Worker();                                                                 //stops the worker, transactions still queued are broken promises
+        SDI12Worker(const SDI12Worker &) = delete;
+        SDI12Worker &operator=(const SDI12Worker &) = delete;
+        std::future<SDI12Transaction> submit(const SDI12Command &command, std::chrono::milliseconds timeout = std::chrono::milliseconds(SDI12_DATA_TIMEOUT_MS));   //queues command, never blocks
+        bool realtime() const;                                                          //true if everything asked for was granted
+};
+
+#endif
@@ -25,6 +25,8 @@ You should have received a copy of the GNU Lesser General Public License along w
 4. Waking up, and talking to, the sensors.
 5. Reading from the SDI-12 object. available(), peek(), read(), flush()
 6. Interrupt Service Routine (getting the data into the buffer)
+7. Waiting for a response. awaitResponse() and releaseResponse()
+8. Event loop interface. eventFd(), submit() and completed()
 */
 /* ===== 0. Includes, Defines, and Variable Declarations ======= (Kevin Smith and James Coppock)
 (KMS:
@@ -39,6 +41,8 @@ You should have received a copy of the GNU Lesser General Public License along w
 (JMC: 0.8 - defines value for ENABLEINTERRUPT state.)
 (KMS: 0.9 - Specifies the delay for transmitting bits. (JMC: 1200 Baud equates to 833us but
 with system calls the actual time was measured using an oscilloscope to be 805us.)
+The bit timing now lives in SDI12Waveform, which uses the exact 833.333 us against absolute
+deadlines, so the call overhead no longer needs to be subtracted.
 )
 (JMC: 0.10 to 0.13 are new reference variables.
 0.10 - a reference to the pin that connects to the SN74HCT240 output enable pin. This
@@ -53,43 +57,59 @@ SN74HCT240.)
 (KMS: 0.14 - holds the buffer overflow status.)
 (JMC: 0.15 - a new reference variable which holds the parity error status.
 )
+0.16 - monotonicNs() - CLOCK_MONOTONIC in nanoseconds, used by sections 4 and 6.
+0.17 - pinMask() - the bit of a pin in an SDI12Gpio::writeMask() mask, used by section 2.
 */
 
 #include <SDI12.h>
-#define _BUFFER_SIZE           75                        //max buffer size
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <time.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 #define DISABLED               0                         //value for DISABLED state
 #define ENABLED                1                         //value for ENABLED state
 #define HOLDING                2                         //value for DISABLED state
 #define TRANSMITTING           3                         //value for TRANSMITTING state
 #define LISTENING              4                         //value for LISTENING state
 #define INTERRUPTENABLED       5                         //(JMC: 0.8 value for ENABLEINTERRUPT state)
-#define SPACING                805                       //bit timing in microseconds
+#define SDI12_SUBMIT_IDLE      0                         //no command submitted, the application owns the buffer
+#define SDI12_SUBMIT_QUEUED    1                         //submit() was called, the listening thread sends it next
+#define SDI12_SUBMIT_SENT      2                         //sent, waiting for the response until _submitDeadlineNs
+#define SDI12_SUBMIT_RETRY     3                         //failed, waiting for a quiet line to send it again
+#define SDI12_SUBMIT_DONE      4                         //outcome in _submitStatus, for completed()
 
-uint8_t _txEnable;                                        //(JMC: refernce to the pin that connects to one of the SN74HCT240 output enable pins)
-uint8_t _txDataPin;                                       //(JMC: reference to the tx data pin)
-uint8_t _rxEnable;                                        //(JMC: reference to the pin that connects to one of the SN74HCT240 output enable pins)
-uint8_t _rxDataPin;                                       //(JMC: reference to the rx data pin)
+// returns the writeMask() bit of a pin
+static uint64_t pinMask(uint8_t pin)
+{
+    return pin < SDI12_MAX_PINS ? 1ULL << pin : 0;                      //SDI12_NO_PIN has none
+}
 
-bool _bufferOverflow;                                    //(buffer overflow status)
-bool _parityError;                                       //(parity error status)
+// returns CLOCK_MONOTONIC in nanoseconds, the clock of the kernel edge timestamps
+static uint64_t monotonicNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
 
 /* ================================ 1. Buffer Setup ============================ ( Kevin Smith)
-The buffer holds the ascii characters from the SDI-12 bus. Characters are read into the buffer when an interrupt is received on the data line.
- The buffer uses a circular implementation with pointers to both the head and the tail. The circular buffer is defined with the size of the buffer and two pointers;
+The buffer holds the ascii characters from the SDI-12 bus. Characters are put into the buffer by the listening thread when a frame is decoded
+ and taken out by the application thread. The buffer uses a circular implementation with indices to both the head and the tail;
 - One to the start of data
 - One to end of data
-When a pointer reaches the end of the buffer it jumps back to the start.
-1.1 - Define a maximum buffer size (in number of characters).
-1.2 - Declare a character array of the specified size.
-1.3 - Index to buffer head. (JMC: Buffer head is the index to first character in. The index is
-declared as uint8_t type which is an unsigned 8-bit integer, can map from 0-255.)
+When an index reaches the end of the buffer it jumps back to the start.
+1.1 - The buffer size (in number of characters) is given to the constructor, SDI12_BUFFER_SIZE by default. It is rounded up to a power of two.
+1.2 - The buffer is an SDI12Ring, a single producer / single consumer ring (see SDI12Ring.h). The head and tail are atomic, so the listening
+ thread and the application thread never need a lock, and the overflow check and every index wrap around the end of the buffer correctly.
+1.3 - Index to buffer head. (JMC: Buffer head is the index to first character in.)
 1.4 - Index to buffer tail. (JMC: Buffer tail is the index to 1 position advanced of the last
 character unless empty.)
+The buffer, the pins and the error flags are members of the SDI12 object (see SDI12.h), so every
+ bus has its own and several SDI12 objects can run at the same time, each on its own thread.
 */
-// See section 0.2 above. // 1.1 - max buffer size
-char _rxBuffer[_BUFFER_SIZE];                           //declare an array(buffer for incoming ascii characters)
-uint8_t _rxBufferHead = 0;                              //index of buff head
-uint8_t _rxBufferTail = 0;                              //index of buff tail
 
 /* ==================================== 2. Data Line States ================== ( James Coppock)
 The original library specified 4 states. The original library used 1 single digital I/O pin of an Arduino. The Arduino pins are 5 volts and can supply 20 mA of current.
@@ -114,8 +134,13 @@ INTERRUPTENABLE --> TRANSMITTING --> LISTENING --> TRANSMITTING --> LISTENING --
 -----------------------------------| Function Descriptions |-----------------------------------
 2.1 - A private function, sets the state of 4 pins that connect to the tri state buffer and line driver with separate output enable pins. 
 The 5 states are given in the table above which are HOLDING, TRANSMITTING, LISTENING, DISABLED and INTERRUPTENABLE. 
-4 of the five states were defined in original code but all the code of this member function is changed. The functions used to write a HIGH or LOW on any pin
-, and the interrupt enable and disable are from the wiringPi library.
+4 of the five states were defined in original code but all the code of this member function is changed. Writing a HIGH or LOW on any pin
+, and the interrupt enable and disable go through the SDI12Gpio backend given to the constructor. On the Raspberry Pi backend the edge detection
+ of the RX data pin is changed with one ioctl on a line file descriptor that stays open, instead of forking "gpio edge" for every change, so a
+ state change costs microseconds. The edge detection follows _rxDataPin instead of a hardcoded BCM 22.
+ The pins of a state are written with one writeMask() call, HIGH pins first: on SDI12MmioGpio that is one store to the set
+ register and one to the clear register, so the enables switch together, and as they are active LOW a driver of the 240 is
+ always released before the other one is enabled.
 2.2 - A public function which forces a "HOLDING" state. This function is called after a failed communication due to noise or to place line into
  a low impedance state before initiating communication with a sensor.
 // 2.1 - sets the state of the SDI-12 object. (JMC: All setState() function code has been modified to control SN74HCT240 using wiringPi libraries as mentioned in section 2 comments above)
@@ -125,57 +150,62 @@ void SDI12::setState(uint8_t state)
     if(state == HOLDING)                                          //if HOLDING
     {
         //std::cout << "SetState = HOLDING" << "\n";
-        digitalWrite(_rxEnable, HIGH);                           //State of 240 output 1 in high impedance
-        digitalWrite(_txEnable, HIGH);                           //Set TX pin HIGH level(txDataPin = BCM17)
-        digitalWrite(_txDataPin, LOW);                           //Set State of 240 output 2 'driving' state
+        _gpio->writeMask(pinMask(_rxEnable) | pinMask(_txEnable),    //State of 240 output 1 and 2 in high impedance
+                         pinMask(_txDataPin));                   //Set TX data pin LOW, the line is held spacing
+        if(_uart)
+        {
+            _uart->hold(true);                                  //the UART holds its TX line spacing instead
+        }
         return ;
     }
     if(state == TRANSMITTING)                                    //if TRANSMITTING
     {
         //std:cout << "SetState = TRANSMITTING" << "\n";
-        digitalWrite(_rxEnable, HIGH);                           //State of 240 output 1 high impedance
-        digitalWrite(_txEnable, LOW);                            //State of 240 output 2 is driving staet
+        _gpio->writeMask(pinMask(_rxEnable),                     //State of 240 output 1 high impedance
+                         pinMask(_txEnable));                    //State of 240 output 2 is driving staet
         return ;
     }
     if(state == LISTENING)                                       //if LISTENING
     {
-        digitalWrite(_txEnable, HIGH);                           //State of 240 output 2 (Tx output) is driving state
-        digitalWrite(_rxEnable, LOW);                            //State of 240 output 1 (RX output) is high impedance
+        _gpio->writeMask(pinMask(_txEnable),                     //State of 240 output 2 (Tx output) is high impedance
+                         pinMask(_rxEnable));                    //State of 240 output 1 (RX output) is driving state
+        return ;
     }
     if(state == DISABLED)                                        //if state == DISABLED. pin interrupt disabled
     {
         //std::cout << "SetState = DISABLED" << "\n";
         //Only necessary to disable if using ISR routine
-        system("gpio edge 22 none");                            //DIsable rising edge interrupt detection on RXDATAPIN
-        digitalWrite(_rxEnable, HIGH);                          //State of 240 output 1 (RX input) is high impedance
-        digitalWrite(_txEnable, HIGH);                          //State of 240 output 2 (TX output) is driving state
+        if(!_uart)
+        {
+            _gpio->setEdge(_rxDataPin, SDI12_EDGE_NONE);        //Disable edge detection on RXDATAPIN (one ioctl, no shell)
+        }
+        _gpio->writeMask(pinMask(_rxEnable) | pinMask(_txEnable), 0);    //State of 240 output 1 and 2 are high impedance
         return ;
     }
     if(state == INTERRUPTENABLED)                               //if state == INTERRUPT. Enables pin interrupt
     {
         //std::cout << "SetState = INTERRUPTENABLE" << "\n";
-        pullUpDnControl(_rxDataPin, PUD_UP);                   //Set RX Pin with pull down resistors enabled
-        system("gpiio edge 22 falling");                       //Enable rising edge interrupt detection on RXDATAPIN
-        pullUpDnControl(_rxDataPin, PUD_DOWN);                 //Triggers the first interrupt which has a bug and triggers two.Both these need to be ignored.
-        pullPuDnControl(_rxDataPin, PUD_UP);                   //Triggers the first interrupt which has a bug and triggers two. Both these need to be ignored.
-        delay(1);
-        digitalWrite(_rxEnable, HIGH);                         //State of 240 output 1 in high impedance
-        digitalWrite(_txDataPin, HIGH);                        //Set Tx pin HIGH level (txDataPin = BCM17)
-        digitalWrite(_txEnable, LOW);                          //Set State of 240 output 2 'driving' state
+        if(_uart)
+        {
+            _uart->hold(false);                                //the UART TX line is marking
+        }
+        else
+        {
+            _gpio->pull(_rxDataPin, SDI12_PUD_UP);             //Set RX Pin with pull up resistor enabled
+            _gpio->setEdge(_rxDataPin, SDI12_EDGE_BOTH);       //Enable edge detection on RXDATAPIN (one ioctl, no shell), the decoder needs both edges
+        }
+        _gpio->writeMask(pinMask(_rxEnable) | pinMask(_txDataPin),  //State of 240 output 1 in high impedance, Tx pin HIGH (marking)
+                         pinMask(_txEnable));                  //Set State of 240 output 2 'driving' state
         return ;
     }
-    else                                                       //Error message due to unexpected value.
-    {
-        std::cout << "Error: SetState = unknown check script for mistake" << "\n";
-        //std::cout << state << "\n";
-        std::cout << unsigned(state) << "\n";
-    }
+    //any other value is ignored, states are only set from this file
 }
 //forces a HOLDING state.
 void SDI12::forceHold()
 {
     //std::cout << "ForceHold() called" << "\n";
     setState(HOLDING);
+    _lastMarkingNs = 0;                                                         //the line is spacing, the next command wakes the sensors again
 }
 /*
 ================================= 3. Constructor, Destructor, SDI12.begin(), SDI12.end(), parityErrorStatus(), and overflowStatus()====================== (Kevin Smith and James Coppock)
@@ -199,37 +229,100 @@ destructor, as it will maintain the memory buffer.
 )
 (KMS: 3.6 - overflowStatus() - public function called to return the overflow error status
 )
+3.7 - realtimeListener() - pins the listening thread to a core and runs it SCHED_FIFO, with
+sdi12Realtime(), so other load on the Pi does not delay the decoding of the RX edges.
+Both need CAP_SYS_NICE (or root) for the priority; they return false if it was refused.
+3.8 - The serial constructor. The bus runs on an SDI12Uart (SDI12Uart.h) owned by the
+caller, the TX and RX data pins are SDI12_NO_PIN and the backend only drives the enables.
+Section 2 switches the enables as before, 4.5 sends and 6.5 receives through the tty.
 // 3.1 Constructor (JMC: Modified function parameters)
 */
-SDI12::SDI12(uint8_t txEnable, uint8_t txDataPin, uint8_t rxEnable, uint8_t rxDataPin)
+SDI12::SDI12(uint8_t txEnable, uint8_t txDataPin, uint8_t rxEnable, uint8_t rxDataPin, SDI12Gpio *gpio, size_t bufferSize)
+    : _rx(bufferSize)                                                           //initialise buffer, head and tail at 0
 {
     //std::cout << "constructor() Called \n";
-    _rxBufferHead = _rxBufferTail = 0;                                          //initialise buffer pointer
+    _rxRunning = false;                                                         //listening thread starts in begin()
+    _lastChar = 0;
+    _lastMarkingNs = 0;                                                         //nothing seen on the bus yet
+    _rxAddress = 0;
+    for(size_t i = 0; i < sizeof(_bitProfile) / sizeof(_bitProfile[0]); i++)
+    {
+        _bitProfile[i] = 0;                                                     //no sensor timed yet
+    }
+    _responseLength = 0;
+    _eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);                         //8.1
+    if(_eventFd < 0)
+    {
+        std::cout << "SDI12: cannot create the event fd : " << strerror(errno) << "\n";
+    }
+    _submitState = SDI12_SUBMIT_IDLE;
+    _submitTimeout = std::chrono::milliseconds(SDI12_DATA_TIMEOUT_MS);
+    _submitRetries = 0;
+    _submitCheck = 0;
+    _submitAttempt = 0;
+    _submitDeadlineNs = 0;
+    _submitStatus = SDI12_OK;
     _bufferOverflow = false;                                                    //initialise buffer overflow
     _parityError = false;                                                       //(JMC: initialise parity error)
+    _discarding = false;
     _txEnable = txEnable;                                                       //(JMC: assign pin number to private variables)
     _txDataPin = txDataPin;                                                     //(JMC: assign pin number to private variables)
     _rxEnable = rxEnable;                                                       //(JMC: assign pin number to private variables)
     _rxDataPin = rxDataPin;                                                     //(JMC: assign pin number to private variables)
+    _uart = 0;                                                                  //the data pins carry the bus
+    _ownsGpio = (gpio == 0);                                                    //no backend given, use the Raspberry Pi pins
+#if SDI12_CHIP_GPIO
+    _gpio = _ownsGpio ? new SDI12ChipGpio() : gpio;
+#else
+    _gpio = _ownsGpio ? new SDI12MockGpio() : gpio;                             //built without the Pi backend, an idle line
+#endif
+}
+// 3.8 - serial constructor, the bus is on uart and only the enables are pins
+SDI12::SDI12(SDI12Uart *uart, uint8_t txEnable, uint8_t rxEnable, SDI12Gpio *gpio, size_t bufferSize)
+    : SDI12(txEnable, SDI12_NO_PIN, rxEnable, SDI12_NO_PIN, gpio, bufferSize)
+{
+    _uart = uart;
 }
 //Destructor
 SDI12::~SDI12()
 {
     //std::cout ><< "Destructor () called\n";
     setState(DISABLED);
+    _rxRunning = false;                                                         //stop the listening thread
+    wakeListener();
+    if(_rxThread.joinable())
+    {
+        _rxThread.join();
+    }
+    if(_eventFd >= 0)
+    {
+        close(_eventFd);
+    }
+    if(_ownsGpio)
+    {
+        delete _gpio;
+    }
+    _gpio = 0;
 }
 
-//Begin - public function sets rising edge interrupt on RX datapin.
+//Begin - public function sets edge detection on RX datapin and starts the listening thread.
 void SDI12::begin()
 {
     //std::cout << "begin() called \n";
     setState(INTERRUPTENABLED);
+    _decoder.reset(SDI12_HIGH);                                                 //line is marking, no partial frame
+    _lastMarkingNs = 0;                                                         //the first command sends the full break
+    if(!_rxRunning)                                                             //start the listening thread once
+    {
+        _rxRunning = true;
+        _rxThread = std::thread(&SDI12::listen, this);
+    }
 }
 //end - public function
 void SDI12::end()
 {
     //std::cout << "end () called \n";
-    SDI12::setState(DISABLED);
+    setState(DISABLED);
 }
 //JMC : - new public function returns the parity error status.
 bool SDI12::parityErrorStatus()
@@ -237,6 +330,35 @@ bool SDI12::parityErrorStatus()
     //std::cout << "parityError () Called\n";
     return(_parityError);
 }
+//3.7 - pins thread to cpu (-1 leaves it) and runs it SCHED_FIFO at priority (0 leaves it)
+bool sdi12Realtime(pthread_t thread, int cpu, int priority)
+{
+    bool ok = true;
+    if(cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        ok = pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+    }
+    if(priority > 0)
+    {
+        struct sched_param param;
+        param.sched_priority = priority;
+        ok = pthread_setschedparam(thread, SCHED_FIFO, &param) == 0 && ok;
+    }
+    return ok;
+}
+
+//3.7 - public function, the listening thread is started by begin()
+bool SDI12::realtimeListener(int cpu, int priority)
+{
+    if(!_rxThread.joinable())
+    {
+        return false;
+    }
+    return sdi12Realtime(_rxThread.native_handle(), cpu, priority);
+}
 //public function returns the overflow status.
 bool SDI12::overflowStatus()
 {
@@ -245,15 +367,13 @@ bool SDI12::overflowStatus()
 }
 /* ========= 4. Waking up, and talking to, the sensors. =========(Kevin Smith and James Coppock)
 ------------------------------------| Function Descriptions |----------------------------------
-(JMC: 4.1 - wakeSensors() - original function (private) that is called by the public sendCommand
-function. wakeSensors() will wake the sensors on the SDI-12 bus by placing spacing
-(HIGH voltage level) for a minimum of 12 milliseconds (no upper limit specified in standard). 
-This is followed by a marking (logic LOW) for at least 8.33 ms (the upper limit to marking is about 90 ms). 
-As the SDI-12 sensors are permitted to sleep after 100 ms of marking. Allowing some extended time on the minimum, 
+(JMC: 4.1 - Waking the sensors. The sensors on the SDI-12 bus are woken by placing spacing
+(HIGH voltage level) for a minimum of 12 milliseconds (no upper limit specified in standard).
+This is followed by a marking (logic LOW) for at least 8.33 ms (the upper limit to marking is about 90 ms).
+As the SDI-12 sensors are permitted to sleep after 100 ms of marking. Allowing some extended time on the minimum,
 the break is held for 14.161 ms and the marking for 10 ms. The state is initially set to the transmitting state.
 )
-(JMC: 4.2 - writeChar(uint8_t out) - slightly modified private function, that outputs a single
-ASCII character to the SDI-12 bus. Each 10 bit frame that is sent out has 7 data bits, (LSB first) 1 start bit, 1 parity bit (even parity), and 1 stop bit. 
+(JMC: 4.2 - Each 10 bit frame that is sent out has 7 data bits, (LSB first) 1 start bit, 1 parity bit (even parity), and 1 stop bit.
 The SDI-12 protocol uses negative logic. An example a transmission of character 'a' is
 shown below. The binary representation of ASCII 'a' is 110 0001.
 The SDI12 line voltage for char 'a' is;
@@ -264,141 +384,180 @@ d = 7 data bits
 s = 1 start bit
 e = 1 parity bit
 f = 1 stop bit
+The start bit is a 1 on the SDI12 data line. Writing a LOW to the TX data pin will
+cause the SN74HCT240 to output a HIGH, so a LOW is written to the TX data pin for the start bit
+and a HIGH for the stop bit.
 )
-There are four steps to the transmission
-(JMC: 4.2.1 -The original code used an a function from the parity.h header to calculate the
-parity. I have used an alternate algorithm. The algorithm calculates the number of
-1's in the 8 bit frame with one parity bit and seven data bits. The algorithm returns
-_evenParityBit is either 0 (even number of 1's) or 1 (odd number of 1's). The frame
-should have an even number of ones for even parity.
-The code merges the first 4 bits with the last 4 bits using an XOR operation. As can
-be seen below the parity of two bits is computed with an XOR operation.
-(0 XOR 0) -> 0
-(0 XOR 1) -> 1
-(1 XOR 0) -> 1
-(1 XOR 1) -> 0
-Now with four bits we are left with 16 possible values for _evenParityBit. Shifting
-0x6996 to the right by _evenParityBit number of times leaves the relevant bit in bit
-position 0. A 0 for even and a 1 for odd parity.
-)
-(JMC: 4.2.2 - slightly modified code to send the start bit. The start bit is a 1 on the SDI12
-data line. The original code sent HIGH however writing a LOW to the TX data pin will
-cause the SN74HCT240 to output a HIGH, so a LOW is written to the TX data pin for 820
-us.
-)
-(KMS: 4.2.3 - (JMC: Slightly modified code switches the HIGH for LOW and LOW for HIGH)
-Send the payload (the 7 character bits and the parity bit) least significant bit
-first. This is accomplished bitwise AND operations on a moving mask (00000001) -->
-(00000010) --> (00000100)... and so on. This functionality makes use of the '<<='
-operator which stores the result of the bit-shift back into the left hand side.
-If the result of (out & mask) determines whether a 1 or 0 should be sent.
-if(out & mask){
-digitalWrite(_txDataPin, HIGH);
-}
-else{
-digitalWrite(_txDataPin, LOW);
-}
-4.2.4 - Slightly modified code to send the stop bit. The stop bit is always a '0', so we
-Appendix C: SDI12 C++ Library 103
-simply write the dataPin HIGH for 820 microseconds.
-4.3 - sendCommand(String cmd) - original public function that sends out a String byte by
-byte the data line.
-)
+4.3 - sendCommand(String cmd) - public function that sends out a String on the data line.
+cmd is taken as a std::string_view, so a literal, a std::string or an SDI12Command (a
+fixed capacity, constexpr capable address + command + '!' builder) is sent without a copy
+and without allocating.
+The break, the marking and every frame of cmd are compiled into one SDI12Waveform, a
+schedule of TX data pin edges, which is then played against absolute deadlines. The
+wait through the break and the marking is a sleep, not a busy wait, and the bits no
+longer drift the way they did with one relative delay (820/805 us) per bit. The timing
+of the last transmission can be read with txJitter().
+4.4 - The break is only needed to wake sleeping sensors. _lastMarkingNs is the time the
+line last went back to marking, after our last stop bit or after the last character a
+sensor sent. The marking of SDI12_MARKING_NS is sent either way, so the first start bit goes
+out that much later than now. If it still falls less than SDI12_MARKING_WINDOW_NS after
+_lastMarkingNs (the aD0! that follows an aM!, for example), the sensors are still awake and
+only the marking is sent, which saves the 14.161 ms break: the command is about 14 ms
+shorter on the wire than the full wake up of 4.1. The marking stays because the line may
+have been marking for only a few ms when the command is sent (right after a response) and
+the standard asks for at least 8.33 ms of marking before the first start bit. Otherwise,
+and after begin() or forceHold(), the full break is sent. sendSerial() gets the same flag.
+4.5 - sendSerial() - on a serial bus (3.8) the break is the UART's (SDI12Uart::sendBreak()),
+the marking a sleep, and the characters are written to the tty, whose UART frames them.
+The same rules decide on the break and the same counters and events are kept.
+4.6 - Timing profiles. The address of every command sent is kept in _rxAddress, the
+sensor that answers it. The listening thread decodes its response starting from the bit
+period learnt for that address (see 6.2.5 and SDI12Decoder.h) and moves the profile
+towards the period measured in every good frame. Profiles stay for the life of the
+object, across transactions; bitProfile() reads one and sets or forgets one, to carry
+them over from an earlier run for example.
+4.7 - While the capture of the bus is open, the edges of every waveform played go into it
+with the time play() started it (see SDI12Capture.h).
 */
-// 4.1 - private function that wakes up the entire sensor bus.
-void SDI12::wakeSensors()
+//public function that sends out the characters of the String cmd in one compiled waveform
+void SDI12::sendCommand(std::string_view cmd)
 {
+    //std::cout << "snedCommand Called\n";
+    SDI12Waveform wave;
+    uint64_t marking = _lastMarkingNs;
+    bool awake = marking != 0 && monotonicNs() + SDI12_MARKING_NS < marking + SDI12_MARKING_WINDOW_NS;  //4.4 - first start bit inside the window
+    if(_uart)                                                   //4.5
+    {
+        sendSerial(cmd, awake);
+        return;
+    }
+    if(awake)                                                   //4.4 - sensors still awake
+    {
+        wave.mark();                                            //marking only
+    }
+    else
+    {
+        wave.wake();                                            //break and marking wake up the sensors
+        _trace.count(SDI12_COUNT_BREAKS);
+    }
+    if(!cmd.empty())
+    {
+        _rxAddress = cmd[0];                                    //4.6 - its sensor answers
+    }
+    if(!wave.addString(cmd))                                    //every character as one 7E1 frame
+    {
+        _trace.event(SDI12_EVENT_REJECTED, cmd.empty() ? 0 : cmd[0], cmd.size());   //longer than SDI12_WAVE_MAX_CHARS, not sent
+        return;
+    }
+    _trace.count(SDI12_COUNT_COMMANDS);
+    _trace.event(SDI12_EVENT_COMMAND, cmd.empty() ? 0 : cmd[0], cmd.size());
     setState(TRANSMITTING);
-    digitalWrite(_txDataPin, LOW);
-    delayMicroseconds(14161);
-    digitalWrite(_txDataPin, HIGH);
-    delayMicroseconds(10000);
+    uint64_t start = wave.play(_gpio, _txDataPin, &_txJitter); //absolute deadlines, sleep then spin
+    if(_capture.active())                                      //4.7 - the edges as they were due
+    {
+        _capture.tx(wave.schedule(), wave.edges(), start);
+    }
+    _lastMarkingNs = monotonicNs();                            //last stop bit is on the line
+    setState(LISTENING);                                       //listen for reply
 }
-//private fuctionp that writes a character out on the data line (JMC: function modified)
-void SDI12::writeChar(uint8_t out)
-{
-    //std::cout << "Next Character out writeChar\n";
-    //std::cout << out << "\n"; //1byte with 7 bit ASCII character and with even parity bit in MSB
-    uint8_t _evenParityBit;                                       // (JMC: code written to calculate the parity bit)
-    _evenParityBit = out;                                         // (JMC: code written to calculate the parity bit)
-    _evenParityBit ^= out >> 4;                                   // (JMC: code written to calculate the parity bit)
-    _evenParityBit &= 0x0F;                                       // (JMC: code written to calculate the parity bit)
-    _evenParityBit = ((0x6996 >> _evenParityBit) & 1);            // (JMC: code written to calculate the parity bit)
 
-    out |= (_evenParityBit<<7);
-
-    digitalWrite(_txDataPin, LOW);                                // 4.2.2 - start bit
-    delayMicroseconds(820);
-    for (uint8_t mask = 0x01; mask; mask<<=1){                    // 4.2.3 - send payload
-    if(out & mask){
-    digitalWrite(_txDataPin, HIGH);
+//4.5 - private function that sends cmd through the UART, the break only if the sensors may sleep
+void SDI12::sendSerial(std::string_view cmd, bool awake)
+{
+    if(cmd.size() > SDI12_WAVE_MAX_CHARS)
+    {
+        _trace.event(SDI12_EVENT_REJECTED, cmd.empty() ? 0 : cmd[0], cmd.size());   //same limit as the waveform
+        return;
     }
-    else{
-    digitalWrite(_txDataPin, LOW);
+    if(!cmd.empty())
+    {
+        _rxAddress = cmd[0];
     }
-    delayMicroseconds(SPACING);
+    _trace.count(SDI12_COUNT_COMMANDS);
+    _trace.event(SDI12_EVENT_COMMAND, cmd.empty() ? 0 : cmd[0], cmd.size());
+    setState(TRANSMITTING);
+    if(!awake)
+    {
+        _uart->sendBreak(SDI12_BREAK_NS);                       //TIOCSBRK / TIOCCBRK
+        _trace.count(SDI12_COUNT_BREAKS);
     }
-    digitalWrite(_txDataPin, HIGH);                               // 4.2.4 - stop bit
-    delayMicroseconds(820);
-
+    std::this_thread::sleep_for(std::chrono::nanoseconds(SDI12_MARKING_NS));
+    _uart->send(cmd);                                           //returns once the last stop bit has left
+    _lastMarkingNs = monotonicNs();
+    setState(LISTENING);
 }
-//public function that sends out the characters of the String cmd, one by one
-void SDI12::sendCommand(std::string cmd)
+
+//public function that sends a command built without allocation (address + command + '!')
+void SDI12::sendCommand(const SDI12Command &cmd)
 {
-    //std::cout << "snedCommand Called\n";
-    wakeSensors();                                              //wake up sensors
-    for(unsigned i = 0; i < cmd.length(); i++)
+    if(cmd.overflow())
     {
-        //std::cout << "Next Character out - sendCommand() \n";
-        //std::cout << cmd[i] << "\n";                         //outputs variable(Note cout << (unsigned char))
-        writeChar(cmd[i]);                                     //write each characters
+        _trace.event(SDI12_EVENT_REJECTED, cmd.address(), SDI12_COMMAND_MAX);  //longer than SDI12_COMMAND_MAX, not sent
+        return;
     }
-    setState(LISTENING);                                       //listen for reply
+    sendCommand(cmd.view());
+}
+
+//public function returns the timing report of the last sendCommand()
+SDI12Jitter SDI12::txJitter()
+{
+    return _txJitter;
+}
+
+//4.6 - public function returns the bit period learnt for the sensor at address, 0 if none
+uint32_t SDI12::bitProfile(char address)
+{
+    return _bitProfile[address & 0x7F].load(std::memory_order_relaxed);
+}
+
+//4.6 - public function sets the bit period of the sensor at address, 0 forgets it
+void SDI12::bitProfile(char address, uint32_t bitNs)
+{
+    _bitProfile[address & 0x7F].store(bitNs, std::memory_order_relaxed);
+}
+
+//public function returns the edge capture of this bus, see SDI12Capture.h
+SDI12Capture &SDI12::capture()
+{
+    return _capture;
+}
+
+//public function returns the instrumentation of this bus, see SDI12Trace.h
+SDI12Trace &SDI12::trace()
+{
+    return _trace;
 }
 
 /* ============= 5. Reading from the SDI-12 object. ============(Kevin Smith and James Coppock)
+All of these are consumer side operations on the SDI12Ring (see section 1) and are called by the
+application thread while the listening thread keeps producing.
 (KMS: 5.1 - available() - (JMC: original public function that) returns the number of characters
-available in the buffer. To understand how:
-_rxBufferTail + _BUFFER_SIZE - _rxBufferHead) % _BUFFER_SIZE;
-accomplishes this task, we will use a few examples.
-To start take the buffer below that has _BUFFER_SIZE = 10. The message "abc" has
-been wrapped around (circular buffer).
-_rxBufferTail = 1 // points to the '-' after c
-_rxBufferHead = 8 // points to 'a'
-[ c ] [ - ] [ - ] [ - ] [ - ] [ - ] [ - ] [ - ] [ a ] [ b ]
-The number of available characters is (1 + 10 - 8) % 10 = 3
-The '%' or modulo operator finds the remainder of division of one number by another.
- In integer arithmetic 3 / 10 = 0, but has a remainder of 3. We can only get the remainder by using the the modulo '%'. 3 % 10 = 3. 
- This next case demonstrates more clearly why the modulo is used.
-rxBufferTail = 4 // points to the '-' after c
-_rxBufferHead = 1 // points to 'a'
-[ a ] [ b ] [ c ] [ - ] [ - ] [ - ] [ - ] [ - ] [ - ] [ - ]
-The number of available characters is (4 + 10 - 1) % 10 = 3
-If we did not use the modulo we would get either ( 4 + 10 - 1 ) = 13 characters
-or ( 4 + 10 - 1 ) / 10 = 1 character. Obviously neither is correct.
+available in the buffer, tail - head of the ring.
 If there has been a buffer overflow, available() will return -1.
 )
 (JMC: 5.2 - new public function that checks the last character in the buffer is a <LF> without
-consuming. The buffer tail is the index to 1 position advanced of the last
-character in thus the last char is _rxBufferTail-1 LF = 0000 1010 = 10(dec)
+consuming. LF = 0000 1010 = 10(dec)
 )
 (JMC: 5.3 - new public function that checks the second last character in the buffer is a <CR>
-without consuming. The buffer tail is the index to 1 position advanced of the
-last character in thus the second last char is:
-_rxBufferTail-2 CR = 0000 1101 = 13(dec)
+without consuming. CR = 0000 1101 = 13(dec). Both checks wrap around the end of the buffer.
 )
 (KMS: 5.4 - peek() - (JMC: original public function that) allows the user to look at the
-character that is at the head of the buffer. Unlike read() it does not consume the character (i.e. the index addressed by _rxBufferHead is not changed). 
+character that is at the head of the buffer. Unlike read() it does not consume the character (i.e. the head is not changed).
 peek() returns -1 if there are no characters to show.
-5.5 - flush() is a modified public function that clears the buffers contents by setting
-the index for both buffer head and tail back to zero. (JMC: new code also resets the status of the buffer overflow and parity error variables.)
+5.5 - flush() is a modified public function that clears the buffers contents by moving
+the head to the tail. (JMC: new code also resets the status of the buffer overflow and parity error variables.)
 5.6 - read() returns the character at the current head in the buffer after incrementing
-the index of the buffer head. This action 'consumes' the character, meaning it cannot be read from the buffer again. If you would rather see the character, 
+the index of the buffer head. This action 'consumes' the character, meaning it cannot be read from the buffer again. If you would rather see the character,
 but leave the index to head intact, you should use peek();
 )
 (JMC: 5.7 - advanceBufHead() - new public function that advances the buffer head. This function
 is used if only a certain part of the response from the sensor is needed. It saves reading all characters into the program and then discarding them.
+It never advances past the last character received.
 )
+5.8 - readInto() - consumes up to max characters into the caller's array in one call, so a
+whole response is taken without one read() per character.
+5.9 - peekRange() - copies up to max characters starting offset characters after the head
+without consuming them.
 */
 // 5.1 - public function that reveals the number of characters available in the buffer -
 int SDI12::availabe()
@@ -408,210 +567,584 @@ int SDI12::availabe()
     {
         return -1;
     }
-    return (_rxBufferTail + _BUFFER_SIZE - _rxBufferHead) % _BUFFER_SIZE;
+    return _rx.available();
 }
 
 //(JMC: 5.2 - new public function that checks the last character in the buffer is a <LF> without consuming)
 bool SDI12::LFCheck()
 {
     //std::cout << "LFCheck() called\n";
-    if(_rxBufferHead == _rxBufferTail)                             //Empty buffer? If yes, 0
-    {
-        return false;
-    }
-    int LF = _rxBuffer[_rxBufferTail -1];
-    //otherwise, read from "tail" (last character in)
-    if(LF == 10)
-    {
-        //std::cout << "Last character is a linefead <LF>! \n";
-        return true;
-    }
-    return false;
+    return _rx.last(0) == 10;                                   //-1 if the buffer is empty
 }
 //(JMC: 5.3 - new public function that checks the second last character in the buffer is a <CR> without consuming)
 bool SDI12::CRCheck()
 {
     //std::cout << "CRCheck() called \n";
-    if(_rxBufferHead == _rxBufferTail)                          //Empty buffer? if yes, 0
-    {
-        return false;
-    }
-    int CR = _rxBuffer[_rxBufferTail - 2];
-    if(CR == 13)                                                //Otherwise, check the second last character in buffer
-    {
-        return true;
-    }
-    return false;
+    return _rx.last(1) == 13;                                   //-1 if fewer than two characters
 }
 
 //5.4 - public function that rev eals the next character in the buffer without consuming
 int SDI12::peek()
 {
-    if(_rxBufferHead == _rxBufferTail)                        //Empty buffer? If yes, 01
-    {
-        return -1;
-    }
-    return _rxBuffer[_rxBufferHead];                          //otherwise, read from "head"
+    return _rx.peek();                                        //-1 if the buffer is empty
 }
 
 //5.5 - a public function that clears the buffer contents, resets the status of the buffer overflow and parrity error variables.
 void SDI12::flush()
 {
     //std::cout << "flush() called \n";
-    _rxBufferHead = _rxBufferTail = 0;
+    _rx.clear();
+    _responseLength = 0;
     _bufferOverflow = false;
     _parityError = false;
+    _discarding = false;
 }
 
 //5.6 - read in the next characterr from the buffer and moves the index ahead. (JMC: this is FIFO opperation)
 int SDI12::read()
 {
-    _bufferOverflow = false;
-    //reading makes room in the buffer
-    if(_rxBufferHead == _rxBufferTail)                     //Empty buffer ? If yes, -1
-    {
-        return -1;
-    }
-    uint8_t nextChar = _rxBuffer[_rxBufferHead];           //otherwise, grab char at head
-    _rxBufferHead = (_rxBufferHead + 1) % _BUFFER_SIZE;    //increment head. modulo will reset the _rxBufferHead to 0 when _rxBufferHead = bufferSize -1
-    return nextChar;                                       //return the char
+    _bufferOverflow = false;                               //reading makes room in the buffer
+    return _rx.read();                                     //-1 if the buffer is empty
 }
 
 //(JMC: 5.7 - new public function that adcvances the buffer head)
 void SDI12::advanceBufHead(int advance)
 {
     //std::cout << "advanceBufHead() called \n";
-    //std::cout << "initial buffer head position" << (int)_rxBufferHead << "\n";
-    _rxBufferHead = _rxBufferHead + advance;
-    //std::cout << "new buffer head position" < (int)_rxBufferHead << "\n";
+    if(advance > 0)
+    {
+        _rx.skip(advance);
+    }
+}
+
+//5.8 - public function that consumes up to max characters into dst, returns how many
+size_t SDI12::readInto(char *dst, size_t max)
+{
+    _bufferOverflow = false;
+    return _rx.readInto(dst, max);
+}
+
+//5.9 - public function that copies up to max characters from offset after the head without consuming, returns how many
+size_t SDI12::peekRange(char *dst, size_t offset, size_t max)
+{
+    return _rx.peekRange(dst, offset, max);
 }
 /* ================== 6. Interrupt Service Routine ============= ( James Coppock & Kevin Smith )
 (JMC:
 The original receiveChar() function did not include a parity check. I have modified the
-code to include a parity error check. Most of the timing delays were changed to decrease
-the chance of missing a bit when the operating system de-scheduled the thread.
-wiringPi library functions used:
-int digitalRead(int pin) - function returns the value read on the given pin. It will be
-HIGH or LOW (1 or 0) depending on the logic level at the pin (Gordons Projects 2015).
+code to include a parity error check.
 )
-(KMS:
-We have received an interrupt signal, what should we do?
-6.1 - function passes of responsibility to the receiveChar() function.
-6.2 - This function quickly reads a new character from the data line in to the buffer.
-It takes place over a series of key steps.
-6.2.1 - Check for the start bit. If it is not there, interrupt may be from interference
-or an interrupt we are not interested in, so return.
-6.2.2 - Make space in memory for the new character "newChar".
-6.2.3 - Wait half of a SPACING to help centre on the next bit. It will not actually be
-centred, or even approximately so until delayMicroseconds(SPACING) is called
-again.
-6.2.4 - For each of the 8 bits in the payload, read whether or not the line state is
-HIGH or LOW. We use a moving mask here, as was previously demonstrated in the writeByte() function.
-The loop runs from i=0x1 (hexadecimal notation for 00000001) to i<0x80
-(hexadecimal notation for 10000000). So the loop effectively uses the
-masks following masks: 00000001
-00000010
-00000100
-00001000
-00010000
-00100000
-01000000 and their inverses.
-Here we use an if / else structure that helps to balance the time it takes to
-either a HIGH vs a LOW, and helps maintain a constant timing.
-6.2.5 - Skip the stop bit.
+The character is no longer sampled by busy waiting 8 times for 800 us and 650 us for the
+stop bit, which held a core for about 8 ms per character and misread a bit whenever the
+thread was descheduled. begin() enables detection of both edges on the RX data pin and
+starts a listening thread. The kernel timestamps every edge, and the frames are rebuilt
+from the timestamp deltas by an SDI12Decoder (see SDI12Decoder.cpp for how the bits, the
+parity and the stop bit are read). The thread sleeps between edges.
+6.1 - handleInterrupt() - called by the listening thread for every wake up, passes
+responsibility to the receiveChar() function.
+6.2 - receiveChar() - sleeps until the RX data pin has edges or until the pending frame
+is complete, then feeds the edges to the decoder.
+6.2.1 - If a frame is being received, sleep no longer than the centre of its stop bit,
+otherwise wake up every 50 ms, or when the response or retry of a submitted command is due
+(8.3). The destructor and submit() end the sleep early with wakeListener().
+6.2.2 - Feed every edge to the decoder, each one may complete the previous frame.
+6.2.3 - No edge arrived and the stop bit centre has passed, complete the frame.
+6.2.4 - While the trace is enabled, the time from each edge's kernel timestamp to now goes
+into the latency histogram (see SDI12Trace.h).
+6.2.5 - Between frames the decoder is given the timing profile of the addressed sensor
+(4.6), the nominal 833.333 us for a sensor not timed yet.
+6.2.6 - While the capture of the bus is open, every batch of edges goes into it before it
+is decoded.
+6.3 - storeChar() - stores a decoded frame.
 (JMC:
-6.2.6 - The original code skipped the parity bit with a delay of 830 microseconds. Due
-to the number of parity errors that would come up the parity check was needed.
-The algorithm calculates the number of 1's in the 8 bit frame with one parity
-bit and seven data bits. The algorithm returns _evenParityBit is either 0 (even
-number of 1's) or 1 (odd number of 1's). The frame should have an even number of ones for even parity.
-The code merges the first 4 bits with the last 4 bits using an XOR
-operation. As can be seen below the parity of two bits is computed with
-an XOR operation.
-(0 XOR 0) -> 0
-(0 XOR 1) -> 1
-(1 XOR 0) -> 1
-(1 XOR 1) -> 0
-Now with four bits we are left with 16 possible values for _evenParityBit Shifting 0x6996 to the right by _evenParityBit number of times leaves the
-relevant bit in bit position 0. 6996 (Hex) = 0110 1001 1001 0110 (bin) which gives the 16 possibilities for the parity. A 0 for even and a 1 for odd parity
-If a parity error is picked up parityError status is set to true and the state
-is set to disabled. The interrupts will be disabled also.
+6.3.1 - If a parity error or incorrect stop bit is picked up parityError status is set to
+true and the state is set to disabled. The interrupts will be disabled also.
 )
+The state is no longer changed: disabling edge detection lost the rest of the response and
+every response after it until begin(). The error is recorded against the frame (counter and
+event in _trace) and against the response (parityError, which awaitResponse() reports as
+SDI12_PARITY_ERROR until flush()), and reception goes on. The rest of the damaged line is
+dropped up to its <LF>, so the next response starts clean.
 (KMS:
-6.2.7 - Check for an overflow. Check if advancing the index to most recent buffer entry
-(tail) will make it have the same index as the head (in a circular fashion). If there is an overflow a character will not be stored and hence will not overwrite buffer head
-6.2.8 - Save the byte into the buffer if there has not been an overflow, and then
-advance the tail index.
+6.3.2 - Check for an overflow. The ring is full when tail - head equals its capacity. If there is an overflow a character will not be stored and hence will not overwrite buffer head
+6.3.3 - Save the byte into the buffer if there has not been an overflow, and then
+advance the tail index (a release store, see SDI12Ring.h).
+6.3.4 - If the character is the <LF> of a <CR><LF>, or the character could not be stored, wake the
+thread sleeping in awaitResponse() as the last byte lands.
 )
+6.3.5 - Every frame, good or not, moves _lastMarkingNs to its end, the retry of 7.6 waits
+for the line to be quiet from there. A good frame with enough edges to time it moves the profile of the addressed
+sensor 1/2^SDI12_PROFILE_SHIFT of the way to its period, the first one sets it.
+Errors and characters are counted in _trace instead of being printed: a console write from
+the listening thread takes longer than a bit period and used to distort the timing it reported on.
+
+6.4 - listen() - body of the listening thread. Before every wait it moves a submitted command on (8.3).
+6.5 - receiveSerial() - on a serial bus (3.8) receiveChar() sleeps on the tty instead of
+the RX data pin. The UART has checked parity and framing; SDI12Uart hands over frames in
+the decoder's format, with errors as SDI12_FRAME_PARITY, and storeChar() takes them as is.
+The thread only wakes when characters arrive, not for every edge.
 */
 
-// 6.1 - public static function that passes off responsibility for an interrupt to the receiveChar() function.
-inline void SDI12::handleInterrupt()
+// 6.1 - public function that passes off responsibility for an interrupt to the receiveChar() function.
+void SDI12::handleInterrupt()
 {
-    if(_parityError == true)
+    receiveChar();
+}
+
+//6.2 - private function that decodes the edges of the RX data pin into characters (frames are rebuilt from kernel timestamps)
+void SDI12::receiveChar()
+{
+    if(_uart)                                                       //6.5
+    {
+        receiveSerial();
+        return;
+    }
+    SDI12Edge edges[32];
+    SDI12Frame frame;
+    int64_t timeoutUs = idleUs();                                   //6.2.1 - idle line, wake up now and then
+    uint64_t deadline = _decoder.deadline();
+    if(!deadline)                                                   //6.2.5 - between frames, time the addressed sensor
+    {
+        uint32_t profile = _bitProfile[_rxAddress & 0x7F].load(std::memory_order_relaxed);
+        _decoder.bitPeriod(profile ? profile : SDI12_BIT_NS);
+    }
+    else                                                            //6.2.1 - frame pending, wake up at its stop bit
+    {
+        uint64_t now = monotonicNs();
+        int64_t stopUs = deadline > now ? (deadline - now + 999) / 1000 : 0;
+        timeoutUs = stopUs < timeoutUs ? stopUs : timeoutUs;
+    }
+    int count = _gpio->waitEdges(_rxDataPin, edges, 32, timeoutUs);
+    if(count < 0)                                                   //edge detection not available, do not spin
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        return;
+    }
+    if(count > 0 && _capture.active())                              //6.2.6 - recorded before they are decoded
+    {
+        _capture.rx(edges, count);
+    }
+    if(count > 0 && _trace.enabled())                               //6.2.4 - edge to decoder latency
+    {
+        uint64_t now = monotonicNs();
+        for(int i = 0; i < count; i++)
+        {
+            _trace.latency(now > edges[i].ns ? now - edges[i].ns : 0);
+        }
+    }
+    for(int i = 0; i < count; i++)                                  //6.2.2 - feed every edge
     {
-        std::cout << "handleInterrupt() error : parity error is true: \n";
+        if(_decoder.feed(edges[i], frame))
+        {
+            storeChar(frame);
+        }
+    }
+    if(count == 0 && deadline && _decoder.advance(monotonicNs(), frame))    //6.2.3 - stop bit centre has passed
+    {
+        storeChar(frame);
+    }
+}
+
+//6.3 - private function that stores a decoded frame in the buffer
+void SDI12::storeChar(const SDI12Frame &frame)
+{
+    uint32_t bitNs = frame.bitNs ? frame.bitNs : SDI12_BIT_NS;
+    _lastMarkingNs = frame.ns + SDI12_FRAME_BITS * (uint64_t)bitNs;            //6.3.5 - the line marks from the end of this frame (4.4)
+    if(frame.status == SDI12_FRAME_STOP)                            //6.3.1
+    {
+        _trace.count(SDI12_COUNT_STOP);
+        _trace.event(SDI12_EVENT_STOP, frame.data, 0, frame.ns);
+        _parityError = true;                                        //JMC:
+        _discarding = true;                                         //rest of the line is dropped, edge detection stays on
+        wakeWaiter();
+        return;                                                     //JMC:
+    }
+    if(frame.status == SDI12_FRAME_PARITY)                          //6.3.1
+    {
+        _trace.count(SDI12_COUNT_PARITY);
+        _trace.event(SDI12_EVENT_PARITY, frame.data, 0, frame.ns);
+        _parityError = true;
+        _discarding = true;
+        wakeWaiter();
         return ;
     }
-    receiveChar();
+    if(_discarding)                                                 //6.3.1 - the damaged line goes on up to its <LF>
+    {
+        _discarding = frame.data != '\n';
+        _lastChar = 0;
+        return;
+    }
+
+    if(frame.bitNs)                                                //6.3.5 - follow the sensor's clock
+    {
+        std::atomic<uint32_t> &profile = _bitProfile[_rxAddress & 0x7F];
+        int64_t learnt = profile.load(std::memory_order_relaxed);
+        learnt = learnt ? learnt + ((int64_t)frame.bitNs - learnt) / (1 << SDI12_PROFILE_SHIFT) : frame.bitNs;
+        profile.store((uint32_t)learnt, std::memory_order_relaxed);
+    }
+    uint8_t newChar = frame.data;                                  //7 bit ASCII character, the decoder has removed the parity bit
+
+    if(!_rx.push(newChar))                                         //6.3.2 - Overflow? 6.3.3 - If not, char saved and tail advanced.
+    {
+        _bufferOverflow = true;                                    //bufferOverflow status set and newChar is not stored
+        _trace.count(SDI12_COUNT_OVERFLOW);
+        _trace.event(SDI12_EVENT_OVERFLOW, newChar, 0, frame.ns);
+        wakeWaiter();
+        _lastChar = newChar;
+        return;
+    }
+    _trace.count(SDI12_COUNT_FRAMES);
+    _trace.event(SDI12_EVENT_FRAME, newChar, 0, frame.ns);
+    if(newChar == '\n' && _lastChar == '\r')                         //6.3.4 - end of a response, wake awaitResponse()
+    {
+        _trace.event(SDI12_EVENT_RESPONSE, 0, _rx.available());
+        wakeWaiter();
+    }
+    _lastChar = newChar;
+}
+
+//6.5 - private function that stores the characters of the UART, it framed and checked them
+void SDI12::receiveSerial()
+{
+    SDI12Frame frames[32];
+    int count = _uart->receive(frames, 32, idleUs());               //wake up every 50 ms on an idle line
+    if(count < 0)                                                   //tty gone, do not spin
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        return;
+    }
+    for(int i = 0; i < count; i++)
+    {
+        storeChar(frames[i]);
+    }
+}
+
+//6.4 - body of the listening thread started by begin()
+void SDI12::listen()
+{
+    while(_rxRunning)
+    {
+        serveSubmitted();
+        handleInterrupt();
+    }
 }
 
-//6.2 - private function that reads a new character into the buffer(JMC : function modified to do parity error check on each received)
-inline void SDI12::receiveChar()
+/* ================== 7. Waiting for a response ============================
+Instead of spinning on availabe() and calling LFCheck()/CRCheck() until a response is complete, the
+application can sleep in awaitResponse() until the listening thread stores the <LF> of a <CR><LF>,
+reports an error or the deadline passes.
+7.1 - awaitResponse() - returns SDI12_OK and a view of the first line in the buffer, without its
+<CR><LF>. The view points into the buffer, nothing is copied; it stays valid until the response is
+released, flush() is called or characters are read. Errors take precedence over a complete line:
+SDI12_PARITY_ERROR, SDI12_OVERFLOW, then SDI12_OK, otherwise SDI12_TIMEOUT.
+7.2 - releaseResponse() - consumes the line returned by the last awaitResponse() and its <CR><LF>.
+7.3 - findLine() - looks for <CR><LF> in the characters in the buffer.
+7.4 - wakeWaiter() - called by the listening thread. It takes the lock only to order the notify
+after the waiter has checked the buffer, so no wake up is lost. With no command submitted it
+also makes eventFd() readable (8.1).
+7.5 - awaitData() - awaitResponse() for a aD0!/aR0! response, the line is parsed into the caller's
+SDI12Data straight from the buffer (see SDI12Data.h) and released. SDI12_INVALID if it does not parse.
+7.6 - transact() - one command and its response line. Stale characters are flushed first. A
+response from another address is released and reported as SDI12_INVALID, and so is a line
+that check (the CRC of a data response, for example) rejects.
+A failed attempt (no response, a parity, stop bit or overflow error, or SDI12_INVALID) sends
+the same command again, up to retries times, following the retry rules of the standard:
+- the retry waits until the line has been marking for SDI12_RETRY_GAP_MS after the last
+frame seen, so it never lands on the tail of a damaged response.
+- sendCommand() decides on the break (4.4): a retry within 85 ms of marking goes without
+one, a retry after a missing response (100 ms or more of marking) is preceded by a break
+as the sensors may be asleep again.
+Each retry is counted in _trace (SDI12_COUNT_RETRIES, SDI12_EVENT_RETRY). Recovering from a
+noisy burst costs one more round trip, nothing is re-initialised.
+*/
+//7.1 - public function that sleeps until a complete response, an error or the deadline
+SDI12Response SDI12::awaitResponse(std::chrono::steady_clock::time_point deadline)
 {
-    //std::cout << "receiveChar() called \n";
+    SDI12Response response;
+    size_t length = 0;
+    std::unique_lock<std::mutex> guard(_rxLock);
+    _rxReady.wait_until(guard, deadline, [&]{ return _parityError || _bufferOverflow || findLine(length); });
+    response.status = _parityError ? SDI12_PARITY_ERROR
+                    : _bufferOverflow ? SDI12_OVERFLOW
+                    : findLine(length) ? SDI12_OK
+                    : SDI12_TIMEOUT;
+    if(response.status == SDI12_OK)
+    {
+        response.line = _rx.view(0, length);
+        _responseLength = length + 2;
+    }
+    else if(response.status == SDI12_TIMEOUT)
+    {
+        _trace.count(SDI12_COUNT_TIMEOUTS);
+        _trace.event(SDI12_EVENT_TIMEOUT);
+    }
+    return response;
+}
+
+//7.2 - public function that consumes the last response and its <CR><LF>
+void SDI12::releaseResponse()
+{
+    _rx.skip(_responseLength);
+    _responseLength = 0;
+}
 
-    if(digitalRead(_rxDataPin) == 0)                                  //6.2.1 - Is the start bit LOW? a HIGH indicates a false trigger of interrupt
+//7.3 - private function, true if the buffer holds <CR><LF>, length is the number of characters before it
+bool SDI12::findLine(size_t &length)
+{
+    std::string_view pending = _rx.view(0, _rx.capacity());
+    size_t end = pending.find("\r\n");
+    if(end == std::string_view::npos)
     {
-        uint8_t newChar = 0;                                          //6.2.2 - Declare and initialise variable for char.
-        delayMicrosecnds(20);                                         //6.2.3 - sets a small delay period after the falling edge of the start bit was detected
-        for(uint16_t i = 0x1; i <= 0x80; i <<= 1)                     //6.2.4 - read the 7 data bits (for i = 1 to 0100 0000 (<<= bitshift assignment))
+        return false;
+    }
+    length = end;
+    return true;
+}
+
+//7.4 - private function that wakes awaitResponse()
+void SDI12::wakeWaiter()
+{
+    {
+        std::lock_guard<std::mutex> guard(_rxLock);
+    }
+    _rxReady.notify_all();
+    if(_submitState.load(std::memory_order_relaxed) == SDI12_SUBMIT_IDLE)       //8.1 - a submitted command signals once, when done
+    {
+        signalEvent();
+    }
+}
+
+//7.5 - public function that waits for a data response and parses it without copying or allocating
+SDI12Status SDI12::awaitData(std::chrono::steady_clock::time_point deadline, SDI12Data &data)
+{
+    SDI12Response response = awaitResponse(deadline);
+    if(response.status != SDI12_OK)
+    {
+        return response.status;
+    }
+    bool valid = data.parse(response.line);
+    releaseResponse();
+    return valid ? SDI12_OK : SDI12_INVALID;
+}
+
+//7.6 - public function that sends command and waits for its response line
+SDI12Status SDI12::transact(const SDI12Command &command, std::chrono::milliseconds timeout, SDI12Response &response,
+                            uint8_t retries, bool (*check)(std::string_view line))
+{
+    for(uint8_t attempt = 0; ; attempt++)
+    {
+        if(attempt > 0)                                                         //wait for a quiet line, then the same command again
         {
-            delayMicroseconds(800);                                   //(800)  Delay 800 us. This seems to work better than a full symbol period of 830 us.
-            uint8_t noti = ~i;                                        //~Bitwise NOT operator
-            if(!digitalRead(_rxDataPin))                              //If pin level is LOW(NOTE ! is Logical NOT operator)
+            uint64_t limit = monotonicNs() + (uint64_t)timeout.count() * 1000000;
+            uint64_t now = monotonicNs();
+            while(now < _lastMarkingNs + SDI12_RETRY_GAP_MS * 1000000ULL && now < limit)
             {
-                std::cout << "pin level LOW : " << "\n";
-                newChar &= noti;
-            }
-            else{                                                     //else pin level is HIGH
-                std::cout << "pin level HIGH : " << "\n";
-                newChar |= i;                                         // |= Bitwise inclusive OR assignment operator
+                std::this_thread::sleep_for(std::chrono::nanoseconds(_lastMarkingNs + SDI12_RETRY_GAP_MS * 1000000ULL - now));
+                now = monotonicNs();
             }
+            _trace.count(SDI12_COUNT_RETRIES);
+            _trace.event(SDI12_EVENT_RETRY, command.address(), attempt);
         }
+        flush();
+        sendCommand(command);
+        response = awaitResponse(std::chrono::steady_clock::now() + timeout);
+        SDI12Status status = response.status;
+        if(status == SDI12_OK && (response.line.empty() || response.line[0] != command.address() || (check && !check(response.line))))
+        {
+            releaseResponse();
+            status = SDI12_INVALID;
+        }
+        if(status == SDI12_OK || attempt >= retries)
+        {
+            response.status = status;
+            return status;
+        }
+    }
+}
 
-        uint8_t newChar2 = newChar;
-        newChar2 &= 0x7F;
+/* ================== 8. Event loop interface ============================
+An application built around one epoll (or poll, select ...) loop can drive any number of
+buses with no thread of its own per bus and without polling availabe() or sleeping in
+awaitResponse():
+8.1 - eventFd() - an eventfd (non-blocking, close-on-exec) made by the constructor. It becomes
+readable when a submitted command is done, whatever its outcome. With no command submitted,
+also when the listening thread stores a complete response or an error (7.4), for code that
+sends with sendCommand() and reads with awaitResponse() at a deadline of now. completed()
+reads it back to zero. Add it to the loop with EPOLLIN.
+8.2 - submit() - hands a command, its timeout, retries and check to the listening thread and
+returns at once. There is one slot per bus: false if a command is still in flight or not
+yet collected by completed(), if the command overflowed or if begin() has not started the
+listening thread. wakeListener() ends the wait of the listening thread (SDI12Gpio::wake(),
+SDI12Uart::wake()), so the command goes out without waiting for the 50 ms idle wake up.
+No thread is added: the listening thread of the bus is idle while the bus transmits, so it
+plays the waveform itself. From submit() until completed() returns true the listening thread
+owns the buffer: do not read or flush it, or call transact() or awaitResponse() meanwhile.
+8.3 - serveSubmitted() - called by the listening thread before every wait, it does what
+transact() (7.6) does, one step at a time and never sleeping:
+- QUEUED - flush(), sendCommand(), the response is due timeout after the last stop bit.
+- SENT - an error, a complete line or the deadline ends the attempt, with the outcome of
+awaitResponse() and the address check of transact(). A failed attempt with retries left goes
+to RETRY, anything else to DONE, which signals eventFd().
+- RETRY - sent again once the line has been marking for SDI12_RETRY_GAP_MS or timeout has
+passed, counted as a retry in _trace.
+idleUs() bounds the wait of 6.2.1 by the next of these deadlines.
+8.4 - completed() - clears eventFd() and, once the command is done, gives its status and, with
+SDI12_OK, its response line exactly as transact() does; releaseResponse() consumes it. The
+slot is then free for the next submit().
+*/
+//8.1 - public function returns the eventfd of this bus
+int SDI12::eventFd() const
+{
+    return _eventFd;
+}
 
-        delayMicroseconds(650);                                     //(650) 6.2.5 - Is the stop bit LOW? a LOW indicates an incorrect stop bit (inverted logic)
-        if(digitalRead(_rxDataPin) == 0)
-        {
-        std::cout << "receiveChar() Incorrect stop bit : - parityError set to true and interrupt disabled \n";
-        _parityError = true;                                        //JMC:
-        SDI12::end();                                               //JMC: Disable interrupt
-        return;                                                     //JMC:
+//8.1 - private function that makes eventFd() readable
+void SDI12::signalEvent()
+{
+    uint64_t one = 1;
+    if(_eventFd >= 0)
+    {
+        ssize_t done = ::write(_eventFd, &one, sizeof(one));          //fails only with the counter full, readable anyway
+        (void)done;
     }
+}
 
-        // (JMC: 6.2.6 - Check for parity error.)
-        uint8_t _evenOrOdd;                                         //JMC
-        _evenOrOdd = newChar;                                       //JMC
-        _evenOrOdd ^= newChar >> 4;                                 //JMC
-        _evenOrOdd &= 0x0F;                                         //JMC
-        _evenOrOdd = ((0x6996 >> _evenOrOdd) & 1);                  //JMC
-        std::cout << "receiveChar() parity error: - parityError set to true - check parityError()\n";
-        _parityError = true;
-        SDI12::end();
-        return ;
+//8.2 - private function that ends the wait of the listening thread
+void SDI12::wakeListener()
+{
+    if(_uart)
+    {
+        _uart->wake();
+    }
+    else if(_gpio)
+    {
+        _gpio->wake();
     }
+}
 
-    newChar &= 0x7F;                                               //Set the most significant bit(parity bit) to 0 leaving the 7 bit ASCII character.
+//8.2 - public function that submits command to the listening thread without waiting
+bool SDI12::submit(const SDI12Command &command, std::chrono::milliseconds timeout, uint8_t retries, bool (*check)(std::string_view line))
+{
+    if(command.overflow())
+    {
+        _trace.event(SDI12_EVENT_REJECTED, command.address(), SDI12_COMMAND_MAX);  //longer than SDI12_COMMAND_MAX, not sent
+        return false;
+    }
+    if(!_rxRunning || _submitState.load(std::memory_order_acquire) != SDI12_SUBMIT_IDLE)
+    {
+        return false;
+    }
+    _submitted = command;
+    _submitTimeout = timeout;
+    _submitRetries = retries;
+    _submitCheck = check;
+    _submitAttempt = 0;
+    _submitState.store(SDI12_SUBMIT_QUEUED, std::memory_order_release);
+    wakeListener();
+    return true;
+}
 
-    if((_rxBufferTail + 1) == _rxBufferHead)                       //6.2.7 - Overflow? If not, proceed.
+//8.3 - private function, how long the listening thread may wait before it has something to do
+int64_t SDI12::idleUs()
+{
+    uint8_t state = _submitState.load(std::memory_order_relaxed);
+    if(state == SDI12_SUBMIT_QUEUED)
     {
-        _bufferOverflow = true;                                    //bufferOverflow status set and newChar is not stored
-        std::cout << "Buffer full - check overflowStatus() " << "\n";
-    }else{                                                         //save char, advance tail.
-        _rxBuffer[_rxBufferTail] = newChar;
-        _rxBufferTail = (_rxBufferTail + 1) % _BUFFER_SIZE;        //increments buffer tail and resets to 0 if _rxBufferTail+1 == BUFFERSIZE
+        return 0;                                                   //submitted since serveSubmitted() looked
+    }
+    if(state != SDI12_SUBMIT_SENT && state != SDI12_SUBMIT_RETRY)
+    {
+        return 50000;
+    }
+    uint64_t due = _submitDeadlineNs;
+    uint64_t quiet = _lastMarkingNs + SDI12_RETRY_GAP_MS * 1000000ULL;
+    if(state == SDI12_SUBMIT_RETRY && quiet < due)
+    {
+        due = quiet;
+    }
+    uint64_t now = monotonicNs();
+    int64_t us = due > now ? (int64_t)((due - now + 999) / 1000) : 0;
+    return us < 50000 ? us : 50000;
+}
+
+//8.3 - private function, one step of the submitted command, run by the listening thread
+void SDI12::serveSubmitted()
+{
+    uint8_t state = _submitState.load(std::memory_order_acquire);
+    if(state == SDI12_SUBMIT_IDLE || state == SDI12_SUBMIT_DONE)
+    {
+        return;
+    }
+    uint64_t now = monotonicNs();
+    if(state == SDI12_SUBMIT_SENT)
+    {
+        size_t length = 0;
+        bool line = findLine(length);
+        if(!_parityError && !_bufferOverflow && !line && now < _submitDeadlineNs)
+        {
+            return;                                                 //still waiting for the response
+        }
+        SDI12Status status = _parityError ? SDI12_PARITY_ERROR
+                           : _bufferOverflow ? SDI12_OVERFLOW
+                           : line ? SDI12_OK
+                           : SDI12_TIMEOUT;
+        if(status == SDI12_OK)
+        {
+            _responseLength = length + 2;
+            std::string_view response = _rx.view(0, length);
+            if(response.empty() || response[0] != _submitted.address() || (_submitCheck && !_submitCheck(response)))
+            {
+                releaseResponse();
+                status = SDI12_INVALID;
+            }
+        }
+        else if(status == SDI12_TIMEOUT)
+        {
+            _trace.count(SDI12_COUNT_TIMEOUTS);
+            _trace.event(SDI12_EVENT_TIMEOUT);
+        }
+        if(status == SDI12_OK || _submitAttempt >= _submitRetries)
+        {
+            _submitStatus = status;
+            _submitState.store(SDI12_SUBMIT_DONE, std::memory_order_release);
+            signalEvent();
+            return;
+        }
+        _submitAttempt++;
+        _submitDeadlineNs = now + (uint64_t)_submitTimeout.count() * 1000000;
+        _submitState.store(SDI12_SUBMIT_RETRY, std::memory_order_relaxed);
+        state = SDI12_SUBMIT_RETRY;
+    }
+    if(state == SDI12_SUBMIT_RETRY)                                 //wait for a quiet line, then the same command again
+    {
+        if(now < _lastMarkingNs + SDI12_RETRY_GAP_MS * 1000000ULL && now < _submitDeadlineNs)
+        {
+            return;
+        }
+        _trace.count(SDI12_COUNT_RETRIES);
+        _trace.event(SDI12_EVENT_RETRY, _submitted.address(), _submitAttempt);
+    }
+    flush();
+    sendCommand(_submitted);
+    _submitDeadlineNs = monotonicNs() + (uint64_t)_submitTimeout.count() * 1000000;
+    _submitState.store(SDI12_SUBMIT_SENT, std::memory_order_relaxed);
+}
+
+//8.4 - public function, true and the response once the submitted command is done
+bool SDI12::completed(SDI12Response &response)
+{
+    if(_eventFd >= 0)
+    {
+        uint64_t count;
+        ssize_t done = ::read(_eventFd, &count, sizeof(count));       //back to zero, EAGAIN if it already was
+        (void)done;
+    }
+    if(_submitState.load(std::memory_order_acquire) != SDI12_SUBMIT_DONE)
+    {
+        return false;
     }
+    response.status = _submitStatus;
+    response.line = _submitStatus == SDI12_OK ? _rx.view(0, _responseLength - 2) : std::string_view();
+    _submitState.store(SDI12_SUBMIT_IDLE, std::memory_order_release);
+    return true;
 }
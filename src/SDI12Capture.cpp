@@ -0,0 +1,370 @@
+/* ================================ Edge capture ================================
+1 - SDI12Capture.
+1.1 - open() - the file is created, the header written and _lastNs set to its startNs.
+1.2 - rx() and tx() - the edges are encoded under _lock, the buffer is written out when
+fewer than one worst case varint (10 bytes) per edge is left. The listening thread only
+pays for the write() of a full buffer, every 20000 edges or so.
+1.3 - close() - clears _open first, so the bus stops calling in, then writes the buffer.
+2 - SDI12CaptureReader - the file is mapped read-only and decoded varint by varint.
+3 - SDI12Replay::run().
+3.1 - Before an edge reaches its decoder, a pending frame of either pin whose stop bit centre
+has passed is completed with advance(), as the listening thread does when its wait times
+out, so the frames of both pins come out in the order they were on the wire. Between
+frames the RX decoder is given the profile of the addressed sensor (6.2.5 of SDI12.cpp).
+3.2 - frame() - a good RX frame moves the profile of the addressed sensor by 1/2^
+SDI12_PROFILE_SHIFT of the difference (6.3.5 of SDI12.cpp). A good TX frame after '!' (or
+the first one) is the address of a new command. The wake up break decodes as a TX frame
+with a stop bit error and is not handed over.
+*/
+#include <SDI12Capture.h>
+#include <SDI12.h>
+#include <iostream>
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static_assert(sizeof(SDI12CaptureHeader) == 32, "SDI12CaptureHeader is stored as is");
+
+static const char SDI12_CAPTURE_MAGIC[4] = { 'S', 'D', 'I', 'C' };
+
+// returns CLOCK_MONOTONIC in nanoseconds, the clock of the edge timestamps
+static uint64_t monotonicNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// 1 - Constructor
+SDI12Capture::SDI12Capture()
+{
+    _open = false;
+    _fd = -1;
+    _lastNs = 0;
+    _used = 0;
+    _edges = 0;
+    _bytes = 0;
+}
+
+// 1 - Destructor
+SDI12Capture::~SDI12Capture()
+{
+    close();
+}
+
+// 1.1 - starts a capture file
+bool SDI12Capture::open(const char *path, uint32_t bitNs)
+{
+    close();
+    std::lock_guard<std::mutex> guard(_lock);
+    int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0)
+    {
+        std::cout << "SDI12Capture: cannot create " << path << " : " << strerror(errno) << "\n";
+        return false;
+    }
+    SDI12CaptureHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SDI12_CAPTURE_MAGIC, 4);
+    header.version = SDI12_CAPTURE_VERSION;
+    header.bitNs = bitNs;
+    header.startNs = monotonicNs();
+    header.wallNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    if(write(fd, &header, sizeof(header)) != sizeof(header))
+    {
+        std::cout << "SDI12Capture: cannot write " << path << " : " << strerror(errno) << "\n";
+        ::close(fd);
+        return false;
+    }
+    _fd = fd;
+    _lastNs = header.startNs;
+    _used = 0;
+    _edges = 0;
+    _bytes = sizeof(header);
+    _open.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+// 1.3 - stops the bus calling in, then writes the rest
+void SDI12Capture::close()
+{
+    _open.store(false, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> guard(_lock);
+    if(_fd < 0)
+    {
+        return;
+    }
+    drain();
+    ::close(_fd);
+    _fd = -1;
+}
+
+// 1.2 - writes the buffer out
+void SDI12Capture::drain()
+{
+    size_t written = 0;
+    while(written < _used)
+    {
+        ssize_t done = write(_fd, _buffer + written, _used - written);
+        if(done < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(done <= 0)
+        {
+            break;                                                  //disk full, the edges are lost
+        }
+        written += done;
+    }
+    _used = 0;
+}
+
+// 1.2 - one edge as a varint of the zigzag delta, pin and level
+void SDI12Capture::put(uint64_t ns, uint8_t pin, uint8_t level)
+{
+    if(_used > SDI12_CAPTURE_BUFFER - 10)
+    {
+        drain();
+    }
+    int64_t delta = (int64_t)(ns - _lastNs);
+    uint64_t value = (((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63)) << 2 | (uint64_t)pin << 1 | (level ? 1 : 0);
+    _lastNs = ns;
+    while(value >= 0x80)
+    {
+        _buffer[_used++] = (uint8_t)value | 0x80;
+        _bytes++;
+        value >>= 7;
+    }
+    _buffer[_used++] = (uint8_t)value;
+    _bytes++;
+    _edges++;
+}
+
+// 1.2 - edges of the RX data pin, kernel timestamps
+void SDI12Capture::rx(const SDI12Edge *edges, int count)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    if(_fd < 0)
+    {
+        return;
+    }
+    for(int i = 0; i < count; i++)
+    {
+        put(edges[i].ns, SDI12_CAPTURE_RX, edges[i].level);
+    }
+}
+
+// 1.2 - edges of a waveform started at startNs
+void SDI12Capture::tx(const SDI12Edge *edges, int count, uint64_t startNs)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    if(_fd < 0)
+    {
+        return;
+    }
+    for(int i = 0; i < count; i++)
+    {
+        put(startNs + edges[i].ns, SDI12_CAPTURE_TX, edges[i].level);
+    }
+}
+
+uint64_t SDI12Capture::edges()
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    return _edges;
+}
+
+uint64_t SDI12Capture::bytes()
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    return _bytes;
+}
+
+// 2 - Constructor maps the file
+SDI12CaptureReader::SDI12CaptureReader(const char *path)
+{
+    _map = 0;
+    _length = 0;
+    _at = sizeof(SDI12CaptureHeader);
+    _ns = 0;
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    if(fd < 0 || fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(SDI12CaptureHeader))
+    {
+        std::cout << "SDI12CaptureReader: cannot read " << path << "\n";
+        if(fd >= 0)
+        {
+            ::close(fd);
+        }
+        return;
+    }
+    void *map = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(map == MAP_FAILED)
+    {
+        std::cout << "SDI12CaptureReader: cannot map " << path << " : " << strerror(errno) << "\n";
+        return;
+    }
+    const SDI12CaptureHeader *header = (const SDI12CaptureHeader *)map;
+    if(memcmp(header->magic, SDI12_CAPTURE_MAGIC, 4) != 0 || header->version != SDI12_CAPTURE_VERSION)
+    {
+        std::cout << "SDI12CaptureReader: " << path << " is not a capture of this version\n";
+        munmap(map, info.st_size);
+        return;
+    }
+    _map = (const uint8_t *)map;
+    _length = info.st_size;
+    _ns = header->startNs;
+}
+
+// 2 - Destructor
+SDI12CaptureReader::~SDI12CaptureReader()
+{
+    if(_map)
+    {
+        munmap((void *)_map, _length);
+    }
+}
+
+bool SDI12CaptureReader::ready() const
+{
+    return _map != 0;
+}
+
+const SDI12CaptureHeader &SDI12CaptureReader::header() const
+{
+    return *(const SDI12CaptureHeader *)_map;
+}
+
+void SDI12CaptureReader::rewind()
+{
+    _at = sizeof(SDI12CaptureHeader);
+    _ns = _map ? header().startNs : 0;
+}
+
+// 2 - decodes the next varint
+bool SDI12CaptureReader::next(SDI12CaptureEdge &edge)
+{
+    if(!_map)
+    {
+        return false;
+    }
+    uint64_t value = 0;
+    size_t at = _at;
+    for(int shift = 0; ; shift += 7)
+    {
+        if(at == _length || shift > 63)
+        {
+            return false;                                           //end of the file or a truncated edge
+        }
+        uint8_t byte = _map[at++];
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if(!(byte & 0x80))
+        {
+            break;
+        }
+    }
+    _at = at;
+    uint64_t zigzag = value >> 2;
+    int64_t delta = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+    _ns += delta;
+    edge.ns = _ns;
+    edge.pin = (value >> 1) & 1;
+    edge.level = value & 1;
+    return true;
+}
+
+// 3 - Constructor
+SDI12Replay::SDI12Replay(uint32_t bitNs, bool profiles)
+{
+    _bitNs = bitNs;
+    _profiles = profiles;
+    memset(_profile, 0, sizeof(_profile));
+    _address = 0;
+    _command = true;
+    _decoder[SDI12_CAPTURE_RX].bitPeriod(bitNs);
+    _decoder[SDI12_CAPTURE_TX].bitPeriod(bitNs);
+}
+
+const SDI12Decoder &SDI12Replay::decoder(uint8_t pin) const
+{
+    return _decoder[pin & 1];
+}
+
+uint32_t SDI12Replay::profile(char address) const
+{
+    return _profile[address & 0x7F];
+}
+
+// 3 - every edge of the capture through its decoder
+uint64_t SDI12Replay::run(SDI12CaptureReader &reader, SDI12ReplayHandler handler, void *user)
+{
+    SDI12CaptureEdge captured;
+    SDI12Frame out;
+    uint64_t count = 0;
+    while(reader.next(captured))
+    {
+        for(uint8_t pin = 0; pin < 2; pin++)                        //3.1 - the wait would have timed out, on either pin
+        {
+            uint64_t deadline = _decoder[pin].deadline();
+            if(deadline && deadline <= captured.ns && _decoder[pin].advance(deadline, out))
+            {
+                frame(pin, out, handler, user);
+            }
+        }
+        SDI12Decoder &decoder = _decoder[captured.pin];
+        if(captured.pin == SDI12_CAPTURE_RX && !decoder.deadline())                 //3.1 - between frames, time the addressed sensor
+        {
+            uint32_t learnt = _profiles ? _profile[_address & 0x7F] : 0;
+            decoder.bitPeriod(learnt ? learnt : _bitNs);
+        }
+        SDI12Edge edge;
+        edge.ns = captured.ns;
+        edge.level = captured.level;
+        if(decoder.feed(edge, out))
+        {
+            frame(captured.pin, out, handler, user);
+        }
+        count++;
+    }
+    for(uint8_t pin = 0; pin < 2; pin++)                            //frames still pending at the end
+    {
+        uint64_t deadline = _decoder[pin].deadline();
+        if(deadline && _decoder[pin].advance(deadline, out))
+        {
+            frame(pin, out, handler, user);
+        }
+    }
+    return count;
+}
+
+// 3.2 - follows the commands and the sensors' clocks, hands the frame over
+void SDI12Replay::frame(uint8_t pin, const SDI12Frame &frame, SDI12ReplayHandler handler, void *user)
+{
+    if(pin == SDI12_CAPTURE_TX)
+    {
+        if(frame.status != SDI12_FRAME_OK)
+        {
+            return;                                                 //the break
+        }
+        if(_command)
+        {
+            _address = frame.data;
+        }
+        _command = frame.data == '!';
+    }
+    else if(frame.status == SDI12_FRAME_OK && frame.bitNs && _profiles)
+    {
+        uint32_t &learnt = _profile[_address & 0x7F];
+        learnt = learnt ? learnt + ((int64_t)frame.bitNs - learnt) / (1 << SDI12_PROFILE_SHIFT) : frame.bitNs;
+    }
+    if(handler)
+    {
+        handler(pin, frame, user);
+    }
+}
@@ -0,0 +1,706 @@
+/* ================================ Configuration ===============================
+1 - parse() - one pass over the text, line by line, in string_views. A ';' starts a comment,
+blank lines are skipped, "[bus]" and "[sensor]" start a section and every other line is
+key = value. A key given twice in a section, an unknown key, a number std::from_chars does
+not take whole, a pin or address out of range: each adds an SDI12ConfigError with its line
+and the line is skipped, so one run lists every mistake in the file.
+1.1 - finish() - when a section ends, its required keys are checked; what is missing is
+reported at the line of its [bus] or [sensor] header.
+1.2 - Once the text has been read, sensors are tied to their bus (the only one when they
+name none, so buses and sensors can come in any order) and addresses used twice on a bus
+are reported.
+The errors are handed back sorted by line.
+2 - load() - reads the whole file and parses it.
+3 - Accessors and schedule().
+4 - SDI12ConfigWatcher.
+4.1 - Constructor and destructor. The file is loaded once before the thread starts, so
+current() already holds it when the constructor returns. The destructor wakes the thread
+through the _stop eventfd.
+4.2 - load() - the text is read; if it is the one already loaded nothing happens, otherwise
+it is parsed and, without errors, stored in the std::atomic shared_ptr before _generation is
+incremented with release order, so a reader that sees the new generation gets the new
+snapshot. The handler is called either way.
+4.3 - watch() - poll() on the inotify descriptor and _stop. After an event for the file
+(IN_CLOSE_WRITE, IN_MOVED_TO or IN_CREATE with its name) the thread keeps reading events
+until SDI12_CONFIG_SETTLE_MS pass without one, then loads the file once.
+*/
+#include <SDI12Config.h>
+#include <SDI12Scheduler.h>
+#include <algorithm>
+#include <charconv>
+#include <iostream>
+#include <string>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+
+#define SECTION_NONE             0                      //before the first section
+#define SECTION_BUS              1
+#define SECTION_SENSOR           2
+#define SECTION_SKIPPED          3                      //a section that could not be stored, its keys are ignored
+#define BUS_NAME                 0x01                   //keys seen in a [bus] section
+#define BUS_TX_ENABLE            0x02
+#define BUS_TX_DATA              0x04
+#define BUS_RX_ENABLE            0x08
+#define BUS_RX_DATA              0x10
+#define BUS_SERIAL               0x20
+#define SENSOR_BUS               0x01                   //keys seen in a [sensor] section
+#define SENSOR_ADDRESS           0x02
+#define SENSOR_COMMAND           0x04
+#define SENSOR_INTERVAL          0x08
+
+struct SDI12ConfigKey                                                                   //a key of a section and its bit in the seen mask
+{
+    const char *name;
+    uint8_t bit;
+};
+
+static const SDI12ConfigKey busKeys[] = {
+    {"name", BUS_NAME}, {"txEnable", BUS_TX_ENABLE}, {"txData", BUS_TX_DATA},
+    {"rxEnable", BUS_RX_ENABLE}, {"rxData", BUS_RX_DATA}, {"serial", BUS_SERIAL}};
+static const SDI12ConfigKey sensorKeys[] = {
+    {"bus", SENSOR_BUS}, {"address", SENSOR_ADDRESS}, {"command", SENSOR_COMMAND}, {"interval", SENSOR_INTERVAL}};
+
+// strips spaces and tabs from both ends
+static std::string_view trim(std::string_view text)
+{
+    size_t first = text.find_first_not_of(" \t\r");
+    if(first == std::string_view::npos)
+    {
+        return std::string_view();
+    }
+    size_t last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+// copies text into a terminated buffer of size bytes, false if it does not fit
+static bool copyText(char *to, size_t size, std::string_view text)
+{
+    if(text.size() >= size)
+    {
+        return false;
+    }
+    memcpy(to, text.data(), text.size());
+    to[text.size()] = '\0';
+    return true;
+}
+
+class SDI12ConfigParser
+{
+    private:
+        SDI12Config &_config;
+        std::vector<SDI12ConfigError> &_errors;
+        uint8_t _section;                                                               //SECTION_*
+        uint32_t _sectionLine;                                                          //line of the section header
+        uint8_t _seen;                                                                  //keys given in the section
+        uint32_t _line;                                                                 //line being parsed
+        char _busName[SDI12_CONFIG_SENSORS][SDI12_CONFIG_NAME];                         //bus key of every sensor, tied in 1.2
+        uint32_t _sensorLine[SDI12_CONFIG_SENSORS];                                     //header line of every sensor
+        void error(uint32_t line, const char *format, ...);
+        void begin(std::string_view header);
+        void finish();
+        void value(std::string_view key, std::string_view value);
+        void busValue(uint8_t bit, std::string_view key, std::string_view value);
+        void sensorValue(uint8_t bit, std::string_view key, std::string_view value);
+        bool pin(std::string_view key, std::string_view value, uint8_t &out);
+        void resolve();
+    public:
+        SDI12ConfigParser(SDI12Config &config, std::vector<SDI12ConfigError> &errors);
+        void parse(std::string_view text);
+};
+
+SDI12ConfigParser::SDI12ConfigParser(SDI12Config &config, std::vector<SDI12ConfigError> &errors) : _config(config), _errors(errors)
+{
+    _section = SECTION_NONE;
+    _sectionLine = 0;
+    _seen = 0;
+    _line = 0;
+}
+
+// 1 - adds an error for line
+void SDI12ConfigParser::error(uint32_t line, const char *format, ...)
+{
+    SDI12ConfigError entry;
+    entry.line = line;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(entry.message, sizeof(entry.message), format, args);
+    va_end(args);
+    _errors.push_back(entry);
+}
+
+// 1 - every line of text
+void SDI12ConfigParser::parse(std::string_view text)
+{
+    while(!text.empty())
+    {
+        _line++;
+        size_t end = text.find('\n');
+        std::string_view line = text.substr(0, end);
+        text = end == std::string_view::npos ? std::string_view() : text.substr(end + 1);
+        line = trim(line.substr(0, line.find(';')));
+        if(line.empty())
+        {
+            continue;
+        }
+        if(line.front() == '[')
+        {
+            begin(line);
+            continue;
+        }
+        size_t equals = line.find('=');
+        if(equals == std::string_view::npos)
+        {
+            error(_line, "expected key = value or a [section]");
+            continue;
+        }
+        std::string_view key = trim(line.substr(0, equals));
+        std::string_view data = trim(line.substr(equals + 1));
+        if(key.empty() || data.empty())
+        {
+            error(_line, key.empty() ? "missing key before '='" : "missing value for %.*s", (int)key.size(), key.data());
+            continue;
+        }
+        value(key, data);
+    }
+    finish();
+    resolve();
+}
+
+// 1 - a section header, the section before it is complete
+void SDI12ConfigParser::begin(std::string_view header)
+{
+    finish();
+    _seen = 0;
+    _sectionLine = _line;
+    _section = SECTION_SKIPPED;
+    if(header == "[bus]")
+    {
+        if(_config._busCount == SDI12_CONFIG_BUSES)
+        {
+            error(_line, "more than %d buses", SDI12_CONFIG_BUSES);
+            return;
+        }
+        SDI12BusConfig &bus = _config._buses[_config._busCount];
+        memset(&bus, 0, sizeof(bus));
+        bus.txDataPin = SDI12_NO_PIN;
+        bus.rxDataPin = SDI12_NO_PIN;
+        _section = SECTION_BUS;
+        return;
+    }
+    if(header == "[sensor]")
+    {
+        if(_config._sensorCount == SDI12_CONFIG_SENSORS)
+        {
+            error(_line, "more than %d sensors", SDI12_CONFIG_SENSORS);
+            return;
+        }
+        SDI12SensorConfig &sensor = _config._sensors[_config._sensorCount];
+        sensor.bus = 0;
+        sensor.address = 0;
+        memcpy(sensor.command, "M", 2);
+        sensor.commandLength = 1;
+        sensor.interval = std::chrono::milliseconds(0);
+        _busName[_config._sensorCount][0] = '\0';
+        _sensorLine[_config._sensorCount] = _line;
+        _section = SECTION_SENSOR;
+        return;
+    }
+    error(_line, "unknown section %.*s, expected [bus] or [sensor]", (int)header.size(), header.data());
+}
+
+// 1.1 - checks the required keys and keeps the section
+void SDI12ConfigParser::finish()
+{
+    if(_section == SECTION_BUS)
+    {
+        SDI12BusConfig &bus = _config._buses[_config._busCount];
+        bool complete = true;
+        if((_seen & (BUS_TX_ENABLE | BUS_RX_ENABLE)) != (BUS_TX_ENABLE | BUS_RX_ENABLE))
+        {
+            error(_sectionLine, "[bus] needs txEnable and rxEnable");
+            complete = false;
+        }
+        bool pins = (_seen & (BUS_TX_DATA | BUS_RX_DATA)) != 0;
+        if((_seen & BUS_SERIAL) ? pins : (_seen & (BUS_TX_DATA | BUS_RX_DATA)) != (BUS_TX_DATA | BUS_RX_DATA))
+        {
+            error(_sectionLine, "[bus] needs either txData and rxData or serial");
+            complete = false;
+        }
+        uint8_t used[4] = {bus.txEnable, bus.txDataPin, bus.rxEnable, bus.rxDataPin};
+        for(int i = 0; complete && i < 4; i++)
+        {
+            for(int j = i + 1; j < 4; j++)
+            {
+                if(used[i] != SDI12_NO_PIN && used[i] == used[j])
+                {
+                    error(_sectionLine, "[bus] uses pin %d twice", used[i]);
+                    complete = false;
+                    break;
+                }
+            }
+        }
+        if(complete)
+        {
+            _config._busCount++;
+        }
+    }
+    else if(_section == SECTION_SENSOR)
+    {
+        if(!(_seen & SENSOR_ADDRESS))
+        {
+            error(_sectionLine, "[sensor] needs address");
+        }
+        else
+        {
+            _config._sensorCount++;
+        }
+    }
+    _section = SECTION_NONE;
+}
+
+// 1 - looks the key up in the keys of the section
+void SDI12ConfigParser::value(std::string_view key, std::string_view data)
+{
+    if(_section == SECTION_SKIPPED)
+    {
+        return;
+    }
+    if(_section == SECTION_NONE)
+    {
+        error(_line, "%.*s outside a [bus] or [sensor] section", (int)key.size(), key.data());
+        return;
+    }
+    const SDI12ConfigKey *keys = _section == SECTION_BUS ? busKeys : sensorKeys;
+    size_t count = _section == SECTION_BUS ? sizeof(busKeys) / sizeof(busKeys[0]) : sizeof(sensorKeys) / sizeof(sensorKeys[0]);
+    for(size_t i = 0; i < count; i++)
+    {
+        if(key != keys[i].name)
+        {
+            continue;
+        }
+        if(_seen & keys[i].bit)
+        {
+            error(_line, "%s given twice in this section", keys[i].name);
+            return;
+        }
+        _seen |= keys[i].bit;
+        if(_section == SECTION_BUS)
+        {
+            busValue(keys[i].bit, key, data);
+        }
+        else
+        {
+            sensorValue(keys[i].bit, key, data);
+        }
+        return;
+    }
+    error(_line, "unknown key %.*s in [%s]", (int)key.size(), key.data(), _section == SECTION_BUS ? "bus" : "sensor");
+}
+
+// 1 - a BCM pin number, 0 to SDI12_MAX_PINS - 1
+bool SDI12ConfigParser::pin(std::string_view key, std::string_view data, uint8_t &out)
+{
+    unsigned number = 0;
+    std::from_chars_result result = std::from_chars(data.data(), data.data() + data.size(), number);
+    if(result.ec != std::errc() || result.ptr != data.data() + data.size() || number >= SDI12_MAX_PINS)
+    {
+        error(_line, "%.*s must be a pin number from 0 to %d", (int)key.size(), key.data(), SDI12_MAX_PINS - 1);
+        return false;
+    }
+    out = number;
+    return true;
+}
+
+// 1 - a key of a [bus] section
+void SDI12ConfigParser::busValue(uint8_t bit, std::string_view key, std::string_view data)
+{
+    SDI12BusConfig &bus = _config._buses[_config._busCount];
+    switch(bit)
+    {
+        case BUS_NAME:
+            if(!copyText(bus.name, sizeof(bus.name), data))
+            {
+                error(_line, "bus name longer than %d characters", SDI12_CONFIG_NAME - 1);
+            }
+            else if(_config.findBus(data) >= 0)
+            {
+                error(_line, "bus %s is already defined", bus.name);
+            }
+            break;
+        case BUS_TX_ENABLE:
+            pin(key, data, bus.txEnable);
+            break;
+        case BUS_TX_DATA:
+            pin(key, data, bus.txDataPin);
+            break;
+        case BUS_RX_ENABLE:
+            pin(key, data, bus.rxEnable);
+            break;
+        case BUS_RX_DATA:
+            pin(key, data, bus.rxDataPin);
+            break;
+        case BUS_SERIAL:
+            if(!copyText(bus.serial, sizeof(bus.serial), data))
+            {
+                error(_line, "serial device path longer than %d characters", SDI12_CONFIG_PATH - 1);
+            }
+            break;
+    }
+}
+
+// 1 - a key of a [sensor] section
+void SDI12ConfigParser::sensorValue(uint8_t bit, std::string_view, std::string_view data)
+{
+    SDI12SensorConfig &sensor = _config._sensors[_config._sensorCount];
+    switch(bit)
+    {
+        case SENSOR_BUS:
+            if(!copyText(_busName[_config._sensorCount], SDI12_CONFIG_NAME, data))
+            {
+                error(_line, "unknown bus %.*s", (int)data.size(), data.data());
+            }
+            break;
+        case SENSOR_ADDRESS:
+        {
+            char address = data[0];
+            bool valid = (address >= '0' && address <= '9') || (address >= 'A' && address <= 'Z') || (address >= 'a' && address <= 'z');
+            if(data.size() != 1 || !valid)
+            {
+                error(_line, "address must be one of 0-9, A-Z or a-z");
+                break;
+            }
+            sensor.address = address;
+            break;
+        }
+        case SENSOR_COMMAND:
+        {
+            std::string_view rest = data;
+            bool valid = !rest.empty() && (rest[0] == 'M' || rest[0] == 'C');
+            if(valid)
+            {
+                rest.remove_prefix(1);
+                if(!rest.empty() && rest[0] == 'C')
+                {
+                    rest.remove_prefix(1);
+                }
+                valid = rest.empty() || (rest.size() == 1 && rest[0] >= '1' && rest[0] <= '9');
+            }
+            if(!valid)
+            {
+                error(_line, "command must be M, MC, C or CC, optionally followed by 1-9");
+                break;
+            }
+            memcpy(sensor.command, data.data(), data.size());
+            sensor.command[data.size()] = '\0';
+            sensor.commandLength = data.size();
+            break;
+        }
+        case SENSOR_INTERVAL:
+        {
+            uint64_t number = 0;
+            std::from_chars_result result = std::from_chars(data.data(), data.data() + data.size(), number);
+            std::string_view unit = trim(std::string_view(result.ptr, data.data() + data.size() - result.ptr));
+            uint64_t scale = unit == "ms" ? 1 : (unit.empty() || unit == "s") ? 1000 : unit == "min" ? 60000 : unit == "h" ? 3600000 : 0;
+            if(result.ec != std::errc() || scale == 0 || number > UINT32_MAX)
+            {
+                error(_line, "interval must be a number followed by ms, s, min or h");
+                break;
+            }
+            sensor.interval = std::chrono::milliseconds(number * scale);
+            break;
+        }
+    }
+}
+
+// 1.2 - ties every sensor to its bus, then looks for addresses used twice
+void SDI12ConfigParser::resolve()
+{
+    for(uint8_t i = 0; i < _config._sensorCount; i++)
+    {
+        SDI12SensorConfig &sensor = _config._sensors[i];
+        std::string_view name(_busName[i]);
+        int bus = name.empty() && _config._busCount == 1 ? 0 : _config.findBus(name);
+        if(bus < 0)
+        {
+            if(name.empty())
+            {
+                error(_sensorLine[i], "[sensor] needs bus, there are %d buses", (int)_config._busCount);
+            }
+            else
+            {
+                error(_sensorLine[i], "[sensor] on unknown bus %s", _busName[i]);
+            }
+            continue;
+        }
+        sensor.bus = bus;
+        for(uint8_t j = 0; j < i; j++)
+        {
+            if(_config._sensors[j].bus == sensor.bus && _config._sensors[j].address == sensor.address)
+            {
+                error(_sensorLine[i], "address %c is already used on this bus (line %u)", sensor.address, _sensorLine[j]);
+                break;
+            }
+        }
+    }
+}
+
+// 1 - Constructor, no buses and no sensors
+SDI12Config::SDI12Config()
+{
+    _busCount = 0;
+    _sensorCount = 0;
+}
+
+// 1 - parses text into a new snapshot
+std::shared_ptr<const SDI12Config> SDI12Config::parse(std::string_view text, std::vector<SDI12ConfigError> &errors)
+{
+    size_t before = errors.size();
+    std::shared_ptr<SDI12Config> config(new SDI12Config());
+    std::unique_ptr<SDI12ConfigParser> parser(new SDI12ConfigParser(*config, errors));     //its name table is too big for the stack
+    parser->parse(text);
+    if(errors.size() != before)
+    {
+        std::stable_sort(errors.begin() + before, errors.end(), [](const SDI12ConfigError &a, const SDI12ConfigError &b) { return a.line < b.line; });
+        return std::shared_ptr<const SDI12Config>();
+    }
+    return config;
+}
+
+// 2 - reads a whole file into text, an error if it cannot be opened
+static bool readFile(const char *path, std::string &text, std::vector<SDI12ConfigError> &errors)
+{
+    FILE *file = fopen(path, "rb");
+    if(!file)
+    {
+        SDI12ConfigError entry;
+        entry.line = 0;
+        snprintf(entry.message, sizeof(entry.message), "cannot open %s : %s", path, strerror(errno));
+        errors.push_back(entry);
+        return false;
+    }
+    text.clear();
+    char block[4096];
+    size_t got;
+    while((got = fread(block, 1, sizeof(block), file)) > 0)
+    {
+        text.append(block, got);
+    }
+    fclose(file);
+    return true;
+}
+
+// 2 - reads and parses a file
+std::shared_ptr<const SDI12Config> SDI12Config::load(const char *path, std::vector<SDI12ConfigError> &errors)
+{
+    std::string text;
+    if(!readFile(path, text, errors))
+    {
+        return std::shared_ptr<const SDI12Config>();
+    }
+    return parse(text, errors);
+}
+
+uint8_t SDI12Config::buses() const
+{
+    return _busCount;
+}
+
+const SDI12BusConfig &SDI12Config::bus(uint8_t index) const
+{
+    return _buses[index];
+}
+
+// 3 - linear search, there are at most SDI12_CONFIG_BUSES
+int SDI12Config::findBus(std::string_view name) const
+{
+    for(uint8_t i = 0; i < _busCount; i++)
+    {
+        if(name == _buses[i].name)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+uint8_t SDI12Config::sensors() const
+{
+    return _sensorCount;
+}
+
+const SDI12SensorConfig &SDI12Config::sensor(uint8_t index) const
+{
+    return _sensors[index];
+}
+
+// 3 - linear search, the configuration is only searched when it is applied
+int SDI12Config::findSensor(uint8_t bus, char address) const
+{
+    for(uint8_t i = 0; i < _sensorCount; i++)
+    {
+        if(_sensors[i].bus == bus && _sensors[i].address == address)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// 3 - adds the sensors of one bus to its scheduler
+uint8_t SDI12Config::schedule(SDI12Scheduler &scheduler, uint8_t bus) const
+{
+    uint8_t added = 0;
+    for(uint8_t i = 0; i < _sensorCount; i++)
+    {
+        if(_sensors[i].bus == bus && scheduler.add(_sensors[i].address, _sensors[i].measurement(), _sensors[i].interval))
+        {
+            added++;
+        }
+    }
+    return added;
+}
+
+// 4.1 - Constructor loads the file and starts watching its directory
+SDI12ConfigWatcher::SDI12ConfigWatcher(const char *path, SDI12ConfigHandler handler, void *user) : _path(path)
+{
+    _generation = 0;
+    _handler = handler;
+    _user = user;
+    _stop = -1;
+    size_t slash = _path.rfind('/');
+    std::string directory = slash == std::string::npos ? std::string(".") : slash == 0 ? std::string("/") : _path.substr(0, slash);
+    _name = slash == std::string::npos ? _path : _path.substr(slash + 1);
+    load();
+    _inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(_inotify >= 0 && inotify_add_watch(_inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+    {
+        close(_inotify);
+        _inotify = -1;
+    }
+    if(_inotify >= 0)
+    {
+        _stop = eventfd(0, EFD_CLOEXEC);
+    }
+    if(_inotify < 0 || _stop < 0)
+    {
+        std::cout << "SDI12ConfigWatcher: cannot watch " << directory << " : " << strerror(errno) << "\n";
+        if(_inotify >= 0)
+        {
+            close(_inotify);
+            _inotify = -1;
+        }
+        return;
+    }
+    _thread = std::thread(&SDI12ConfigWatcher::watch, this);
+}
+
+// 4.1 - Destructor
+SDI12ConfigWatcher::~SDI12ConfigWatcher()
+{
+    if(_thread.joinable())
+    {
+        uint64_t one = 1;
+        ssize_t written = write(_stop, &one, sizeof(one));
+        (void)written;
+        _thread.join();
+    }
+    if(_stop >= 0)
+    {
+        close(_stop);
+    }
+    if(_inotify >= 0)
+    {
+        close(_inotify);
+    }
+}
+
+bool SDI12ConfigWatcher::watching() const
+{
+    return _inotify >= 0;
+}
+
+std::shared_ptr<const SDI12Config> SDI12ConfigWatcher::current() const
+{
+    return _current.load();
+}
+
+uint32_t SDI12ConfigWatcher::generation() const
+{
+    return _generation.load(std::memory_order_acquire);
+}
+
+// 4.2 - reads the file and publishes it if it changed and parses
+void SDI12ConfigWatcher::load()
+{
+    std::vector<SDI12ConfigError> errors;
+    std::string text;
+    std::shared_ptr<const SDI12Config> config;
+    if(readFile(_path.c_str(), text, errors))
+    {
+        if(_generation.load(std::memory_order_relaxed) > 0 && text == _text)
+        {
+            return;                                                 //touched, not changed
+        }
+        _text.swap(text);
+        config = SDI12Config::parse(_text, errors);
+    }
+    if(config)
+    {
+        _current.store(config);
+        _generation.fetch_add(1, std::memory_order_release);
+    }
+    if(_handler)
+    {
+        _handler(config, errors, _user);
+    }
+}
+
+// 4.3 - waits for changes to the file, settles and loads it
+void SDI12ConfigWatcher::watch()
+{
+    struct pollfd fds[2];
+    fds[0].fd = _inotify;
+    fds[0].events = POLLIN;
+    fds[1].fd = _stop;
+    fds[1].events = POLLIN;
+    bool changed = false;
+    while(true)
+    {
+        int ready = poll(fds, 2, changed ? SDI12_CONFIG_SETTLE_MS : -1);
+        if(ready < 0 && errno != EINTR)
+        {
+            return;
+        }
+        if(fds[1].revents & POLLIN)
+        {
+            return;
+        }
+        if(ready == 0)                                              //settled
+        {
+            changed = false;
+            load();
+            continue;
+        }
+        if(!(fds[0].revents & POLLIN))
+        {
+            continue;
+        }
+        alignas(struct inotify_event) char events[4096];
+        ssize_t got = read(_inotify, events, sizeof(events));
+        for(ssize_t at = 0; at < got; )
+        {
+            const struct inotify_event *event = (const struct inotify_event *)(events + at);
+            if(event->len > 0 && _name == event->name)
+            {
+                changed = true;
+            }
+            at += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
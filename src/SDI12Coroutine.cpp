@@ -0,0 +1,528 @@
+/* ============================== Coroutine interface ===========================
+1 - Task end. finish() - a task that was awaited resumes its caller by symmetric transfer,
+so a chain of tasks unwinds without going back to the loop. A spawned task leaves
+_spawned and its frame is destroyed; the loop goes on (std::noop_coroutine()).
+2 - Bus awaiters. They are only awaited by the coroutines of section 3.
+2.1 - SDI12TakeAwaiter - takes the bus for the task, or links the task's SDI12Waiter at the
+end of the bus's list and suspends. The SDI12BusHold in the task's frame gives the bus
+back when the task is done with it, or when the frame goes: the oldest waiter is readied
+and the bus stays taken, handed over, so no later task can get in between.
+2.2 - SDI12ExchangeAwaiter - submit() (8.2 of SDI12.cpp), then the task is the bus's
+exchange waiter until serve() sees completed(). The response line is copied into the
+waiter's SDI12Transaction and released from the bus buffer, SDI12_OVERFLOW if it does not
+fit or if the command could not be submitted.
+2.3 - SDI12LineAwaiter - waits for a line nobody asked for, the service request after aM!,
+until a deadline. The bus is looked at before suspending: the eventFd() signal of a line
+that arrived just after the aM! response has been read by completed() already.
+3 - SDI12::command(), identify() and measure(). measure() follows 4.2 and 4.3 of
+SDI12Scheduler.cpp: atttn is parsed, aM!/aMC! keep the bus until the service request or
+ttt, aC!/aCC! give it back for ttt, then aD0!..aD9! until the announced values are in,
+with the CRC checked and a failed aDn! sent again on its own.
+4 - SDI12Executor.
+4.1 - Constructor and destructor. The destructor destroys the spawned tasks that have not
+ended, and with them the tasks they await.
+4.2 - spawn() - the task is readied with this executor in its promise.
+4.3 - runOnce() - resumes every ready task, sleeps in epoll_wait() for no longer than wait,
+the next sleeper or the next line deadline (not at all with tasks ready), serves the
+buses whose eventFd() is readable, readies what is due and resumes again.
+4.4 - serve() - completed() clears the eventFd() and hands a finished command to the
+exchange waiter; then a line waiter is given a line if there is one.
+4.5 - expire() - sleepers whose time has come are readied, and line waiters whose deadline
+has passed with SDI12_TIMEOUT.
+*/
+#include <SDI12Coroutine.h>
+#include <SDI12Crc.h>
+#include <algorithm>
+#include <iostream>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+struct SDI12Waiter                                                                      //a task suspended on a bus
+{
+    std::coroutine_handle<> task;                                                       //resumed when done
+    SDI12Waiter *next;                                                                  //next task waiting for the bus
+    SDI12Transaction result;                                                            //response of an exchange or a line
+};
+
+// 2.2 - copies the response line out of the bus buffer and releases it
+static void copyResponse(SDI12 &bus, const SDI12Response &response, SDI12Transaction &transaction)
+{
+    transaction.status = response.status;
+    transaction.length = 0;
+    if(response.status != SDI12_OK)
+    {
+        return;
+    }
+    if(response.line.size() > SDI12_RESPONSE_MAX)
+    {
+        transaction.status = SDI12_OVERFLOW;
+    }
+    else
+    {
+        transaction.length = response.line.size();
+        memcpy(transaction.line, response.line.data(), transaction.length);
+    }
+    bus.releaseResponse();
+}
+
+// 1 - resumes the caller, or frees a spawned task
+std::coroutine_handle<> SDI12FinalAwaiter::finish(SDI12Promise &promise, std::coroutine_handle<> done) noexcept
+{
+    if(promise.continuation)
+    {
+        return promise.continuation;
+    }
+    std::vector<std::coroutine_handle<>> &spawned = promise.executor->_spawned;
+    std::vector<std::coroutine_handle<>>::iterator found = std::find(spawned.begin(), spawned.end(), done);
+    if(found != spawned.end())
+    {
+        *found = spawned.back();
+        spawned.pop_back();
+    }
+    done.destroy();
+    return std::noop_coroutine();
+}
+
+SDI12SleepAwaiter sdi12Sleep(std::chrono::steady_clock::duration duration)
+{
+    return SDI12SleepAwaiter{ std::chrono::steady_clock::now() + duration };
+}
+
+SDI12SleepAwaiter sdi12SleepUntil(std::chrono::steady_clock::time_point until)
+{
+    return SDI12SleepAwaiter{ until };
+}
+
+void SDI12SleepAwaiter::suspend(SDI12Executor *executor, std::coroutine_handle<> task)
+{
+    executor->_timers.push_back(SDI12Executor::Timer{ until, task });
+    std::push_heap(executor->_timers.begin(), executor->_timers.end());
+}
+
+// 2.1 - the bus of a task, given back by the destructor
+struct SDI12BusHold
+{
+    SDI12Executor *executor = 0;                                                        //executor of the task
+    SDI12Executor::Bus *entry = 0;                                                      //the bus in it, 0 if it could not be added
+    bool held = false;                                                                  //the task has the bus
+    ~SDI12BusHold()
+    {
+        release();
+    }
+    void release()                                                                      //hands the bus to the oldest waiter
+    {
+        if(!held)
+        {
+            return;
+        }
+        held = false;
+        SDI12Waiter *next = entry->first;
+        if(!next)
+        {
+            entry->taken = false;
+            return;
+        }
+        entry->first = next->next;
+        if(!entry->first)
+        {
+            entry->last = 0;
+        }
+        executor->_ready.push_back(next->task);                                         //still taken, it is next's now
+    }
+};
+
+// 2.1 - takes the bus or queues for it
+struct SDI12TakeAwaiter
+{
+    SDI12 &bus;
+    SDI12BusHold &hold;
+    SDI12Waiter waiter;
+    SDI12TakeAwaiter(SDI12 &bus, SDI12BusHold &hold) : bus(bus), hold(hold)
+    {
+    }
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+    template<typename P> bool await_suspend(std::coroutine_handle<P> task)
+    {
+        return suspend(task.promise().executor, task);
+    }
+    void await_resume()
+    {
+        hold.held = hold.entry != 0;
+    }
+    bool suspend(SDI12Executor *executor, std::coroutine_handle<> task)
+    {
+        hold.executor = executor;
+        hold.entry = executor->attach(bus);
+        if(!hold.entry || !hold.entry->taken)
+        {
+            if(hold.entry)
+            {
+                hold.entry->taken = true;
+            }
+            return false;                                                               //go on at once
+        }
+        waiter.task = task;
+        waiter.next = 0;
+        if(hold.entry->last)
+        {
+            hold.entry->last->next = &waiter;
+        }
+        else
+        {
+            hold.entry->first = &waiter;
+        }
+        hold.entry->last = &waiter;
+        return true;
+    }
+};
+
+// 2.2 - one command and its response, on a bus the task holds
+struct SDI12ExchangeAwaiter
+{
+    SDI12BusHold &hold;
+    SDI12Command command;
+    std::chrono::milliseconds timeout;
+    uint8_t retries;
+    bool (*check)(std::string_view line);
+    SDI12Waiter waiter;
+    SDI12ExchangeAwaiter(SDI12BusHold &hold, const SDI12Command &command, std::chrono::milliseconds timeout, uint8_t retries,
+                         bool (*check)(std::string_view line) = 0)
+        : hold(hold), command(command), timeout(timeout), retries(retries), check(check)
+    {
+        waiter.result.status = SDI12_OVERFLOW;
+        waiter.result.length = 0;
+    }
+    bool await_ready() const noexcept
+    {
+        return !hold.held;                                                              //no bus, SDI12_OVERFLOW
+    }
+    bool await_suspend(std::coroutine_handle<> task)
+    {
+        if(!hold.entry->bus->submit(command, timeout, retries, check))
+        {
+            return false;
+        }
+        waiter.task = task;
+        hold.entry->exchange = &waiter;
+        return true;
+    }
+    SDI12Transaction await_resume()
+    {
+        return waiter.result;
+    }
+};
+
+// 2.3 - a line sent unasked, or SDI12_TIMEOUT at until
+struct SDI12LineAwaiter
+{
+    SDI12BusHold &hold;
+    std::chrono::steady_clock::time_point until;
+    SDI12Waiter waiter;
+    SDI12LineAwaiter(SDI12BusHold &hold, std::chrono::steady_clock::time_point until) : hold(hold), until(until)
+    {
+        waiter.result.status = SDI12_TIMEOUT;
+        waiter.result.length = 0;
+    }
+    bool await_ready() const noexcept
+    {
+        return !hold.held;
+    }
+    bool await_suspend(std::coroutine_handle<> task)
+    {
+        waiter.task = task;
+        hold.entry->line = &waiter;
+        hold.entry->lineUntil = until;
+        return !hold.executor->checkLine(*hold.entry);                                 //already there, go on
+    }
+    SDI12Transaction await_resume()
+    {
+        return waiter.result;
+    }
+};
+
+// 3 - transact() for a task
+SDI12Task<SDI12Transaction> SDI12::command(SDI12Command cmd, std::chrono::milliseconds timeout, uint8_t retries)
+{
+    SDI12BusHold hold;
+    co_await SDI12TakeAwaiter(*this, hold);
+    co_return co_await SDI12ExchangeAwaiter(hold, cmd, timeout, retries);
+}
+
+// 3 - aI!
+SDI12Task<SDI12Transaction> SDI12::identify(char address)
+{
+    co_return co_await command(SDI12Command(address, "I"), std::chrono::milliseconds(SDI12_DATA_TIMEOUT_MS));
+}
+
+// 3 - aM!, the service request or ttt, aD0!..aD9!
+SDI12Task<SDI12Reading> SDI12::measure(char address, std::string_view command)
+{
+    SDI12Reading reading;
+    reading.address = address;
+    reading.time = std::chrono::steady_clock::now();
+    reading.status = SDI12_OK;
+    reading.data.clear(address);
+    bool concurrent = !command.empty() && command[0] == 'C';
+    bool crc = command.size() > 1 && command[1] == 'C';
+    SDI12Command start(address, command);
+    SDI12BusHold hold;
+    co_await SDI12TakeAwaiter(*this, hold);
+    SDI12Transaction answer = co_await SDI12ExchangeAwaiter(hold, start, std::chrono::milliseconds(SDI12_ACK_TIMEOUT_MS), SDI12_RETRIES);
+    uint16_t ttt = 0;
+    uint8_t values = 0;
+    if(answer.status == SDI12_OK && !sdi12ParseTiming(answer.view(), ttt, values))
+    {
+        answer.status = SDI12_INVALID;
+    }
+    if(answer.status != SDI12_OK)
+    {
+        reading.status = answer.status;
+        co_return reading;
+    }
+    std::chrono::steady_clock::time_point ready = std::chrono::steady_clock::now() + std::chrono::seconds(ttt);
+    if(concurrent)                                                                      //the bus is free while it measures
+    {
+        hold.release();
+        co_await sdi12SleepUntil(ready);
+        co_await SDI12TakeAwaiter(*this, hold);
+    }
+    else if(ttt > 0)                                                                    //the service request or ttt, whichever is first
+    {
+        co_await SDI12LineAwaiter(hold, ready);
+    }
+    for(uint8_t d = 0; reading.status == SDI12_OK && d <= 9 && reading.data.count() < values; d++)
+    {
+        char data[2] = { 'D', (char)('0' + d) };
+        uint8_t before = reading.data.count();
+        SDI12Transaction response = co_await SDI12ExchangeAwaiter(hold, SDI12Command(address, std::string_view(data, 2)),
+                                                                  std::chrono::milliseconds(SDI12_DATA_TIMEOUT_MS), SDI12_DATA_RETRIES,
+                                                                  crc ? sdi12CrcValid : 0);     //only this aDn! is sent again
+        reading.status = response.status;
+        if(reading.status == SDI12_OK)
+        {
+            std::string_view line = response.view();
+            if(crc)
+            {
+                line.remove_suffix(SDI12_CRC_LENGTH);
+            }
+            reading.status = reading.data.parse(line, true) ? SDI12_OK : SDI12_INVALID;
+        }
+        if(reading.status == SDI12_OK && reading.data.count() == before)               //no more values
+        {
+            break;
+        }
+    }
+    if(reading.status == SDI12_OK && reading.data.count() < values)
+    {
+        reading.status = SDI12_INVALID;
+    }
+    co_return reading;
+}
+
+// 4.1 - Constructor
+SDI12Executor::SDI12Executor()
+{
+    _epoll = epoll_create1(EPOLL_CLOEXEC);
+    if(_epoll < 0)
+    {
+        std::cout << "SDI12Executor: cannot create epoll : " << strerror(errno) << "\n";
+    }
+    _busCount = 0;
+    _resumes = 0;
+}
+
+// 4.1 - Destructor
+SDI12Executor::~SDI12Executor()
+{
+    while(!_spawned.empty())
+    {
+        std::coroutine_handle<> task = _spawned.back();
+        _spawned.pop_back();
+        task.destroy();
+    }
+    if(_epoll >= 0)
+    {
+        close(_epoll);
+    }
+}
+
+// 4.2 - runs task from the next runOnce()
+void SDI12Executor::spawn(SDI12Task<> task)
+{
+    std::coroutine_handle<SDI12Task<>::promise_type> handle = task._handle;
+    task._handle = 0;
+    handle.promise().executor = this;
+    _spawned.push_back(handle);
+    _ready.push_back(handle);
+}
+
+// returns the entry of bus, its eventFd() added to the epoll set on first use
+SDI12Executor::Bus *SDI12Executor::attach(SDI12 &bus)
+{
+    for(uint8_t i = 0; i < _busCount; i++)
+    {
+        if(_buses[i].bus == &bus)
+        {
+            return &_buses[i];
+        }
+    }
+    if(_busCount == SDI12_EXECUTOR_BUSES || bus.eventFd() < 0)
+    {
+        std::cout << "SDI12Executor: cannot drive another bus\n";
+        return 0;
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u32 = _busCount;
+    if(epoll_ctl(_epoll, EPOLL_CTL_ADD, bus.eventFd(), &event) < 0)
+    {
+        std::cout << "SDI12Executor: cannot watch the bus : " << strerror(errno) << "\n";
+        return 0;
+    }
+    Bus &entry = _buses[_busCount++];
+    entry.bus = &bus;
+    entry.taken = false;
+    entry.first = 0;
+    entry.last = 0;
+    entry.exchange = 0;
+    entry.line = 0;
+    return &entry;
+}
+
+// 4.3 - resumes every ready task
+void SDI12Executor::drain()
+{
+    while(!_ready.empty())
+    {
+        std::coroutine_handle<> task = _ready.front();
+        _ready.pop_front();
+        _resumes++;
+        task.resume();
+    }
+}
+
+// 4.3 - one turn of the loop
+bool SDI12Executor::runOnce(std::chrono::milliseconds wait)
+{
+    drain();
+    if(_spawned.empty())
+    {
+        return false;
+    }
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point until = now + wait;
+    std::chrono::steady_clock::time_point wake = nextWake();
+    if(wake < until)
+    {
+        until = wake;
+    }
+    int timeoutMs = until > now ? (int)std::chrono::ceil<std::chrono::milliseconds>(until - now).count() : 0;
+    struct epoll_event events[SDI12_EXECUTOR_BUSES];
+    int ready = epoll_wait(_epoll, events, SDI12_EXECUTOR_BUSES, timeoutMs);
+    for(int i = 0; i < ready; i++)
+    {
+        serve(_buses[events[i].data.u32]);
+    }
+    expire(std::chrono::steady_clock::now());
+    drain();
+    return !_spawned.empty();
+}
+
+// 4.3 - the whole loop
+void SDI12Executor::run()
+{
+    while(runOnce(std::chrono::milliseconds(1000)))
+    {
+    }
+}
+
+// 4.4 - a finished command and a line sent unasked
+void SDI12Executor::serve(Bus &entry)
+{
+    SDI12Response response;
+    if(entry.bus->completed(response))
+    {
+        SDI12Waiter *waiter = entry.exchange;
+        entry.exchange = 0;
+        SDI12Transaction unclaimed;
+        copyResponse(*entry.bus, response, waiter ? waiter->result : unclaimed);
+        if(waiter)
+        {
+            _ready.push_back(waiter->task);
+        }
+    }
+    SDI12Waiter *waiter = entry.line;
+    if(waiter && checkLine(entry))
+    {
+        _ready.push_back(waiter->task);
+    }
+}
+
+// 2.3 - a line or an error for the line waiter of entry, false if none yet
+bool SDI12Executor::checkLine(Bus &entry)
+{
+    SDI12 &bus = *entry.bus;
+    if(!bus.parityErrorStatus() && !bus.overflowStatus() && !bus.LFCheck())
+    {
+        return false;
+    }
+    copyResponse(bus, bus.awaitResponse(std::chrono::steady_clock::now()), entry.line->result);
+    entry.line = 0;
+    return true;
+}
+
+// 4.5 - sleepers and line deadlines that are due
+void SDI12Executor::expire(std::chrono::steady_clock::time_point now)
+{
+    while(!_timers.empty() && _timers.front().due <= now)
+    {
+        _ready.push_back(_timers.front().task);
+        std::pop_heap(_timers.begin(), _timers.end());
+        _timers.pop_back();
+    }
+    for(uint8_t i = 0; i < _busCount; i++)
+    {
+        if(_buses[i].line && _buses[i].lineUntil <= now)
+        {
+            _ready.push_back(_buses[i].line->task);                                     //result is SDI12_TIMEOUT
+            _buses[i].line = 0;
+        }
+    }
+}
+
+int SDI12Executor::fd() const
+{
+    return _epoll;
+}
+
+std::chrono::steady_clock::time_point SDI12Executor::nextWake() const
+{
+    std::chrono::steady_clock::time_point wake = _ready.empty() ? std::chrono::steady_clock::time_point::max() : std::chrono::steady_clock::time_point::min();
+    if(!_timers.empty() && _timers.front().due < wake)
+    {
+        wake = _timers.front().due;
+    }
+    for(uint8_t i = 0; i < _busCount; i++)
+    {
+        if(_buses[i].line && _buses[i].lineUntil < wake)
+        {
+            wake = _buses[i].lineUntil;
+        }
+    }
+    return wake;
+}
+
+uint32_t SDI12Executor::tasks() const
+{
+    return _spawned.size();
+}
+
+uint64_t SDI12Executor::resumes() const
+{
+    return _resumes;
+}
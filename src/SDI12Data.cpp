@@ -0,0 +1,124 @@
+/* ============================ Data response parser ============================
+1 - parse() - the first character is the address, then every field runs from a sign up to
+the next sign or the end of the line. When appending, the address must be the one of the
+values already held, and a malformed line leaves those values as they were.
+1.1 - A field is checked before it is converted: 1 to 7 digits and at most one decimal point.
+This rejects the exponents, "inf" and "nan" that std::from_chars would otherwise accept.
+1.2 - The digits are converted with std::from_chars, which works on the line in place and
+does not allocate or depend on the locale. The sign is applied afterwards because
+std::from_chars does not accept a '+'.
+2 - sdi12ParseTiming() - the address, 3 digits of ttt and 1 (aM!) or 2 (aC!) digits of n.
+*/
+#include <SDI12Data.h>
+#include <charconv>
+
+SDI12Data::SDI12Data()
+{
+    _address = 0;
+    _count = 0;
+}
+
+void SDI12Data::clear(char address)
+{
+    _address = address;
+    _count = 0;
+}
+
+// 1 - parses "a+v-v+v..."
+bool SDI12Data::parse(std::string_view line, bool append)
+{
+    uint8_t kept = append ? _count : 0;                                         //values restored if the line is malformed
+    _count = kept;
+    if(line.empty() || (append && line[0] != _address))
+    {
+        return false;
+    }
+    _address = line[0];
+    size_t pos = 1;
+    while(pos < line.size())
+    {
+        char sign = line[pos];
+        if((sign != '+' && sign != '-') || _count == SDI12_MAX_VALUES)
+        {
+            _count = kept;
+            return false;
+        }
+        size_t start = ++pos;
+        uint8_t digits = 0;
+        uint8_t points = 0;
+        while(pos < line.size() && line[pos] != '+' && line[pos] != '-')     // 1.1 - check the field
+        {
+            if(line[pos] == '.')
+            {
+                points++;
+            }
+            else if(line[pos] >= '0' && line[pos] <= '9')
+            {
+                digits++;
+            }
+            else
+            {
+                _count = kept;
+                return false;
+            }
+            pos++;
+        }
+        if(digits == 0 || digits > SDI12_MAX_DIGITS || points > 1)
+        {
+            _count = kept;
+            return false;
+        }
+        double value = 0;                                                       // 1.2 - convert in place
+        std::from_chars_result result = std::from_chars(line.data() + start, line.data() + pos, value, std::chars_format::fixed);
+        if(result.ec != std::errc() || result.ptr != line.data() + pos)
+        {
+            _count = kept;
+            return false;
+        }
+        _values[_count++] = (sign == '-') ? -value : value;
+    }
+    return true;
+}
+
+char SDI12Data::address() const
+{
+    return _address;
+}
+
+uint8_t SDI12Data::count() const
+{
+    return _count;
+}
+
+double SDI12Data::value(uint8_t index) const
+{
+    return index < _count ? _values[index] : 0;
+}
+
+const double *SDI12Data::values() const
+{
+    return _values;
+}
+
+// 2 - parses "atttn" or "atttnn"
+bool sdi12ParseTiming(std::string_view line, uint16_t &ttt, uint8_t &values)
+{
+    if(line.size() < 5 || line.size() > 6)
+    {
+        return false;
+    }
+    for(size_t i = 1; i < line.size(); i++)
+    {
+        if(line[i] < '0' || line[i] > '9')
+        {
+            return false;
+        }
+    }
+    ttt = (line[1] - '0') * 100 + (line[2] - '0') * 10 + (line[3] - '0');
+    values = 0;
+    for(size_t i = 4; i < line.size(); i++)
+    {
+        values = values * 10 + (line[i] - '0');
+    }
+    return true;
+}
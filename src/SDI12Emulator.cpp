@@ -0,0 +1,355 @@
+/* ============================== Bus and sensor emulator =======================
+1 - Constructor and sensors.
+2 - TX data pin. write() timestamps every level change of the TX data pin.
+2.1 - A return to marking after SDI12_EMULATOR_BREAK_NS of spacing is a break: the decoder
+is reset, the partial command dropped, anything the sensors had not sent yet is cancelled
+and the sensors are awake. The 14 ms of spacing also decodes as a NUL with no stop bit
+before the break ends; that frame is dropped without counting it as an error.
+2.2 - Any other change is an edge for the decoder. complete() lets the decoder finish a
+frame whose stop bit centre has passed, it is called before every edge and by waitEdges().
+2.3 - receive() - the first character of a command checks whether the sensors are awake
+and cancels what they had not sent yet. The '!' runs the command.
+3 - execute() - the sensor at the command's address answers after responseUs.
+a! -> a, aI! -> a + id, aIM! and aM! -> atttn, aD0! -> a + data. aM! with ttt above 0 is
+followed by the service request a<CR><LF> readyMs after the response.
+3.1 - respond() - frames are encoded with the frame table and every level change becomes
+an edge. The sensor's bit period is SDI12_BIT_NS * (1 + skewPpm / 10^6); each edge is
+moved by a uniform random amount in [-jitterNs, jitterNs], at most a quarter of a bit
+so the edges stay in order. Every damageEvery-th response has the first data bit of its
+second character flipped.
+4 - RX data pin. waitEdges() sleeps until the next RX edge is due, a TX frame is to be
+completed, a TX write, a wake() or the timeout, whichever comes first. The edges whose
+time has come are handed out if edge detection is on and dropped otherwise.
+*/
+#include <SDI12Emulator.h>
+#include <SDI12FrameTable.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+// returns CLOCK_MONOTONIC in nanoseconds, the clock of the edge timestamps
+static uint64_t monotonicNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// 1 - Constructor
+SDI12Emulator::SDI12Emulator(uint8_t txDataPin, uint8_t rxDataPin)
+{
+    _txDataPin = txDataPin % SDI12_MAX_PINS;
+    _rxDataPin = rxDataPin % SDI12_MAX_PINS;
+    _txLevel = SDI12_HIGH;
+    _spacingNs = 0;
+    _markingNs = 0;                                                             //asleep until the first break
+    _ignoring = false;
+    _rxLevel = SDI12_HIGH;
+    _rxEdge = SDI12_EDGE_NONE;
+    memset(_level, SDI12_LOW, sizeof(_level));
+    _commands = 0;
+    _ignored = 0;
+    _errors = 0;
+    _woken = false;
+}
+
+void SDI12Emulator::addSensor(const SDI12SensorModel &model)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    Sensor sensor;
+    sensor.model = model;
+    sensor.random.seed(model.seed);
+    sensor.responses = 0;
+    _sensors.push_back(sensor);
+}
+
+uint32_t SDI12Emulator::commands() const
+{
+    return _commands;
+}
+
+uint32_t SDI12Emulator::ignored() const
+{
+    return _ignored;
+}
+
+uint32_t SDI12Emulator::errors() const
+{
+    return _errors;
+}
+
+// 2 - the SDI12 object drives a pin
+void SDI12Emulator::write(uint8_t pin, uint8_t level)
+{
+    pin %= SDI12_MAX_PINS;
+    level = level ? SDI12_HIGH : SDI12_LOW;
+    std::lock_guard<std::mutex> guard(_lock);
+    uint64_t now = monotonicNs();                                               //under the lock, waitEdges() never completes a frame past this edge
+    if(pin != _txDataPin)
+    {
+        _level[pin] = level;
+        return;
+    }
+    if(level == _txLevel)
+    {
+        return;
+    }
+    complete(now);
+    SDI12Frame frame;
+    if(level == SDI12_HIGH && now - _spacingNs >= SDI12_EMULATOR_BREAK_NS)     // 2.1 - break
+    {
+        _decoder.reset(SDI12_HIGH);
+        _command = SDI12Command();
+        _ignoring = false;
+        while(!_rx.empty() && _rx.back().ns > now)
+        {
+            _rx.pop_back();
+        }
+        _markingNs = now;
+    }
+    else                                                                        // 2.2 - an edge of a frame
+    {
+        SDI12Edge edge;
+        edge.ns = now;
+        edge.level = level;
+        if(_decoder.feed(edge, frame))
+        {
+            receive(frame);
+        }
+    }
+    if(level == SDI12_LOW)
+    {
+        _spacingNs = now;
+    }
+    _txLevel = level;
+    _changed.notify_all();
+}
+
+// 2.2 - completes a frame whose stop bit centre is before ns, _lock held
+void SDI12Emulator::complete(uint64_t ns)
+{
+    SDI12Frame frame;
+    uint64_t deadline = _decoder.deadline();
+    if(deadline && deadline <= ns && _decoder.advance(ns, frame))
+    {
+        receive(frame);
+    }
+}
+
+// 2.3 - one character from the SDI12 object, _lock held
+void SDI12Emulator::receive(const SDI12Frame &frame)
+{
+    if(frame.status != SDI12_FRAME_OK)
+    {
+        if(_txLevel == SDI12_HIGH)                                              //not the start of a break
+        {
+            _errors++;
+        }
+        _command = SDI12Command();
+        return;
+    }
+    if(_command.view().empty())                                                 //first character of a command
+    {
+        _ignoring = _markingNs == 0 || frame.ns > _markingNs + SDI12_EMULATOR_SLEEP_NS;
+        while(!_rx.empty() && _rx.back().ns > frame.ns)                         //sensors stop talking
+        {
+            _rx.pop_back();
+        }
+    }
+    _command.append((char)frame.data);
+    uint64_t end = frame.ns + SDI12_FRAME_BITS * (uint64_t)SDI12_BIT_NS;
+    _markingNs = _markingNs ? end : 0;
+    if(frame.data == '!' || _command.overflow())
+    {
+        if(_ignoring || _command.overflow())
+        {
+            _ignored++;
+        }
+        else
+        {
+            execute(end);
+        }
+        _command = SDI12Command();
+    }
+}
+
+// 3 - the addressed sensor answers, _lock held
+void SDI12Emulator::execute(uint64_t ns)
+{
+    std::string_view text = _command.view();
+    std::string_view body = text.substr(1, text.size() - 2);                    //without the address and the '!'
+    Sensor *sensor = 0;
+    for(size_t i = 0; i < _sensors.size() && !sensor; i++)
+    {
+        sensor = _sensors[i].model.address == text[0] ? &_sensors[i] : 0;
+    }
+    if(!sensor)
+    {
+        _ignored++;
+        return;
+    }
+    const SDI12SensorModel &model = sensor->model;
+    uint64_t start = ns + (uint64_t)model.responseUs * 1000;
+    char timing[8];
+    uint8_t values = 0;
+    for(size_t i = 0; i < model.data.size(); i++)
+    {
+        values += (model.data[i] == '+' || model.data[i] == '-');
+    }
+    snprintf(timing, sizeof(timing), "%03u%u", model.ttt % 1000, values % 10);
+    uint64_t end;
+    if(body.empty())
+    {
+        end = respond(*sensor, "", start);
+    }
+    else if(body == "I")
+    {
+        end = respond(*sensor, model.id, start);
+    }
+    else if(body == "IM")
+    {
+        end = respond(*sensor, timing, start);
+    }
+    else if(body == "M")
+    {
+        end = respond(*sensor, timing, start);
+        if(model.ttt > 0)                                                       //service request when the measurement is done
+        {
+            end = respond(*sensor, "", end + (uint64_t)model.readyMs * 1000000);
+        }
+    }
+    else if(body == "D0")
+    {
+        end = respond(*sensor, model.data, start);
+    }
+    else
+    {
+        _ignored++;
+        return;
+    }
+    _commands++;
+    _markingNs = end;
+}
+
+// 3.1 - schedules the edges of address + text + <CR><LF>, _lock held
+uint64_t SDI12Emulator::respond(Sensor &sensor, std::string_view text, uint64_t ns)
+{
+    const SDI12SensorModel &model = sensor.model;
+    double bitNs = SDI12_BIT_NS * (1.0 + model.skewPpm / 1e6);
+    int32_t jitter = model.jitterNs < SDI12_BIT_NS / 4 ? model.jitterNs : SDI12_BIT_NS / 4;
+    std::uniform_int_distribution<int32_t> error(-jitter, jitter);
+    uint8_t level = SDI12_HIGH;
+    uint32_t bits = 0;
+    sensor.responses++;
+    bool damaged = model.damageEvery && sensor.responses % model.damageEvery == 0;
+    for(size_t i = 0; i < text.size() + 3; i++)
+    {
+        char c = i == 0 ? model.address : i <= text.size() ? text[i - 1] : i == text.size() + 1 ? '\r' : '\n';
+        uint16_t frame = sdi12Encode(c) ^ (damaged && i == 1 ? 0x02 : 0);      //first data bit flipped, parity no longer even
+        for(uint8_t bit = 0; bit < SDI12_FRAME_BITS; bit++, bits++)
+        {
+            uint8_t next = (frame >> bit) & 1;
+            if(next == level)
+            {
+                continue;
+            }
+            SDI12Edge edge;
+            edge.ns = ns + (uint64_t)(bits * bitNs) + (jitter ? error(sensor.random) : 0);
+            edge.level = next;
+            _rx.push_back(edge);
+            level = next;
+        }
+    }
+    return ns + (uint64_t)(bits * bitNs);
+}
+
+// 4 - reads the level of a pin now
+uint8_t SDI12Emulator::read(uint8_t pin)
+{
+    pin %= SDI12_MAX_PINS;
+    std::lock_guard<std::mutex> guard(_lock);
+    if(pin != _rxDataPin)
+    {
+        return pin == _txDataPin ? _txLevel : _level[pin];
+    }
+    uint64_t now = monotonicNs();
+    uint8_t level = _rxLevel;
+    for(size_t i = 0; i < _rx.size() && _rx[i].ns <= now; i++)
+    {
+        level = _rx[i].level;
+    }
+    return level;
+}
+
+void SDI12Emulator::pull(uint8_t pin, uint8_t pud)
+{
+    (void)pin;
+    (void)pud;                                                                  //the line is driven, pulls change nothing
+}
+
+bool SDI12Emulator::setEdge(uint8_t pin, uint8_t edge)
+{
+    if(pin % SDI12_MAX_PINS != _rxDataPin)
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(_lock);
+    _rxEdge = edge;
+    _changed.notify_all();
+    return true;
+}
+
+// 4 - hands out the RX edges whose time has come
+int SDI12Emulator::waitEdges(uint8_t pin, SDI12Edge *edges, int max, int64_t timeoutUs)
+{
+    if(pin % SDI12_MAX_PINS != _rxDataPin || max <= 0)
+    {
+        return -1;
+    }
+    uint64_t now = monotonicNs();
+    uint64_t until = timeoutUs < 0 ? UINT64_MAX : now + (uint64_t)timeoutUs * 1000;
+    std::unique_lock<std::mutex> guard(_lock);
+    while(true)
+    {
+        complete(now);
+        int count = 0;
+        while(count < max && !_rx.empty() && _rx.front().ns <= now)
+        {
+            SDI12Edge edge = _rx.front();
+            _rx.pop_front();
+            _rxLevel = edge.level;
+            uint8_t wanted = (edge.level == SDI12_HIGH) ? SDI12_EDGE_RISING : SDI12_EDGE_FALLING;
+            if(_rxEdge & wanted)
+            {
+                edges[count++] = edge;
+            }
+        }
+        if(count > 0 || now >= until || _woken)
+        {
+            _woken = false;
+            return count;
+        }
+        uint64_t wake = until;
+        if(!_rx.empty() && _rx.front().ns < wake)
+        {
+            wake = _rx.front().ns;
+        }
+        if(_decoder.deadline() && _decoder.deadline() < wake)
+        {
+            wake = _decoder.deadline();
+        }
+        uint64_t sleep = wake > now ? wake - now : 0;
+        _changed.wait_for(guard, std::chrono::nanoseconds(sleep < 1000000000ULL ? sleep : 1000000000ULL));
+        now = monotonicNs();
+    }
+}
+
+// 4 - ends a waitEdges() sleeping in another thread
+void SDI12Emulator::wake()
+{
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _woken = true;
+    }
+    _changed.notify_all();
+}
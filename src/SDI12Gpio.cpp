@@ -0,0 +1,186 @@
+/* ========================= Raspberry Pi GPIO backend =========================
+Levels and pull resistors are set with wiringPi. Edge detection on the RX data pin used
+to be switched with system("gpio edge ..."), which forked a shell on every begin(), end()
+and parity error. Here the RX line is requested from the GPIO character device once and
+kept open; switching between no edge detection and edge detection is one ioctl on the line
+file descriptor.
+1 - Constructor and destructor.
+2 - Level and pull resistor access (wiringPi).
+3 - Edge detection (GPIO character device, uAPI v2).
+4 - Waiting for edges. The kernel timestamps every edge when it happens, so the time a
+reader takes to wake up does not change the timing of the bits it decodes. ppoll() also
+watches an eventfd, wake() writes it and the waiter reads it back to zero.
+*/
+#include <SDI12Gpio.h>
+#include <wiringPi.h>
+#include <linux/gpio.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <iostream>
+
+// 1 - Constructor opens the chip device once, no line is requested until it is needed.
+SDI12ChipGpio::SDI12ChipGpio(const char *chip)
+{
+    _chipFd = open(chip, O_RDWR | O_CLOEXEC);
+    if(_chipFd < 0)
+    {
+        std::cout << "SDI12ChipGpio: cannot open " << chip << " : " << strerror(errno) << "\n";
+    }
+    for(int i = 0; i < SDI12_MAX_PINS; i++)
+    {
+        _lineFd[i] = -1;
+    }
+    _wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+// 1 - Destructor releases the requested lines, the kernel drops edge detection with them.
+SDI12ChipGpio::~SDI12ChipGpio()
+{
+    for(int i = 0; i < SDI12_MAX_PINS; i++)
+    {
+        if(_lineFd[i] >= 0)
+        {
+            close(_lineFd[i]);
+        }
+    }
+    if(_chipFd >= 0)
+    {
+        close(_chipFd);
+    }
+    if(_wakeFd >= 0)
+    {
+        close(_wakeFd);
+    }
+}
+
+// 2 - Level and pull resistor access.
+void SDI12ChipGpio::write(uint8_t pin, uint8_t level)
+{
+    digitalWrite(pin, level);
+}
+
+uint8_t SDI12ChipGpio::read(uint8_t pin)
+{
+    return digitalRead(pin);
+}
+
+void SDI12ChipGpio::pull(uint8_t pin, uint8_t pud)
+{
+    pullUpDnControl(pin, pud);
+}
+
+// 3 - Requests a single line as an input with the given flags and keeps its file descriptor.
+bool SDI12ChipGpio::requestLine(uint8_t pin, uint64_t flags)
+{
+    struct gpio_v2_line_request req;
+    memset(&req, 0, sizeof(req));
+    req.offsets[0] = pin;
+    req.num_lines = 1;
+    req.config.flags = flags;
+    req.event_buffer_size = 256;                                    //a whole SDI-12 response fits in the kernel queue
+    strncpy(req.consumer, "sdi12", sizeof(req.consumer) - 1);
+    if(ioctl(_chipFd, GPIO_V2_GET_LINE_IOCTL, &req) < 0)
+    {
+        std::cout << "SDI12ChipGpio: cannot request line " << unsigned(pin) << " : " << strerror(errno) << "\n";
+        return false;
+    }
+    _lineFd[pin] = req.fd;
+    return true;
+}
+
+// 3 - Sets the edge detection of a pin. The first call requests the line, every later call reconfigures it in place.
+bool SDI12ChipGpio::setEdge(uint8_t pin, uint8_t edge)
+{
+    if(pin >= SDI12_MAX_PINS || _chipFd < 0)
+    {
+        return false;
+    }
+    uint64_t flags = GPIO_V2_LINE_FLAG_INPUT;
+    if(edge & SDI12_EDGE_FALLING)
+    {
+        flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING;
+    }
+    if(edge & SDI12_EDGE_RISING)
+    {
+        flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+    }
+    if(_lineFd[pin] < 0)
+    {
+        return requestLine(pin, flags);
+    }
+    struct gpio_v2_line_config config;
+    memset(&config, 0, sizeof(config));
+    config.flags = flags;
+    if(ioctl(_lineFd[pin], GPIO_V2_LINE_SET_CONFIG_IOCTL, &config) < 0)
+    {
+        std::cout << "SDI12ChipGpio: cannot set edge on line " << unsigned(pin) << " : " << strerror(errno) << "\n";
+        return false;
+    }
+    return true;
+}
+
+// 4 - Sleeps until the line has edges or timeoutUs has passed (timeoutUs < 0 waits forever). Returns the number of edges stored, -1 on error.
+int SDI12ChipGpio::waitEdges(uint8_t pin, SDI12Edge *edges, int max, int64_t timeoutUs)
+{
+    if(pin >= SDI12_MAX_PINS || _lineFd[pin] < 0 || max <= 0)
+    {
+        return -1;
+    }
+    struct pollfd pfd[2];
+    pfd[0].fd = _lineFd[pin];
+    pfd[0].events = POLLIN;
+    pfd[1].fd = _wakeFd;                                            //-1 without an eventfd, ppoll() skips it
+    pfd[1].events = POLLIN;
+    pfd[1].revents = 0;
+    struct timespec timeout;
+    timeout.tv_sec = timeoutUs / 1000000;
+    timeout.tv_nsec = (timeoutUs % 1000000) * 1000;
+    int ready = ppoll(pfd, 2, timeoutUs < 0 ? 0 : &timeout, 0);
+    if(ready <= 0)
+    {
+        return (ready < 0 && errno != EINTR) ? -1 : 0;
+    }
+    if(pfd[1].revents & POLLIN)                                     //wake(), clear it
+    {
+        uint64_t count;
+        ssize_t done = ::read(_wakeFd, &count, sizeof(count));
+        (void)done;
+    }
+    if(!pfd[0].revents)                                             //only woken, no edges
+    {
+        return 0;
+    }
+    struct gpio_v2_line_event events[64];
+    if(max > 64)
+    {
+        max = 64;
+    }
+    ssize_t got = ::read(_lineFd[pin], events, sizeof(events[0]) * max);
+    if(got < 0)
+    {
+        return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+    }
+    int count = got / sizeof(events[0]);
+    for(int i = 0; i < count; i++)
+    {
+        edges[i].ns = events[i].timestamp_ns;
+        edges[i].level = (events[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE) ? SDI12_HIGH : SDI12_LOW;
+    }
+    return count;
+}
+
+// 4 - ends the ppoll() of waitEdges() in another thread
+void SDI12ChipGpio::wake()
+{
+    uint64_t one = 1;
+    if(_wakeFd >= 0)
+    {
+        ssize_t done = ::write(_wakeFd, &one, sizeof(one));         //fails only with a wake up already pending
+        (void)done;
+    }
+}
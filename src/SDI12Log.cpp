@@ -0,0 +1,407 @@
+/* ================================ Measurement log =============================
+1 - Constructor and destructor. The directory is created if it does not exist and
+index.sdx opened or created with its 16 byte header: "SDIX", SDI12_LOG_VERSION,
+sizeof(SDI12LogIndex) and 8 reserved bytes. recover() looks at the last index entry; if its
+segment was never closed it is closed now from the count its header holds, and the next
+segment gets the following number. No segment is created until the first append().
+2 - Segments.
+2.1 - open() - the file is created, extended to segmentBytes with ftruncate(), mapped and
+given its header, then its index entry is appended.
+2.2 - close() - commits, marks the header and the index entry closed, unmaps and truncates
+the file to the header and its records.
+3 - append() - the wall clock time of the measurement is its steady clock start time moved
+by the difference between the two clocks now. Each value goes into the next record of the
+mapping, opening a new segment when the open one is full or older than segmentTime.
+4 - commit() - msync(MS_SYNC) of the pages holding the records appended since the last
+commit, then the header is updated and its page synced, then the index entry is rewritten.
+5 - SDI12LogReader::query() - the index is mapped and every segment whose first to last
+record time overlaps the range is mapped read-only and its committed records scanned.
+*/
+#include <SDI12Log.h>
+#include <iostream>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SDI12_LOG_INDEX_HEADER   16                     //magic, version, entry size, reserved
+#define SDI12_LOG_PAGE           4096                   //msync granularity
+
+static_assert(sizeof(SDI12LogRecord) == 24, "SDI12LogRecord is stored as is");
+static_assert(sizeof(SDI12LogHeader) == 64, "SDI12LogHeader is stored as is");
+static_assert(sizeof(SDI12LogIndex) == 32, "SDI12LogIndex is stored as is");
+
+static const char SDI12_LOG_MAGIC[4] = { 'S', 'D', 'I', 'L' };
+static const char SDI12_INDEX_MAGIC[4] = { 'S', 'D', 'I', 'X' };
+
+// returns the path of segment sequence in directory
+static std::string segmentPath(const std::string &directory, uint32_t sequence)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "/%08u.sdl", sequence);
+    return directory + name;
+}
+
+// returns CLOCK_REALTIME in nanoseconds
+static int64_t wallNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// 1 - Constructor opens or creates the directory and its index
+SDI12Log::SDI12Log(const char *directory, uint64_t segmentBytes, std::chrono::seconds segmentTime, uint32_t flushRecords) : _directory(directory)
+{
+    _segmentBytes = segmentBytes < sizeof(SDI12LogHeader) + SDI12_LOG_PAGE ? sizeof(SDI12LogHeader) + SDI12_LOG_PAGE : segmentBytes;
+    _segmentNs = std::chrono::duration_cast<std::chrono::nanoseconds>(segmentTime).count();
+    _flushRecords = flushRecords == 0 ? 1 : flushRecords;
+    _segmentFd = -1;
+    _map = 0;
+    _header = 0;
+    _records = 0;
+    _capacity = (_segmentBytes - sizeof(SDI12LogHeader)) / sizeof(SDI12LogRecord);
+    _count = 0;
+    _sequence = 0;
+    _indexEntry = 0;
+    _openedNs = 0;
+    _firstNs = 0;
+    _lastNs = 0;
+    _committed = std::chrono::steady_clock::now();
+    if(mkdir(directory, 0755) != 0 && errno != EEXIST)
+    {
+        std::cout << "SDI12Log: cannot create " << directory << " : " << strerror(errno) << "\n";
+        _indexFd = -1;
+        return;
+    }
+    std::string index = _directory + "/index.sdx";
+    _indexFd = ::open(index.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(_indexFd < 0)
+    {
+        std::cout << "SDI12Log: cannot open " << index << " : " << strerror(errno) << "\n";
+        return;
+    }
+    uint8_t header[SDI12_LOG_INDEX_HEADER];
+    ssize_t got = pread(_indexFd, header, sizeof(header), 0);
+    if(got == 0)                                                    //new index
+    {
+        memset(header, 0, sizeof(header));
+        memcpy(header, SDI12_INDEX_MAGIC, 4);
+        uint16_t version = SDI12_LOG_VERSION;
+        uint16_t size = sizeof(SDI12LogIndex);
+        memcpy(header + 4, &version, 2);
+        memcpy(header + 6, &size, 2);
+        got = pwrite(_indexFd, header, sizeof(header), 0);
+    }
+    uint16_t version = 0;
+    uint16_t size = 0;
+    memcpy(&version, header + 4, 2);
+    memcpy(&size, header + 6, 2);
+    if(got != sizeof(header) || memcmp(header, SDI12_INDEX_MAGIC, 4) != 0 || version != SDI12_LOG_VERSION || size != sizeof(SDI12LogIndex))
+    {
+        std::cout << "SDI12Log: " << index << " is not an index of this version\n";
+        ::close(_indexFd);
+        _indexFd = -1;
+        return;
+    }
+    recover();
+}
+
+// 1 - Destructor
+SDI12Log::~SDI12Log()
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    close();
+    if(_indexFd >= 0)
+    {
+        ::close(_indexFd);
+    }
+}
+
+bool SDI12Log::ready() const
+{
+    return _indexFd >= 0;
+}
+
+uint32_t SDI12Log::segment() const
+{
+    return _sequence;
+}
+
+// 1 - closes the last segment if a crash left it open, continues the numbering after it
+void SDI12Log::recover()
+{
+    struct stat info;
+    if(fstat(_indexFd, &info) != 0 || info.st_size < (off_t)(SDI12_LOG_INDEX_HEADER + sizeof(SDI12LogIndex)))
+    {
+        return;
+    }
+    SDI12LogIndex entry;
+    _indexEntry = (info.st_size - SDI12_LOG_INDEX_HEADER) / sizeof(SDI12LogIndex) - 1;
+    if(pread(_indexFd, &entry, sizeof(entry), SDI12_LOG_INDEX_HEADER + _indexEntry * sizeof(SDI12LogIndex)) != sizeof(entry))
+    {
+        return;
+    }
+    _sequence = entry.sequence;
+    if(entry.closed)
+    {
+        return;
+    }
+    std::string path = segmentPath(_directory, entry.sequence);
+    int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    SDI12LogHeader header;
+    if(fd >= 0 && pread(fd, &header, sizeof(header), 0) == sizeof(header) && memcmp(header.magic, SDI12_LOG_MAGIC, 4) == 0)
+    {
+        header.closed = 1;
+        entry.count = header.count;
+        entry.firstNs = header.firstNs;
+        entry.lastNs = header.lastNs;
+        if(pwrite(fd, &header, sizeof(header), 0) == sizeof(header))
+        {
+            int truncated = ftruncate(fd, sizeof(header) + header.count * sizeof(SDI12LogRecord));
+            (void)truncated;
+            fsync(fd);
+        }
+    }
+    else
+    {
+        entry.count = 0;                                            //lost before its header was written
+    }
+    if(fd >= 0)
+    {
+        ::close(fd);
+    }
+    entry.closed = 1;
+    ssize_t written = pwrite(_indexFd, &entry, sizeof(entry), SDI12_LOG_INDEX_HEADER + _indexEntry * sizeof(SDI12LogIndex));
+    (void)written;
+    fsync(_indexFd);
+}
+
+// 2.1 - creates and maps the next segment
+bool SDI12Log::open(int64_t now)
+{
+    std::string path = segmentPath(_directory, _sequence + 1);
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0)
+    {
+        std::cout << "SDI12Log: cannot create " << path << " : " << strerror(errno) << "\n";
+        return false;
+    }
+    void *map = MAP_FAILED;
+    if(ftruncate(fd, _segmentBytes) == 0)
+    {
+        map = mmap(0, _segmentBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if(map == MAP_FAILED)
+    {
+        std::cout << "SDI12Log: cannot map " << path << " : " << strerror(errno) << "\n";
+        ::close(fd);
+        unlink(path.c_str());
+        return false;
+    }
+    _sequence++;
+    _segmentFd = fd;
+    _map = (uint8_t *)map;
+    _header = (SDI12LogHeader *)_map;
+    _records = (SDI12LogRecord *)(_map + sizeof(SDI12LogHeader));
+    memset(_header, 0, sizeof(SDI12LogHeader));
+    memcpy(_header->magic, SDI12_LOG_MAGIC, 4);
+    _header->version = SDI12_LOG_VERSION;
+    _header->recordSize = sizeof(SDI12LogRecord);
+    _header->sequence = _sequence;
+    msync(_map, SDI12_LOG_PAGE, MS_SYNC);
+    _count = 0;
+    _openedNs = now;
+    _firstNs = INT64_MAX;
+    _lastNs = INT64_MIN;
+    struct stat info;
+    _indexEntry = fstat(_indexFd, &info) == 0 ? (info.st_size - SDI12_LOG_INDEX_HEADER) / sizeof(SDI12LogIndex) : 0;
+    writeIndex();
+    return true;
+}
+
+// 2.2 - commits, marks the segment closed and cuts it to its records
+void SDI12Log::close()
+{
+    if(_segmentFd < 0)
+    {
+        return;
+    }
+    commitLocked();
+    _header->closed = 1;
+    msync(_map, SDI12_LOG_PAGE, MS_SYNC);
+    writeIndex();
+    munmap(_map, _segmentBytes);
+    int truncated = ftruncate(_segmentFd, sizeof(SDI12LogHeader) + _count * sizeof(SDI12LogRecord));
+    (void)truncated;
+    ::close(_segmentFd);
+    _segmentFd = -1;
+    _map = 0;
+    _header = 0;
+    _records = 0;
+}
+
+// 2 - the index entry of the open segment, from its header
+void SDI12Log::writeIndex()
+{
+    SDI12LogIndex entry;
+    entry.sequence = _header->sequence;
+    entry.closed = _header->closed;
+    entry.count = _header->count;
+    entry.firstNs = _header->firstNs;
+    entry.lastNs = _header->lastNs;
+    ssize_t written = pwrite(_indexFd, &entry, sizeof(entry), SDI12_LOG_INDEX_HEADER + _indexEntry * sizeof(SDI12LogIndex));
+    (void)written;
+}
+
+// 3 - one record per value of the reading, one with SDI12_LOG_NO_VALUE if it has none
+bool SDI12Log::append(uint8_t bus, const SDI12Reading &reading)
+{
+    int64_t now = wallNs();
+    int64_t ns = now - std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - reading.time).count();
+    uint8_t values = reading.data.count();
+    std::lock_guard<std::mutex> guard(_lock);
+    if(_indexFd < 0)
+    {
+        return false;
+    }
+    for(uint8_t i = 0; i < values || (i == 0 && values == 0); i++)
+    {
+        if(_segmentFd >= 0 && (_count == _capacity || now - _openedNs >= _segmentNs))
+        {
+            close();
+        }
+        if(_segmentFd < 0 && !open(now))
+        {
+            return false;
+        }
+        SDI12LogRecord &record = _records[_count++];
+        record.ns = ns;
+        record.value = values ? reading.data.value(i) : NAN;
+        record.bus = bus;
+        record.address = reading.address;
+        record.index = i;
+        record.status = reading.status;
+        record.flags = values ? 0 : SDI12_LOG_NO_VALUE;
+        memset(record.reserved, 0, sizeof(record.reserved));
+        _firstNs = ns < _firstNs ? ns : _firstNs;
+        _lastNs = ns > _lastNs ? ns : _lastNs;
+    }
+    if(_count - _header->count >= _flushRecords || std::chrono::steady_clock::now() - _committed >= std::chrono::milliseconds(SDI12_LOG_FLUSH_MS))
+    {
+        commitLocked();
+    }
+    return true;
+}
+
+void SDI12Log::commit()
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    commitLocked();
+}
+
+// 4 - records first, then the header that counts them, then the index
+void SDI12Log::commitLocked()
+{
+    _committed = std::chrono::steady_clock::now();
+    if(_segmentFd < 0 || _count == _header->count)
+    {
+        return;
+    }
+    size_t from = (sizeof(SDI12LogHeader) + _header->count * sizeof(SDI12LogRecord)) / SDI12_LOG_PAGE * SDI12_LOG_PAGE;
+    size_t to = sizeof(SDI12LogHeader) + _count * sizeof(SDI12LogRecord);
+    msync(_map + from, to - from, MS_SYNC);
+    _header->count = _count;
+    _header->firstNs = _firstNs;
+    _header->lastNs = _lastNs;
+    msync(_map, SDI12_LOG_PAGE, MS_SYNC);
+    writeIndex();
+}
+
+// 5 - Constructor
+SDI12LogReader::SDI12LogReader(const char *directory) : _directory(directory)
+{
+}
+
+uint32_t SDI12LogReader::segments() const
+{
+    struct stat info;
+    std::string index = _directory + "/index.sdx";
+    if(stat(index.c_str(), &info) != 0 || info.st_size < SDI12_LOG_INDEX_HEADER)
+    {
+        return 0;
+    }
+    return (info.st_size - SDI12_LOG_INDEX_HEADER) / sizeof(SDI12LogIndex);
+}
+
+// 5 - maps the segments that overlap fromNs..toNs and visits their records in that range
+uint64_t SDI12LogReader::query(int64_t fromNs, int64_t toNs, SDI12LogVisitor visitor, void *user) const
+{
+    std::string index = _directory + "/index.sdx";
+    int fd = ::open(index.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    if(fd < 0 || fstat(fd, &info) != 0 || info.st_size < (off_t)(SDI12_LOG_INDEX_HEADER + sizeof(SDI12LogIndex)))
+    {
+        if(fd >= 0)
+        {
+            ::close(fd);
+        }
+        return 0;
+    }
+    size_t indexBytes = info.st_size;
+    void *indexMap = mmap(0, indexBytes, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(indexMap == MAP_FAILED)
+    {
+        return 0;
+    }
+    const SDI12LogIndex *entries = (const SDI12LogIndex *)((const uint8_t *)indexMap + SDI12_LOG_INDEX_HEADER);
+    size_t count = (indexBytes - SDI12_LOG_INDEX_HEADER) / sizeof(SDI12LogIndex);
+    uint64_t visited = 0;
+    bool going = true;
+    for(size_t e = 0; going && e < count; e++)
+    {
+        if(entries[e].count == 0 || entries[e].firstNs > toNs || entries[e].lastNs < fromNs)
+        {
+            continue;
+        }
+        std::string path = segmentPath(_directory, entries[e].sequence);
+        int segment = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(segment < 0 || fstat(segment, &info) != 0 || info.st_size < (off_t)sizeof(SDI12LogHeader))
+        {
+            if(segment >= 0)
+            {
+                ::close(segment);
+            }
+            continue;
+        }
+        size_t bytes = info.st_size;
+        void *map = mmap(0, bytes, PROT_READ, MAP_SHARED, segment, 0);
+        ::close(segment);
+        if(map == MAP_FAILED)
+        {
+            continue;
+        }
+        const SDI12LogHeader *header = (const SDI12LogHeader *)map;
+        const SDI12LogRecord *records = (const SDI12LogRecord *)((const uint8_t *)map + sizeof(SDI12LogHeader));
+        uint64_t stored = (bytes - sizeof(SDI12LogHeader)) / sizeof(SDI12LogRecord);
+        uint64_t committed = header->count < stored ? header->count : stored;
+        if(memcmp(header->magic, SDI12_LOG_MAGIC, 4) != 0 || header->recordSize != sizeof(SDI12LogRecord))
+        {
+            committed = 0;
+        }
+        for(uint64_t r = 0; going && r < committed; r++)
+        {
+            if(records[r].ns >= fromNs && records[r].ns <= toNs)
+            {
+                visited++;
+                going = visitor(records[r], user);
+            }
+        }
+        munmap(map, bytes);
+    }
+    munmap(indexMap, indexBytes);
+    return visited;
+}
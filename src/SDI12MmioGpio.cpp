@@ -0,0 +1,211 @@
+/* ========================= Raspberry Pi register backend ======================
+The GPIO block of the BCM2835/BCM2711, addressed in 32 bit words from its base:
+    GPFSEL0-5  0-5    3 bits per pin, 000 input, 001 output
+    GPSET0-1   7-8    a 1 drives the pin HIGH, 0 bits do nothing
+    GPCLR0-1   10-11  a 1 drives the pin LOW, 0 bits do nothing
+    GPLEV0-1   13-14  level of every pin
+    GPPUD      37     BCM2835 pull control, then clocked into the pins by GPPUDCLK0-1 (38-39)
+    GPIO_PUP_PDN_CNTRL0-3  57-60  BCM2711, 2 bits per pin, 00 none, 01 up, 10 down
+1 - Constructors and destructor. The block is mapped MAP_SHARED so stores reach the device
+(or the file). The chip is a BCM2711 unless GPIO_PUP_PDN_CNTRL3 reads "gpio", what the
+BCM2835 returns for registers it does not have.
+2 - Levels. GPSET and GPCLR only act on the 1 bits, so writes never read-modify-write and
+never disturb pins driven by another thread.
+3 - Pin functions and pull resistors, under _lock.
+4 - Edge detection, passed to the edges backend.
+*/
+#include <SDI12Gpio.h>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define GPFSEL0                  0                      //register indices, see above
+#define GPSET0                   7
+#define GPCLR0                   10
+#define GPLEV0                   13
+#define GPPUD                    37
+#define GPPUDCLK0                38
+#define GPPUPPDN0                57
+#define GPPUPPDN3                60
+#define GPIO_FUNCTION_INPUT      0
+#define GPIO_FUNCTION_OUTPUT     1
+
+// 1 - Constructor maps the register block of path at offset
+SDI12MmioGpio::SDI12MmioGpio(const char *path, long offset, SDI12Gpio *edges)
+{
+    _reg = 0;
+    _map = 0;
+    _edges = edges;
+    _outputs = 0;
+    _bcm2711 = true;
+    int fd = open(path, O_RDWR | O_SYNC | O_CLOEXEC);
+    if(fd < 0)
+    {
+        std::cout << "SDI12MmioGpio: cannot open " << path << " : " << strerror(errno) << "\n";
+        return;
+    }
+    void *map = mmap(0, SDI12_MMIO_LENGTH, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+    close(fd);                                                      //the mapping stays valid
+    if(map == MAP_FAILED)
+    {
+        std::cout << "SDI12MmioGpio: cannot map " << path << " : " << strerror(errno) << "\n";
+        return;
+    }
+    _map = map;
+    _reg = (volatile uint32_t *)map;
+    _bcm2711 = _reg[GPPUPPDN3] != 0x6770696f;                       //"gpio" on a BCM2835
+}
+
+// 1 - Constructor with a block the caller owns
+SDI12MmioGpio::SDI12MmioGpio(volatile uint32_t *registers, SDI12Gpio *edges)
+{
+    _reg = registers;
+    _map = 0;
+    _edges = edges;
+    _outputs = 0;
+    _bcm2711 = _reg == 0 || _reg[GPPUPPDN3] != 0x6770696f;
+}
+
+// 1 - Destructor
+SDI12MmioGpio::~SDI12MmioGpio()
+{
+    if(_map)
+    {
+        munmap(_map, SDI12_MMIO_LENGTH);
+    }
+}
+
+bool SDI12MmioGpio::mapped() const
+{
+    return _reg != 0;
+}
+
+// 2 - one store to GPSET or GPCLR, the pin is made an output first if it is not one yet
+void SDI12MmioGpio::write(uint8_t pin, uint8_t level)
+{
+    if(!_reg || pin >= SDI12_MMIO_PINS)
+    {
+        return;
+    }
+    if(!((_outputs.load(std::memory_order_relaxed) >> pin) & 1))
+    {
+        function(pin, GPIO_FUNCTION_OUTPUT);
+    }
+    _reg[(level ? GPSET0 : GPCLR0) + pin / 32] = 1u << (pin % 32);
+}
+
+// 2 - every pin of high in one store per bank to GPSET, then every pin of low to GPCLR
+void SDI12MmioGpio::writeMask(uint64_t high, uint64_t low)
+{
+    uint64_t valid = (1ULL << SDI12_MMIO_PINS) - 1;
+    high &= valid;
+    low &= valid;
+    if(!_reg)
+    {
+        return;
+    }
+    uint64_t inputs = (high | low) & ~_outputs.load(std::memory_order_relaxed);
+    for(uint8_t pin = 0; inputs; pin++, inputs >>= 1)
+    {
+        if(inputs & 1)
+        {
+            function(pin, GPIO_FUNCTION_OUTPUT);
+        }
+    }
+    for(int bank = 0; bank < 2; bank++)
+    {
+        if((uint32_t)(high >> (32 * bank)))
+        {
+            _reg[GPSET0 + bank] = (uint32_t)(high >> (32 * bank));
+        }
+    }
+    for(int bank = 0; bank < 2; bank++)
+    {
+        if((uint32_t)(low >> (32 * bank)))
+        {
+            _reg[GPCLR0 + bank] = (uint32_t)(low >> (32 * bank));
+        }
+    }
+}
+
+// 2 - one load of GPLEV
+uint8_t SDI12MmioGpio::read(uint8_t pin)
+{
+    if(!_reg || pin >= SDI12_MMIO_PINS)
+    {
+        return SDI12_LOW;
+    }
+    return (_reg[GPLEV0 + pin / 32] >> (pin % 32)) & 1;
+}
+
+// 3 - sets the 3 bit function of a pin in GPFSEL
+void SDI12MmioGpio::function(uint8_t pin, uint32_t select)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    uint32_t shift = (pin % 10) * 3;
+    _reg[GPFSEL0 + pin / 10] = (_reg[GPFSEL0 + pin / 10] & ~(7u << shift)) | (select << shift);
+    if(select == GPIO_FUNCTION_OUTPUT)
+    {
+        _outputs |= 1ULL << pin;
+    }
+    else
+    {
+        _outputs &= ~(1ULL << pin);
+    }
+}
+
+// 3 - makes the pin an input and sets its pull resistor
+void SDI12MmioGpio::pull(uint8_t pin, uint8_t pud)
+{
+    if(!_reg || pin >= SDI12_MMIO_PINS)
+    {
+        return;
+    }
+    function(pin, GPIO_FUNCTION_INPUT);
+    std::lock_guard<std::mutex> guard(_lock);
+    if(_bcm2711)
+    {
+        uint32_t bits = pud == SDI12_PUD_UP ? 1 : pud == SDI12_PUD_DOWN ? 2 : 0;    //the BCM2711 swaps up and down
+        uint32_t shift = (pin % 16) * 2;
+        _reg[GPPUPPDN0 + pin / 16] = (_reg[GPPUPPDN0 + pin / 16] & ~(3u << shift)) | (bits << shift);
+        return;
+    }
+    _reg[GPPUD] = pud;                                              //same values as SDI12_PUD_*
+    std::this_thread::sleep_for(std::chrono::microseconds(5));      //at least 150 cycles of set up and hold
+    _reg[GPPUDCLK0 + pin / 32] = 1u << (pin % 32);
+    std::this_thread::sleep_for(std::chrono::microseconds(5));
+    _reg[GPPUD] = SDI12_PUD_OFF;
+    _reg[GPPUDCLK0 + pin / 32] = 0;
+}
+
+// 4 - edge detection is done by the edges backend
+bool SDI12MmioGpio::setEdge(uint8_t pin, uint8_t edge)
+{
+    if(!_edges)
+    {
+        return false;
+    }
+    if(_reg && pin < SDI12_MMIO_PINS && ((_outputs.load(std::memory_order_relaxed) >> pin) & 1))
+    {
+        function(pin, GPIO_FUNCTION_INPUT);
+    }
+    return _edges->setEdge(pin, edge);
+}
+
+int SDI12MmioGpio::waitEdges(uint8_t pin, SDI12Edge *edges, int max, int64_t timeoutUs)
+{
+    return _edges ? _edges->waitEdges(pin, edges, max, timeoutUs) : -1;
+}
+
+void SDI12MmioGpio::wake()
+{
+    if(_edges)
+    {
+        _edges->wake();
+    }
+}
@@ -0,0 +1,135 @@
+/* ============================ In-memory GPIO backend =========================
+Stands in for the Raspberry Pi pins when there is no hardware. Every pin starts LOW with
+no pull resistor and no edge detection. A pull resistor moves the pin to the pulled level,
+the same as an input pin with nothing driving it. Edges injected by a simulated sensor are
+queued per pin, only if edge detection for that pin asks for them, the same as the kernel.
+wake() sets a flag the waiting predicate checks, so a waitEdges() returns even with no edge.
+*/
+#include <SDI12Gpio.h>
+#include <string.h>
+#include <chrono>
+
+SDI12MockGpio::SDI12MockGpio()
+{
+    for(int i = 0; i < SDI12_MAX_PINS; i++)
+    {
+        _level[i] = SDI12_LOW;
+    }
+    memset(_pud, SDI12_PUD_OFF, sizeof(_pud));
+    memset(_edge, SDI12_EDGE_NONE, sizeof(_edge));
+    _writes = 0;
+    _edgeChanges = 0;
+    _woken = false;
+}
+
+void SDI12MockGpio::write(uint8_t pin, uint8_t level)
+{
+    _level[pin % SDI12_MAX_PINS] = level ? SDI12_HIGH : SDI12_LOW;
+    _writes++;
+}
+
+uint8_t SDI12MockGpio::read(uint8_t pin)
+{
+    return _level[pin % SDI12_MAX_PINS];
+}
+
+void SDI12MockGpio::pull(uint8_t pin, uint8_t pud)
+{
+    pin %= SDI12_MAX_PINS;
+    _pud[pin] = pud;
+    if(pud == SDI12_PUD_UP)
+    {
+        _level[pin] = SDI12_HIGH;
+    }
+    else if(pud == SDI12_PUD_DOWN)
+    {
+        _level[pin] = SDI12_LOW;
+    }
+}
+
+bool SDI12MockGpio::setEdge(uint8_t pin, uint8_t edge)
+{
+    if(pin >= SDI12_MAX_PINS)
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(_lock);
+    _edge[pin] = edge;
+    _edgeChanges++;
+    return true;
+}
+
+int SDI12MockGpio::waitEdges(uint8_t pin, SDI12Edge *edges, int max, int64_t timeoutUs)
+{
+    if(pin >= SDI12_MAX_PINS || max <= 0)
+    {
+        return -1;
+    }
+    std::unique_lock<std::mutex> guard(_lock);
+    if(timeoutUs < 0)
+    {
+        _edgeReady.wait(guard, [&]{ return !_edges[pin].empty() || _woken; });
+    }
+    else
+    {
+        _edgeReady.wait_for(guard, std::chrono::microseconds(timeoutUs), [&]{ return !_edges[pin].empty() || _woken; });
+    }
+    _woken = false;
+    int count = 0;
+    while(count < max && !_edges[pin].empty())
+    {
+        edges[count++] = _edges[pin].front();
+        _edges[pin].pop_front();
+    }
+    return count;
+}
+
+void SDI12MockGpio::wake()
+{
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _woken = true;
+    }
+    _edgeReady.notify_all();
+}
+
+void SDI12MockGpio::injectEdge(uint8_t pin, uint64_t ns, uint8_t level)
+{
+    pin %= SDI12_MAX_PINS;
+    level = level ? SDI12_HIGH : SDI12_LOW;
+    std::lock_guard<std::mutex> guard(_lock);
+    if(_level[pin] == level)
+    {
+        return;                                                     //no change, no edge
+    }
+    _level[pin] = level;
+    uint8_t wanted = (level == SDI12_HIGH) ? SDI12_EDGE_RISING : SDI12_EDGE_FALLING;
+    if(_edge[pin] & wanted)
+    {
+        SDI12Edge edge;
+        edge.ns = ns;
+        edge.level = level;
+        _edges[pin].push_back(edge);
+        _edgeReady.notify_all();
+    }
+}
+
+uint8_t SDI12MockGpio::edge(uint8_t pin) const
+{
+    return _edge[pin % SDI12_MAX_PINS];
+}
+
+uint8_t SDI12MockGpio::pud(uint8_t pin) const
+{
+    return _pud[pin % SDI12_MAX_PINS];
+}
+
+uint32_t SDI12MockGpio::writes() const
+{
+    return _writes;
+}
+
+uint32_t SDI12MockGpio::edgeChanges() const
+{
+    return _edgeChanges;
+}
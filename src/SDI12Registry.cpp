@@ -0,0 +1,261 @@
+/* ================================ Sensor registry =============================
+1 - Constructor, lookups and clear().
+2 - Cache file. An 8 byte header: "SDIR", SDI12_CACHE_VERSION, the number of sensors and the
+SDI-12 CRC-16 (SDI12Crc.h) of the records, least significant byte first. Then one 38 byte
+record per sensor: address, idLength, id (33 bytes), ttt (2 bytes, least significant
+first) and values. Every field is written byte by byte, so the file does not depend on
+the padding or byte order of SDI12Sensor.
+2.1 - load() - a file that is short, has another magic or version, too many sensors or a
+wrong CRC is ignored as a whole and the registry is left empty.
+2.2 - save() - the cache is written to path.tmp and renamed over path, so a crash or power
+cut while saving leaves the old cache or the new one, never half of one.
+3 - Talking to the sensors, every command goes through SDI12::transact().
+3.1 - verify() - one a! per known sensor, sent again up to SDI12_RETRIES times, the ones
+that do not answer are dropped.
+3.2 - discover() - a! at every address from 0 to 9, A to Z and a to z. Most addresses are
+empty, so a! is sent once without the retries of transact(): a scan of 62 addresses costs
+one timeout each instead of four. Only an address where something answered, damaged, is
+asked once more. Sensors already known keep their identification, new ones are identified.
+3.3 - identify() - aI! for the identification, then aIM! for the timing and value count
+of aM!. A sensor that does not answer aIM! (older than SDI-12 1.4) still counts as found.
+*/
+#include <SDI12Registry.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+
+#define SDI12_CACHE_HEADER       8                      //magic, version, count and CRC
+#define SDI12_CACHE_RECORD       (4 + SDI12_ID_LENGTH + 1)   //address, idLength, id, ttt and values
+
+static const char SDI12_CACHE_MAGIC[4] = { 'S', 'D', 'I', 'R' };
+
+// 1 - Constructor
+SDI12Registry::SDI12Registry(SDI12 &bus) : _bus(bus)
+{
+    _count = 0;
+}
+
+void SDI12Registry::clear()
+{
+    _count = 0;
+}
+
+uint8_t SDI12Registry::count() const
+{
+    return _count;
+}
+
+const SDI12Sensor &SDI12Registry::sensor(uint8_t index) const
+{
+    return _sensors[index];
+}
+
+const SDI12Sensor *SDI12Registry::find(char address) const
+{
+    for(uint8_t i = 0; i < _count; i++)
+    {
+        if(_sensors[i].address == address)
+        {
+            return &_sensors[i];
+        }
+    }
+    return 0;
+}
+
+// 2.1 - reads the cache file
+bool SDI12Registry::load(const char *path)
+{
+    uint8_t file[SDI12_CACHE_HEADER + SDI12_MAX_SENSORS * SDI12_CACHE_RECORD];
+    _count = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        return false;
+    }
+    ssize_t length = read(fd, file, sizeof(file));
+    close(fd);
+    if(length < SDI12_CACHE_HEADER || memcmp(file, SDI12_CACHE_MAGIC, 4) != 0 || file[4] != SDI12_CACHE_VERSION)
+    {
+        return false;
+    }
+    uint8_t count = file[5];
+    size_t records = (size_t)count * SDI12_CACHE_RECORD;
+    if(count > SDI12_MAX_SENSORS || (size_t)length != SDI12_CACHE_HEADER + records)
+    {
+        return false;
+    }
+    uint16_t crc = sdi12Crc(std::string_view((const char *)file + SDI12_CACHE_HEADER, records));
+    if(file[6] != (crc & 0xFF) || file[7] != (crc >> 8))
+    {
+        return false;
+    }
+    for(uint8_t i = 0; i < count; i++)
+    {
+        const uint8_t *record = file + SDI12_CACHE_HEADER + i * SDI12_CACHE_RECORD;
+        SDI12Sensor &sensor = _sensors[i];
+        sensor.address = (char)record[0];
+        sensor.idLength = record[1] > SDI12_ID_LENGTH ? SDI12_ID_LENGTH : record[1];
+        memcpy(sensor.id, record + 2, SDI12_ID_LENGTH);
+        sensor.ttt = record[2 + SDI12_ID_LENGTH] | (record[3 + SDI12_ID_LENGTH] << 8);
+        sensor.values = record[4 + SDI12_ID_LENGTH];
+    }
+    _count = count;
+    return true;
+}
+
+// 2.2 - writes the cache file to path.tmp and renames it over path
+bool SDI12Registry::save(const char *path) const
+{
+    uint8_t file[SDI12_CACHE_HEADER + SDI12_MAX_SENSORS * SDI12_CACHE_RECORD];
+    size_t records = (size_t)_count * SDI12_CACHE_RECORD;
+    memset(file, 0, sizeof(file));
+    memcpy(file, SDI12_CACHE_MAGIC, 4);
+    file[4] = SDI12_CACHE_VERSION;
+    file[5] = _count;
+    for(uint8_t i = 0; i < _count; i++)
+    {
+        uint8_t *record = file + SDI12_CACHE_HEADER + i * SDI12_CACHE_RECORD;
+        const SDI12Sensor &sensor = _sensors[i];
+        record[0] = (uint8_t)sensor.address;
+        record[1] = sensor.idLength;
+        memcpy(record + 2, sensor.id, sensor.idLength);
+        record[2 + SDI12_ID_LENGTH] = sensor.ttt & 0xFF;
+        record[3 + SDI12_ID_LENGTH] = sensor.ttt >> 8;
+        record[4 + SDI12_ID_LENGTH] = sensor.values;
+    }
+    uint16_t crc = sdi12Crc(std::string_view((const char *)file + SDI12_CACHE_HEADER, records));
+    file[6] = crc & 0xFF;
+    file[7] = crc >> 8;
+
+    std::string temporary = std::string(path) + ".tmp";
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0)
+    {
+        return false;
+    }
+    size_t length = SDI12_CACHE_HEADER + records;
+    bool written = write(fd, file, length) == (ssize_t)length && fsync(fd) == 0;
+    close(fd);
+    if(!written || rename(temporary.c_str(), path) != 0)
+    {
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+// 3 - a!, sent again up to retries times, SDI12_OK if the sensor at address answered
+SDI12Status SDI12Registry::acknowledge(char address, uint8_t retries)
+{
+    SDI12Response response;
+    SDI12Status status = _bus.transact(SDI12Command(address, ""), std::chrono::milliseconds(SDI12_ACK_TIMEOUT_MS), response, retries);
+    if(status == SDI12_OK)
+    {
+        _bus.releaseResponse();
+    }
+    return status;
+}
+
+// 3.1 - keeps the known sensors that still answer
+uint8_t SDI12Registry::verify()
+{
+    uint8_t kept = 0;
+    for(uint8_t i = 0; i < _count; i++)
+    {
+        if(acknowledge(_sensors[i].address, SDI12_RETRIES) == SDI12_OK)
+        {
+            _sensors[kept++] = _sensors[i];
+        }
+    }
+    _count = kept;
+    return _count;
+}
+
+// 3.2 - scans every address
+uint8_t SDI12Registry::discover()
+{
+    static const char addresses[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    SDI12Sensor known[SDI12_MAX_SENSORS];
+    uint8_t knownCount = _count;
+    memcpy(known, _sensors, sizeof(SDI12Sensor) * _count);
+    _count = 0;
+    for(uint8_t a = 0; a < SDI12_MAX_SENSORS; a++)
+    {
+        char address = addresses[a];
+        SDI12Status status = acknowledge(address, 0);                          //no retries, most addresses are empty
+        if(status != SDI12_OK && status != SDI12_TIMEOUT)                       //something answered, damaged
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(SDI12_RETRY_GAP_MS));    //quiet line before the command again
+            status = acknowledge(address, 0);
+        }
+        if(status != SDI12_OK)
+        {
+            continue;
+        }
+        const SDI12Sensor *cached = 0;
+        for(uint8_t i = 0; i < knownCount && !cached; i++)
+        {
+            cached = known[i].address == address ? &known[i] : 0;
+        }
+        if(cached)                                                              //already identified
+        {
+            _sensors[_count++] = *cached;
+        }
+        else if(identify(address, _sensors[_count]))
+        {
+            _count++;
+        }
+    }
+    return _count;
+}
+
+bool SDI12Registry::refresh(char address)
+{
+    SDI12Sensor sensor;
+    if(!identify(address, sensor))
+    {
+        return false;
+    }
+    for(uint8_t i = 0; i < _count; i++)
+    {
+        if(_sensors[i].address == address)
+        {
+            _sensors[i] = sensor;
+            return true;
+        }
+    }
+    if(_count == SDI12_MAX_SENSORS)
+    {
+        return false;
+    }
+    _sensors[_count++] = sensor;
+    return true;
+}
+
+// 3.3 - aI! then aIM!
+bool SDI12Registry::identify(char address, SDI12Sensor &sensor)
+{
+    SDI12Response response;
+    if(_bus.transact(SDI12Command(address, "I"), std::chrono::milliseconds(SDI12_DATA_TIMEOUT_MS), response) != SDI12_OK)
+    {
+        return false;
+    }
+    memset(&sensor, 0, sizeof(sensor));
+    sensor.address = address;
+    sensor.idLength = response.line.size() > SDI12_ID_LENGTH ? SDI12_ID_LENGTH : response.line.size();
+    memcpy(sensor.id, response.line.data(), sensor.idLength);
+    _bus.releaseResponse();
+    if(_bus.transact(SDI12Command(address, "IM"), std::chrono::milliseconds(SDI12_ACK_TIMEOUT_MS), response) == SDI12_OK)
+    {
+        if(!sdi12ParseTiming(response.line, sensor.ttt, sensor.values))
+        {
+            sensor.ttt = 0;
+            sensor.values = 0;
+        }
+        _bus.releaseResponse();
+    }
+    return true;
+}
@@ -0,0 +1,318 @@
+/* ============================ Measurement scheduler ===========================
+1 - Constructor, adding sensors and the reading handler.
+2 - Deadline queue. _queue is a binary heap kept with std::push_heap/std::pop_heap, the
+sensor due first is _queue[0]. runOnce() sleeps until it is due, runs its measurement and
+puts it back with its next due time. A sensor that overran its interval is due at once
+instead of trying to catch up on the measurements it missed.
+3 - Every command goes through SDI12::transact(): stale characters are flushed, a response
+from another address is SDI12_INVALID and a failed command is sent again on its own,
+following the retry rules of the standard.
+4 - Measurement sequence.
+4.1 - start() - aM!/aC! is answered with atttn: the address, ttt seconds until the data is
+ready and n (1 digit for aM!, 2 for aC!) values.
+4.2 - For aM!, if ttt is not 0, sleep until the service request a<CR><LF> or until ttt has
+passed. Either way the data is asked for next, as the standard says. For aC! the sensor is
+put back in the queue due in ttt seconds and the bus goes on with other sensors.
+4.3 - harvest() - aD0!, aD1!, ... are sent until n values have been received. A response
+with no values means the sensor has nothing more. Each aDn! is retried on its own, up to
+SDI12_DATA_RETRIES times, by transact() when its response is missing, has a parity error or
+fails its CRC (sdi12CrcValid() is the check).
+4.4 - deliver() - the reading is handed to the handler, SDI12_INVALID if fewer than n values
+arrived.
+5 - Following a configuration. runOnce() compares the watcher's generation with _applied
+before it picks the next sensor: one atomic load, nothing else while the configuration is
+unchanged.
+5.1 - apply() - every queued sensor is refreshed from the new snapshot or removed, sensors
+the previous snapshot did not list are added and the heap is rebuilt. A sensor with a
+shorter interval than before is due no later than now + its new interval. A sensor waiting
+for its concurrent measurement is only marked stale; it is refreshed, or removed, once its
+data has been harvested. A sensor that ran once (interval 0) is not added again as long as
+the configuration still lists it.
+*/
+#include <SDI12Scheduler.h>
+#include <algorithm>
+#include <thread>
+#include <string.h>
+
+// 1 - Constructor
+SDI12Scheduler::SDI12Scheduler(SDI12 &bus) : _bus(bus)
+{
+    _count = 0;
+    _handler = 0;
+    _user = 0;
+    _watcher = 0;
+    _busName[0] = '\0';
+    _applied = 0;
+    _configBus = -1;
+}
+
+// 1 - adds a sensor, its first measurement is due at once
+bool SDI12Scheduler::add(char address, std::string_view command, std::chrono::milliseconds interval)
+{
+    if(_count == SDI12_MAX_SENSORS || !configure(_queue[_count], address, command, interval))
+    {
+        return false;
+    }
+    _queue[_count].due = std::chrono::steady_clock::now();
+    _queue[_count].harvesting = false;
+    _queue[_count].stale = false;
+    _queue[_count].values = 0;
+    _count++;
+    std::push_heap(_queue, _queue + _count, later);
+    return true;
+}
+
+// 1 - sets the command and interval of an entry
+bool SDI12Scheduler::configure(Entry &entry, char address, std::string_view command, std::chrono::milliseconds interval)
+{
+    SDI12Command built(address, command);
+    if(built.overflow())
+    {
+        return false;
+    }
+    entry.interval = interval;
+    entry.command = built;
+    entry.concurrent = command.size() > 0 && command[0] == 'C';
+    entry.crc = command.size() > 1 && (command[0] == 'M' || command[0] == 'C') && command[1] == 'C';
+    return true;
+}
+
+// 5 - follows a configuration, the first snapshot is applied by the next runOnce()
+void SDI12Scheduler::follow(const SDI12ConfigWatcher &watcher, std::string_view bus)
+{
+    size_t length = bus.size() < SDI12_CONFIG_NAME ? bus.size() : SDI12_CONFIG_NAME - 1;
+    memcpy(_busName, bus.data(), length);
+    _busName[length] = '\0';
+    _watcher = &watcher;
+    _applied = watcher.generation() - 1;                                        //differs, so the next runOnce() applies it
+}
+
+void SDI12Scheduler::onReading(SDI12ReadingHandler handler, void *user)
+{
+    _handler = handler;
+    _user = user;
+}
+
+uint8_t SDI12Scheduler::pending() const
+{
+    return _count;
+}
+
+// 2 - heap order, the entry due first is on top
+bool SDI12Scheduler::later(const Entry &a, const Entry &b)
+{
+    return a.due > b.due;
+}
+
+// 2 - runs the measurement due first if it is due before until, otherwise sleeps until until
+bool SDI12Scheduler::runOnce(std::chrono::steady_clock::time_point until)
+{
+    if(_watcher && _watcher->generation() != _applied)                         // 5 - a new configuration, between two measurements
+    {
+        apply();
+    }
+    if(_count == 0 || _queue[0].due > until)
+    {
+        std::this_thread::sleep_until(until);
+        return false;
+    }
+    std::this_thread::sleep_until(_queue[0].due);
+    std::pop_heap(_queue, _queue + _count, later);
+    Entry &entry = _queue[_count - 1];
+    uint16_t ttt = 0;
+    if(entry.harvesting)                                                        //concurrent measurement ready
+    {
+        harvest(entry);
+    }
+    else if(start(entry, ttt))
+    {
+        if(entry.concurrent)                                                    // 4.2 - come back when the data is ready
+        {
+            entry.harvesting = true;
+            entry.due = entry.started + std::chrono::seconds(ttt);
+            std::push_heap(_queue, _queue + _count, later);
+            return true;
+        }
+        if(ttt > 0)                                                             // 4.2 - service request or ttt
+        {
+            SDI12Response request = _bus.awaitResponse(entry.started + std::chrono::seconds(ttt));
+            if(request.status == SDI12_OK)
+            {
+                _bus.releaseResponse();
+            }
+        }
+        harvest(entry);
+    }
+    if(entry.stale && !refresh(entry))                                          // 5.1 - removed while it was measuring
+    {
+        _count--;
+        return true;
+    }
+    if(entry.interval.count() == 0)                                             //runs once
+    {
+        _count--;
+        return true;
+    }
+    entry.due = entry.started + entry.interval;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if(entry.due < now)                                                         //overran, due at once
+    {
+        entry.due = now;
+    }
+    std::push_heap(_queue, _queue + _count, later);
+    return true;
+}
+
+// 2 - runs measurements until running is false, checking it at least every 100 ms
+void SDI12Scheduler::run(const std::atomic<bool> &running)
+{
+    while(running)
+    {
+        runOnce(std::chrono::steady_clock::now() + std::chrono::milliseconds(100));
+    }
+}
+
+// 4.1 - sends the measurement command and reads atttn, delivers a failed reading if that goes wrong
+bool SDI12Scheduler::start(Entry &entry, uint16_t &ttt)
+{
+    char address = entry.command.address();
+    entry.started = std::chrono::steady_clock::now();
+    entry.values = 0;
+    ttt = 0;
+    SDI12Response response;
+    SDI12Status status = _bus.transact(entry.command, std::chrono::milliseconds(SDI12_ACK_TIMEOUT_MS), response);
+    if(status == SDI12_OK)
+    {
+        bool valid = sdi12ParseTiming(response.line, ttt, entry.values);
+        _bus.releaseResponse();
+        status = valid ? SDI12_OK : SDI12_INVALID;
+    }
+    if(status != SDI12_OK)
+    {
+        _reading.address = address;
+        _reading.time = entry.started;
+        _reading.status = status;
+        _reading.data.clear(address);
+        deliver();
+        return false;
+    }
+    return true;
+}
+
+// 4.3 - collects aD0!..aD9! until every announced value has arrived
+void SDI12Scheduler::harvest(Entry &entry)
+{
+    char address = entry.command.address();
+    entry.harvesting = false;
+    _reading.address = address;
+    _reading.time = entry.started;
+    _reading.status = SDI12_OK;
+    _reading.data.clear(address);
+    SDI12Response response;
+    for(uint8_t d = 0; _reading.status == SDI12_OK && d <= 9 && _reading.data.count() < entry.values; d++)
+    {
+        char data[2] = { 'D', (char)('0' + d) };
+        SDI12Command command(address, std::string_view(data, 2));
+        uint8_t before = _reading.data.count();
+        _reading.status = _bus.transact(command, std::chrono::milliseconds(SDI12_DATA_TIMEOUT_MS), response,
+                                        SDI12_DATA_RETRIES, entry.crc ? sdi12CrcValid : 0);    //only this aDn! is sent again
+        if(_reading.status == SDI12_OK)
+        {
+            std::string_view line = response.line;
+            if(entry.crc)
+            {
+                line.remove_suffix(SDI12_CRC_LENGTH);
+            }
+            bool valid = _reading.data.parse(line, true);
+            _bus.releaseResponse();
+            _reading.status = valid ? SDI12_OK : SDI12_INVALID;
+        }
+        if(_reading.status == SDI12_OK && _reading.data.count() == before)     //no more values
+        {
+            break;
+        }
+    }
+    if(_reading.status == SDI12_OK && _reading.data.count() < entry.values)
+    {
+        _reading.status = SDI12_INVALID;
+    }
+    deliver();
+}
+
+// 4.4 - hands the reading to the handler
+void SDI12Scheduler::deliver()
+{
+    if(_handler)
+    {
+        _handler(_reading, _user);
+    }
+}
+
+// 5.1 - applies the newest snapshot of the configuration followed
+void SDI12Scheduler::apply()
+{
+    _applied = _watcher->generation();
+    std::shared_ptr<const SDI12Config> config = _watcher->current();
+    if(!config)
+    {
+        return;
+    }
+    std::shared_ptr<const SDI12Config> previous = config;
+    previous.swap(_config);
+    int previousBus = _configBus;
+    _configBus = _busName[0] ? config->findBus(_busName) : config->buses() == 1 ? 0 : -1;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    for(uint8_t i = 0; i < _count; )
+    {
+        Entry &entry = _queue[i];
+        if(entry.harvesting)
+        {
+            entry.stale = true;
+            i++;
+            continue;
+        }
+        std::chrono::milliseconds interval = entry.interval;
+        if(!refresh(entry))
+        {
+            entry = _queue[--_count];
+            continue;
+        }
+        if(entry.interval.count() > 0 && entry.interval < interval && entry.due > now + entry.interval)
+        {
+            entry.due = now + entry.interval;
+        }
+        i++;
+    }
+    std::make_heap(_queue, _queue + _count, later);
+    for(uint8_t i = 0; _configBus >= 0 && i < config->sensors(); i++)
+    {
+        const SDI12SensorConfig &sensor = config->sensor(i);
+        if(sensor.bus != _configBus || (previous && previousBus >= 0 && previous->findSensor(previousBus, sensor.address) >= 0))
+        {
+            continue;
+        }
+        bool queued = false;
+        for(uint8_t j = 0; j < _count && !queued; j++)
+        {
+            queued = _queue[j].command.address() == sensor.address;
+        }
+        if(!queued)
+        {
+            add(sensor.address, sensor.measurement(), sensor.interval);
+        }
+    }
+}
+
+// 5.1 - takes the command and interval of a sensor from _config
+bool SDI12Scheduler::refresh(Entry &entry)
+{
+    entry.stale = false;
+    char address = entry.command.address();
+    int index = _configBus < 0 ? -1 : _config->findSensor(_configBus, address);
+    if(index < 0)
+    {
+        return false;
+    }
+    const SDI12SensorConfig &sensor = _config->sensor(index);
+    return configure(entry, address, sensor.measurement(), sensor.interval);
+}
@@ -0,0 +1,241 @@
+/* ================================ Serial transport ============================
+1 - Constructors and destructor. configure() sets raw mode, 1200 baud, CS7 | PARENB with
+CREAD and CLOCAL, INPCK | PARMRK | IGNBRK on input and VMIN 0 / VTIME 0, so a read never
+blocks: receive() sleeps in ppoll() instead.
+2 - sendBreak() - TIOCSBRK, a sleep of ns, TIOCCBRK. hold() is the first or second half.
+3 - send() - write() until every byte is queued, tcdrain() until they have left, then
+tcflush(TCIFLUSH) drops anything received while transmitting.
+4 - receive() - ppoll() for up to timeoutUs, on the tty and the eventfd of wake(), then one read of what is there. The PARMRK
+marks are parsed byte by byte with _marked, so a mark split across two reads still
+decodes: \377 \377 is a \377 character, \377 \0 c is c with a parity or framing error.
+The tty does not timestamp characters: the last one read is taken to have ended now and
+the ones before it a character time apart.
+*/
+#include <SDI12Uart.h>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+
+// returns CLOCK_MONOTONIC in nanoseconds, the clock of the frame timestamps
+static uint64_t monotonicNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// 1 - raw 1200 baud 7E1, parity and framing errors marked, breaks ignored
+static bool configure(int fd)
+{
+    struct termios tty;
+    if(tcgetattr(fd, &tty) < 0)
+    {
+        return false;
+    }
+    cfmakeraw(&tty);
+    tty.c_cflag &= ~(CSIZE | PARODD | CSTOPB | CRTSCTS);
+    tty.c_cflag |= CS7 | PARENB | CREAD | CLOCAL;
+    tty.c_iflag &= ~(IGNPAR | ISTRIP | IXON | IXOFF);
+    tty.c_iflag |= INPCK | PARMRK | IGNBRK;
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+    cfsetispeed(&tty, B1200);
+    cfsetospeed(&tty, B1200);
+    return tcsetattr(fd, TCSANOW, &tty) == 0 && tcflush(fd, TCIOFLUSH) == 0;
+}
+
+// 1 - Constructor opens the tty
+SDI12Uart::SDI12Uart(const char *path)
+{
+    _marked = 0;
+    _wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    _fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if(_fd < 0)
+    {
+        std::cout << "SDI12Uart: cannot open " << path << " : " << strerror(errno) << "\n";
+        return;
+    }
+    if(!configure(_fd))
+    {
+        std::cout << "SDI12Uart: cannot configure " << path << " : " << strerror(errno) << "\n";
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+// 1 - Constructor with a tty the caller opened
+SDI12Uart::SDI12Uart(int fd)
+{
+    _marked = 0;
+    _wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    _fd = fd;
+    if(_fd >= 0 && !configure(_fd))
+    {
+        std::cout << "SDI12Uart: cannot configure fd " << fd << " : " << strerror(errno) << "\n";
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+// 1 - Destructor
+SDI12Uart::~SDI12Uart()
+{
+    if(_fd >= 0)
+    {
+        close(_fd);
+    }
+    if(_wakeFd >= 0)
+    {
+        close(_wakeFd);
+    }
+}
+
+bool SDI12Uart::ready() const
+{
+    return _fd >= 0;
+}
+
+int SDI12Uart::fd() const
+{
+    return _fd;
+}
+
+// 2 - the break, timed here rather than by tcsendbreak()
+bool SDI12Uart::sendBreak(uint64_t ns)
+{
+    if(!hold(true))
+    {
+        return false;
+    }
+    std::this_thread::sleep_for(std::chrono::nanoseconds(ns));
+    return hold(false);
+}
+
+// 2 - starts or ends a break
+bool SDI12Uart::hold(bool on)
+{
+    return _fd >= 0 && ioctl(_fd, on ? TIOCSBRK : TIOCCBRK) == 0;
+}
+
+// 3 - writes text and waits until it has left
+bool SDI12Uart::send(std::string_view text)
+{
+    if(_fd < 0)
+    {
+        return false;
+    }
+    size_t sent = 0;
+    while(sent < text.size())
+    {
+        ssize_t done = ::write(_fd, text.data() + sent, text.size() - sent);
+        if(done < 0 && errno != EAGAIN && errno != EINTR)
+        {
+            return false;
+        }
+        if(done < 0)
+        {
+            struct pollfd pfd;
+            pfd.fd = _fd;
+            pfd.events = POLLOUT;
+            poll(&pfd, 1, 100);
+            continue;
+        }
+        sent += done;
+    }
+    bool drained = tcdrain(_fd) == 0;
+    tcflush(_fd, TCIFLUSH);                                         //our own characters, if the bus echoes them
+    return drained;
+}
+
+// 4 - sleeps until characters arrive and turns them into frames
+int SDI12Uart::receive(SDI12Frame *frames, int max, int64_t timeoutUs)
+{
+    if(_fd < 0 || max <= 0)
+    {
+        return -1;
+    }
+    struct pollfd pfd[2];
+    pfd[0].fd = _fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = _wakeFd;                                            //-1 without an eventfd, ppoll() skips it
+    pfd[1].events = POLLIN;
+    pfd[1].revents = 0;
+    struct timespec timeout;
+    timeout.tv_sec = timeoutUs / 1000000;
+    timeout.tv_nsec = (timeoutUs % 1000000) * 1000;
+    int ready = ppoll(pfd, 2, timeoutUs < 0 ? 0 : &timeout, 0);
+    if(ready <= 0)
+    {
+        return (ready < 0 && errno != EINTR) ? -1 : 0;
+    }
+    if(pfd[1].revents & POLLIN)                                     //wake(), clear it
+    {
+        uint64_t count;
+        ssize_t done = ::read(_wakeFd, &count, sizeof(count));
+        (void)done;
+    }
+    if(!pfd[0].revents)                                             //only woken, no characters
+    {
+        return 0;
+    }
+    uint8_t bytes[64];
+    ssize_t got = ::read(_fd, bytes, (size_t)max < sizeof(bytes) ? (size_t)max : sizeof(bytes));
+    if(got < 0)
+    {
+        return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+    }
+    int count = 0;
+    for(ssize_t i = 0; i < got; i++)
+    {
+        uint8_t status = SDI12_FRAME_OK;
+        if(_marked == 0 && bytes[i] == 0377)                        //start of a mark or an escaped \377
+        {
+            _marked = 1;
+            continue;
+        }
+        if(_marked == 1)
+        {
+            if(bytes[i] == 0)                                       //\377 \0, the character follows
+            {
+                _marked = 2;
+                continue;
+            }
+            _marked = 0;                                            //\377 \377
+        }
+        else if(_marked == 2)
+        {
+            status = SDI12_FRAME_PARITY;
+            _marked = 0;
+        }
+        frames[count].data = bytes[i] & 0x7F;
+        frames[count].status = status;
+        frames[count].bitNs = 0;                                    //the UART keeps the time, nothing to learn
+        count++;
+    }
+    uint64_t now = monotonicNs();
+    for(int i = 0; i < count; i++)
+    {
+        frames[i].ns = now - (count - i) * SDI12_UART_FRAME_NS;
+    }
+    return count;
+}
+
+// 4 - ends the ppoll() of receive() in another thread
+void SDI12Uart::wake()
+{
+    uint64_t one = 1;
+    if(_wakeFd >= 0)
+    {
+        ssize_t done = ::write(_wakeFd, &one, sizeof(one));         //fails only with a wake up already pending
+        (void)done;
+    }
+}
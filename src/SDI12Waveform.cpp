@@ -0,0 +1,158 @@
+/* ============================ Transmit waveform ===============================
+1 - Compiling. level() appends "hold this level for this long" to the schedule and only
+stores an edge when the level changes, so a run of equal bits costs nothing.
+1.1 - wake() - spacing for SDI12_BREAK_NS then marking for SDI12_MARKING_NS. mark() - the
+marking alone. It adds no edge, the pin is already marking, only the first frame is delayed.
+1.2 - addChar() - start bit, 7 data bits least significant bit first, even parity bit
+and stop bit, taken as a whole from the compile time frame table (SDI12FrameTable.h).
+2 - Playing. Every edge has an absolute deadline, start + offset. The thread sleeps with
+clock_nanosleep(TIMER_ABSTIME) until spinNs before the deadline, spins on clock_gettime()
+until the deadline and writes the pin. The lateness of every write goes into the report.
+play() returns once the last stop bit has been on the line for a full bit period, with
+the time the schedule started, so the edges can be put on the clock of the RX edges (see
+SDI12Capture.h).
+*/
+#include <SDI12Waveform.h>
+#include <time.h>
+
+// returns CLOCK_MONOTONIC in nanoseconds
+static uint64_t monotonicNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// sleeps until spinNs before deadline, then spins until deadline. Returns the time spent spinning.
+static uint64_t waitUntil(uint64_t deadline, uint32_t spinNs)
+{
+    uint64_t now = monotonicNs();
+    if(deadline > now + spinNs)
+    {
+        struct timespec wake;
+        wake.tv_sec = (deadline - spinNs) / 1000000000ULL;
+        wake.tv_nsec = (deadline - spinNs) % 1000000000ULL;
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, 0) != 0)
+        {
+        }
+    }
+    uint64_t spinStart = monotonicNs();
+    while(monotonicNs() < deadline)
+    {
+    }
+    return monotonicNs() - spinStart;
+}
+
+SDI12Waveform::SDI12Waveform()
+{
+    clear();
+}
+
+void SDI12Waveform::clear()
+{
+    _count = 0;
+    _ns = 0;
+    _level = SDI12_HIGH;
+}
+
+// 1 - holds level for ns nanoseconds from the end of the schedule
+void SDI12Waveform::level(uint8_t level, uint64_t ns)
+{
+    if(level != _level)
+    {
+        _edges[_count].ns = _ns;
+        _edges[_count].level = level;
+        _count++;
+        _level = level;
+    }
+    _ns += ns;
+}
+
+// 1.1 - break and marking
+void SDI12Waveform::wake()
+{
+    if(_count >= SDI12_WAVE_MAX_EDGES - 1)
+    {
+        return;
+    }
+    level(SDI12_LOW, SDI12_BREAK_NS);
+    level(SDI12_HIGH, SDI12_MARKING_NS);
+}
+
+// 1.1 - marking only, the sensors are still awake
+void SDI12Waveform::mark()
+{
+    level(SDI12_HIGH, SDI12_MARKING_NS);
+}
+
+// 1.2 - one 7E1 frame
+bool SDI12Waveform::addChar(uint8_t out)
+{
+    if(_count + SDI12_FRAME_BITS > SDI12_WAVE_MAX_EDGES)
+    {
+        return false;
+    }
+    uint16_t frame = sdi12Encode(out);                              //start, data, parity and stop bits
+    for(uint8_t bit = 0; bit < SDI12_FRAME_BITS; bit++)
+    {
+        level((frame >> bit) & 1, SDI12_BIT_NS);
+    }
+    return true;
+}
+
+bool SDI12Waveform::addString(std::string_view cmd)
+{
+    for(size_t i = 0; i < cmd.size(); i++)
+    {
+        if(!addChar(cmd[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint16_t SDI12Waveform::edges() const
+{
+    return _count;
+}
+
+const SDI12Edge *SDI12Waveform::schedule() const
+{
+    return _edges;
+}
+
+uint64_t SDI12Waveform::duration() const
+{
+    return _ns;
+}
+
+// 2 - writes every edge at its absolute deadline
+uint64_t SDI12Waveform::play(SDI12Gpio *gpio, uint8_t pin, SDI12Jitter *report, uint32_t spinNs) const
+{
+    int64_t lateSum = 0;
+    int64_t lateMax = 0;
+    uint64_t spin = 0;
+    uint64_t start = monotonicNs() + spinNs;                        //the first edge is spun for as well
+    for(uint16_t i = 0; i < _count; i++)
+    {
+        uint64_t deadline = start + _edges[i].ns;
+        spin += waitUntil(deadline, spinNs);
+        int64_t late = (int64_t)(monotonicNs() - deadline);
+        gpio->write(pin, _edges[i].level);
+        lateSum += late;
+        if(late > lateMax)
+        {
+            lateMax = late;
+        }
+    }
+    spin += waitUntil(start + _ns, spinNs);                         //last stop bit
+    if(report)
+    {
+        report->edges = _count;
+        report->maxLateNs = lateMax;
+        report->meanLateNs = _count ? lateSum / _count : 0;
+        report->spinNs = spin;
+    }
+    return start;
+}
@@ -0,0 +1,157 @@
+/* ================================== I/O worker ================================
+1 - Constructor and destructor. The worker thread is started by the constructor and stopped
+by the destructor, which wakes it through the semaphore.
+2 - submit() - claims the next position with a compare and swap on _enqueue. The slot at
+that position is free when its seq equals the position; if it still holds a transaction
+from one lap earlier the queue is full and the future is ready at once with
+SDI12_OVERFLOW. The slot is filled, published with a release store of position + 1 and
+the worker is woken with sem_post().
+3 - work() - body of the worker thread.
+3.1 - Lock memory, touch SDI12_WORKER_STACK of stack, then pin and raise the worker and the
+listening thread. Whether all of it was granted is kept for realtime().
+3.2 - Sleep on the semaphore, waking every 50 ms to notice the destructor. After every post
+or timeout the worker takes slots in order for as long as the one at _dequeue has seq
+_dequeue + 1, not one slot per post: producers publish out of order, so the post of a later
+slot may arrive while an earlier one is still being filled, and its transaction has to be
+found on a later pass instead of waiting for a post that was already used. Each slot is
+handed back for the next lap with _dequeue + SDI12_WORKER_QUEUE before the command runs,
+so submit() is never held up by a command on the wire.
+3.3 - The command runs through SDI12::transact() and the response line is copied into the
+transaction before it is released from the bus buffer.
+*/
+#include <SDI12Worker.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+// 1 - Constructor
+SDI12Worker::SDI12Worker(SDI12 &bus, int cpu, int priority, bool lockMemory) : _bus(bus)
+{
+    for(size_t i = 0; i < SDI12_WORKER_QUEUE; i++)
+    {
+        _queue[i].seq.store(i, std::memory_order_relaxed);
+    }
+    _enqueue = 0;
+    _dequeue = 0;
+    _cpu = cpu;
+    _priority = priority;
+    _lockMemory = lockMemory;
+    _realtime = false;
+    _running = true;
+    sem_init(&_pending, 0, 0);
+    _thread = std::thread(&SDI12Worker::work, this);
+}
+
+// 1 - Destructor
+SDI12Worker::~SDI12Worker()
+{
+    _running = false;
+    sem_post(&_pending);
+    _thread.join();
+    sem_destroy(&_pending);
+}
+
+bool SDI12Worker::realtime() const
+{
+    return _realtime;
+}
+
+// 2 - queues a transaction, several threads may submit at once
+std::future<SDI12Transaction> SDI12Worker::submit(const SDI12Command &command, std::chrono::milliseconds timeout)
+{
+    std::promise<SDI12Transaction> promise;
+    std::future<SDI12Transaction> future = promise.get_future();
+    size_t position = _enqueue.load(std::memory_order_relaxed);
+    Request *request;
+    while(true)
+    {
+        request = &_queue[position & (SDI12_WORKER_QUEUE - 1)];
+        intptr_t lap = (intptr_t)request->seq.load(std::memory_order_acquire) - (intptr_t)position;
+        if(lap == 0 && _enqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+        {
+            break;                                                              //the slot is ours
+        }
+        if(lap < 0)                                                             //the worker has not taken it yet, full
+        {
+            SDI12Transaction full;
+            full.status = SDI12_OVERFLOW;
+            full.length = 0;
+            promise.set_value(full);
+            return future;
+        }
+        if(lap > 0)                                                             //another thread claimed it first
+        {
+            position = _enqueue.load(std::memory_order_relaxed);
+        }
+    }
+    request->command = command;
+    request->timeout = timeout;
+    request->promise = std::move(promise);
+    request->seq.store(position + 1, std::memory_order_release);
+    sem_post(&_pending);
+    return future;
+}
+
+// 3 - body of the worker thread
+void SDI12Worker::work()
+{
+    bool granted = true;                                                        // 3.1
+    if(_lockMemory)
+    {
+        granted = mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+        volatile char stack[SDI12_WORKER_STACK];
+        memset((char *)stack, 0, sizeof(stack));
+    }
+    granted = sdi12Realtime(pthread_self(), _cpu, _priority) && granted;
+    if(_cpu >= 0 || _priority > 0)
+    {
+        granted = _bus.realtimeListener(_cpu, _priority) && granted;
+    }
+    _realtime = granted;
+
+    while(_running)
+    {
+        struct timespec wake;                                                   // 3.2 - wait for work
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_nsec += 50000000;
+        if(wake.tv_nsec >= 1000000000)
+        {
+            wake.tv_sec++;
+            wake.tv_nsec -= 1000000000;
+        }
+        sem_timedwait(&_pending, &wake);                                        //a post or the timeout, the queue is looked at either way
+        while(_running)
+        {
+            Request &request = _queue[_dequeue & (SDI12_WORKER_QUEUE - 1)];
+            if(request.seq.load(std::memory_order_acquire) != _dequeue + 1)   //not published yet, the next post brings it
+            {
+                break;
+            }
+            SDI12Command command = request.command;
+            std::chrono::milliseconds timeout = request.timeout;
+            std::promise<SDI12Transaction> promise = std::move(request.promise);
+            request.seq.store(_dequeue + SDI12_WORKER_QUEUE, std::memory_order_release);
+            _dequeue++;
+
+            SDI12Transaction transaction;                                       // 3.3 - run it
+            SDI12Response response;
+            transaction.length = 0;
+            transaction.status = _bus.transact(command, timeout, response);
+            if(transaction.status == SDI12_OK)
+            {
+                if(response.line.size() > SDI12_RESPONSE_MAX)
+                {
+                    transaction.status = SDI12_OVERFLOW;
+                }
+                else
+                {
+                    transaction.length = response.line.size();
+                    memcpy(transaction.line, response.line.data(), transaction.length);
+                }
+                _bus.releaseResponse();
+            }
+            promise.set_value(transaction);
+        }
+    }
+}